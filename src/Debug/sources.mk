@@ -15,6 +15,8 @@ C_DEPS :=
 SUBDIRS := \
 . \
 storage/avr \
+storage/cache \
+storage/mmap \
 storage/stdio \
 test \
 
@@ -34,7 +34,8 @@
  * 1)  Fast write is important, read can be a little slower.
  * 2)  Fragmentation shall be supported, to support deletion.
  * 3)  Filenames are not needed. Numeric index is fine.
- * 4)  An amount of 126 records (files) is more than enough.
+ * 4)  An amount of 126 records (files) is more than enough
+ *     (FROGFS_USE_EXTENDED_INDEX extends the index range for sparse numbering).
  * 5)  A certain boot-time to sync filesystem to RAM is accepted.
  * 6)  Wear-leveling is not managed by the filesystem. It can be
  *     implemented in a lower or upper layer.
@@ -42,6 +43,8 @@
  * Record
  *
  * <rec.type:rec index>|<data.type:MSB offset/size>|<LSB offset/size>
+ * <rec.type:1:rec index MSB>|<rec index LSB>|<data.type:MSB offset/size>|<LSB offset/size>
+ *      (FROGFS_USE_EXTENDED_INDEX)
  * rec.type : 0->normal ; 1->fragment
  * data.type: 0->pointer; 1->size
  *
@@ -51,8 +54,10 @@
  *
  * A fragment type record with size data type
  *      SHALL be found as first record at the position pointed from pointer fragment.
- *      SHALL be after either empty space, end of data of a normal record or another.
- *      fragment (FUTURE: support >32K files and storages).
+ *      SHALL be after either empty space, end of data of a normal record or another
+ *      fragment.
+ *      It is also used to chain the data of a record beyond the size a single block can
+ *      hold (FROGFS_MAX_BLOCK_SIZE): the record size is only bounded by the storage.
  *
  * A normal type record with size data type
  *      SHALL be before record data and indicates an entire record.
@@ -74,13 +79,46 @@
  *  storage.
  *  At boot, all the records are loaded so that it is known which records are existing
  *  and which are not and more importantly where they are starting.
+ *  With FROGFS_USE_EXTENDED_INDEX, the table is hashed on the record index, so that its
+ *  size follows the number of records existing at the same time and not the index range.
+ *  All the RAM state belongs to a volume (t_s_frogfs_volume), together with the storage
+ *  instance it lives on: independent volumes can be mounted side by side.
  *
- *  Holes (performance ideas)
+ *  Holes
  *
  *  For performance, holes are mapped in RAM to speedup fragmentation space retrieval.
- *  There is a maximum number of holes after which another search shall be done.
- *  -> done at boot
- *  -> done periodically when no operations due.
+ *  There is a maximum number of holes (FROGFS_MAX_FREE_EXTENTS) after which another search shall be done.
+ *  -> done at boot (or at the first allocation, if the allocation table came from the checkpoint)
+ *  -> kept up to date by the write, close and erase operations.
+ *  -> done again when the map overflowed and no mapped hole is large enough.
+ *  -> or built a piece at a time, in the idle time of the application, by frogfs_maintenance_step.
+ *  A new record takes the first hole, or with frogfs_open_sized the smallest hole that takes
+ *  its expected size whole (else the largest one). New fragments take the first hole.
+ *
+ *  Append
+ *
+ *  The FROGFS_APPEND_RESERVED_SPACE bytes after the data of the last block of a record
+ *  are never allocated: they hold the fragment pointer when the record is appended to
+ *  (frogfs_open_append) and the space after them is already used by another block.
+ *  A scan recognizes them as the free space right after a sized block that is not
+ *  followed by a fragment pointer.
+ *
+ *  High-water mark
+ *
+ *  With FROGFS_USE_QUICK_FORMAT, the header holds the offset up to which the storage is
+ *  formatted. Everything after it is free space that is not read: the scans stop there.
+ *  The storage is zeroed and the mark moved forward before a block or its data (and the
+ *  zeroed bytes that shall follow them) get past it.
+ *  It is moved back when the records at the end of the storage are erased (and after a
+ *  scan, if a power cut left it high), so that the boot time follows the used space.
+ *
+ *  Compaction
+ *
+ *  With FROGFS_USE_COMPACTION, frogfs_compact moves the records one by one into a single
+ *  block at the first free extent before them (or, for a fragmented record, anywhere it
+ *  fits). A move copies the data and writes the new header, then erases the old blocks
+ *  one by one. The two-slot journal after the checkpoint tells frogfs_init what to do
+ *  after a power cut: zero the partial copy, or complete the erasure of the old blocks.
  *
  */
 
@@ -90,12 +128,19 @@
  * - if power is cut in the middle of READ:
  *    A) nothing happens
  * - if power is cut in the middle of WRITE:
- *    A) last written bytes could be lost
+ *    A) last written bytes could be lost: the header of a block is stored before the
+ *       data it covers, so the bytes of the last write read as zeros (with
+ *       FROGFS_USE_DEFERRED_HEADER: up to FROGFS_HEADER_STEP zeros after the data
+ *       written; with FROGFS_USE_CACHE: the bytes not written back yet, the cache
+ *       writing the blocks back in the order they have been written)
  *    B) record cannot be written further (implicitly closed)
  * - if power is cut in the middle of REMOVE:
  *    A) the record could be only partially deleted on the storage and therefore
  *       some fragments could take space without being released, ever, unless
  *       the disk is formatted.
+ * - if power is cut in the middle of COMPACT (FROGFS_USE_COMPACTION):
+ *    A) nothing is lost: the record being moved is found either at its old or at
+ *       its new place by frogfs_init
  *
  *  How to implement safe guards:
  *
@@ -118,22 +163,118 @@
 
 /* Storage includes */
 #include "storage/storage_api.h"
+#include "storage/cache/storage_cache.h"
 
 /* Filesystem includes */
 #include "frogfs.h"
 #include "frogfs_assert.h"
 
 #define FROGFS_SIGNATURE               (0x66594C53UL)
+#ifdef FROGFS_USE_LARGE_STORAGE
+#define FROGFS_VERSION                 (2)
+#else
 #define FROGFS_VERSION                 (1)
+#endif
+
+#ifdef FROGFS_USE_QUICK_FORMAT
+/** The version byte carries the quick format flag as well */
+#define FROGFS_VERSION_FLAG_QUICK_FORMAT    (0x20U)
+
+/** The size in bytes of the header at the start of the storage:
+ *  <signature>|<version>|<high-water mark, LSB first>
+ *  The storage is formatted (zeroed) up to the high-water mark only: the bytes after
+ *  it are free whatever their content and they are never read. */
+#define FROGFS_HEADER_MARK_OFFSET      (5U)
+#define FROGFS_HEADER_SIZE             (FROGFS_HEADER_MARK_OFFSET + FROGFS_RECORD_POINTER_SIZE)
+#else
+#define FROGFS_VERSION_FLAG_QUICK_FORMAT    (0x00U)
+
+/** The size in bytes of the signature and version header at the start of the storage */
+#define FROGFS_HEADER_SIZE             (5U)
+#endif
+
+#ifdef FROGFS_USE_CHECKPOINT
+/** The version byte carries the checkpoint flag, so that a storage is never
+ *  mounted with a different layout than the one it has been formatted with. */
+#define FROGFS_VERSION_FLAG_CHECKPOINT (0x80U)
+
+/** Checkpoint layout, right after the header:
+ *  <marker>|<generation LSB>|<generation MSB>|<offset, LSB first> * FROGFS_MAX_RECORD_COUNT|<crc8>
+ *  The marker is written last when the checkpoint is stored and it is cleared as first
+ *  operation when the allocation table is about to change. */
+#define FROGFS_CHECKPOINT_OFFSET       (FROGFS_HEADER_SIZE)
+#define FROGFS_CHECKPOINT_ENTRY_SIZE   (FROGFS_RECORD_POINTER_SIZE + FROGFS_CHECKPOINT_KEY_SIZE)
+#define FROGFS_CHECKPOINT_SIZE         ((FROGFS_CHECKPOINT_ENTRY_SIZE * FROGFS_MAX_RECORD_COUNT) + 4U)
+#define FROGFS_CHECKPOINT_MARKER       (0xC5U)
+#define FROGFS_CHECKPOINT_END          (FROGFS_CHECKPOINT_OFFSET + FROGFS_CHECKPOINT_SIZE)
+#else
+#define FROGFS_VERSION_FLAG_CHECKPOINT (0x00U)
+#define FROGFS_CHECKPOINT_END          (FROGFS_HEADER_SIZE)
+#endif
+
+#ifdef FROGFS_USE_COMPACTION
+/** The version byte carries the compaction flag as well */
+#define FROGFS_VERSION_FLAG_COMPACTION (0x10U)
+
+/** Compaction journal, after the checkpoint: two slots written alternately, the valid
+ *  slot with the latest sequence number holds the state of the record move in progress:
+ *  <sequence>|<phase>|<start, LSB first>|<length, LSB first>|<next, LSB first>|<crc8>
+ *  A torn slot fails its crc8, leaving the previous state in the other slot. */
+#define FROGFS_JOURNAL_OFFSET          (FROGFS_CHECKPOINT_END)
+#define FROGFS_JOURNAL_SLOT_SIZE       ((3U * FROGFS_RECORD_POINTER_SIZE) + 3U)
+#define FROGFS_DATA_OFFSET             (FROGFS_JOURNAL_OFFSET + (2U * FROGFS_JOURNAL_SLOT_SIZE))
+
+/** Nothing in progress */
+#define FROGFS_JOURNAL_IDLE            (0U)
+/** The record is being copied to the block at start, of length bytes: zero it on recovery */
+#define FROGFS_JOURNAL_COPY            (1U)
+/** The copy is complete, the old blocks are being erased: the block at start, of length
+ *  bytes, then the blocks chained from next. Complete the erasure on recovery. */
+#define FROGFS_JOURNAL_ERASE           (2U)
+#else
+#define FROGFS_VERSION_FLAG_COMPACTION (0x00U)
+#define FROGFS_DATA_OFFSET             (FROGFS_CHECKPOINT_END)
+#endif
+
+#ifdef FROGFS_USE_EXTENDED_INDEX
+/** The version byte carries the extended index flag as well */
+#define FROGFS_VERSION_FLAG_EXTENDED_INDEX  (0x40U)
+#else
+#define FROGFS_VERSION_FLAG_EXTENDED_INDEX  (0x00U)
+#endif
+
+#define FROGFS_VERSION_FLAGS           (FROGFS_VERSION_FLAG_CHECKPOINT | FROGFS_VERSION_FLAG_EXTENDED_INDEX | \
+                                        FROGFS_VERSION_FLAG_QUICK_FORMAT | FROGFS_VERSION_FLAG_COMPACTION)
 
 /** Every index that is in RAM shall be increased for writing to disk first */
 #define FROGFS_RECORD_INDEX_OFFSET(x)   ((x) + FROGFS_MIN_RECORD_INDEX_OFFSET)
 
-/** Every index written to disk needs to be subtracted */
-#define FROGFS_RECORD_INDEX(x)         (((x) & ~0x80U) - FROGFS_MIN_RECORD_INDEX_OFFSET)
-#define FROGFS_RECORD_TYPE(x)          ((x >> 7U) & 0x1)
-#define FROGFS_RECORD_DATA(x)          ((x >> 7U) & 0x1)
-#define FROGFS_RECORD_POINTER(x,y,z)   ((uint16_t)((uint16_t)((uint16_t)(y & ~0x80U) << 8U) | (uint16_t)(z)))
+/** Every index written to disk needs to be subtracted: decode the record index of the
+ *  metadata block in the buffer x. The extended index is <type bit|1|index MSB>|<index LSB>:
+ *  the bit always set keeps the first byte from being zero. */
+#ifdef FROGFS_USE_EXTENDED_INDEX
+#define FROGFS_RECORD_INDEX_SIZE       (2U)
+#define FROGFS_RECORD_INDEX_EXTENDED   (0x40U)
+#define FROGFS_RECORD_INDEX(x)         ((t_frogfs_record)((((t_frogfs_record)((x)[0] & 0x3FU) << 8U) | (t_frogfs_record)(x)[1]) - \
+                                                          FROGFS_MIN_RECORD_INDEX_OFFSET))
+#else
+#define FROGFS_RECORD_INDEX_SIZE       (1U)
+#define FROGFS_RECORD_INDEX(x)         ((t_frogfs_record)(((x)[0] & 0x7FU) - FROGFS_MIN_RECORD_INDEX_OFFSET))
+#endif
+#define FROGFS_RECORD_TYPE(x)          (((x)[0] >> 7U) & 0x1U)
+#define FROGFS_RECORD_DATA(x)          (((x)[FROGFS_RECORD_INDEX_SIZE] >> 7U) & 0x1U)
+
+/** Decode the pointer or size of the metadata block in the buffer x (the data bit is removed) */
+#ifdef FROGFS_USE_LARGE_STORAGE
+#define FROGFS_RECORD_POINTER_SIZE     (3U)
+#define FROGFS_RECORD_POINTER(x)       ((t_frogfs_offset)(((t_frogfs_offset)((x)[FROGFS_RECORD_INDEX_SIZE] & 0x7FU) << 16U) | \
+                                                          ((t_frogfs_offset)(x)[FROGFS_RECORD_INDEX_SIZE + 1U] << 8U) | \
+                                                          (t_frogfs_offset)(x)[FROGFS_RECORD_INDEX_SIZE + 2U]))
+#else
+#define FROGFS_RECORD_POINTER_SIZE     (2U)
+#define FROGFS_RECORD_POINTER(x)       ((t_frogfs_offset)((t_frogfs_offset)((t_frogfs_offset)((x)[FROGFS_RECORD_INDEX_SIZE] & 0x7FU) << 8U) | \
+                                                          (t_frogfs_offset)((x)[FROGFS_RECORD_INDEX_SIZE + 1U])))
+#endif
 
 #define FROGFS_RECORD_TYPE_NORMAL      (0U)
 #define FROGFS_RECORD_TYPE_FRAGMENT    (1U)
@@ -142,9 +283,50 @@
 #define FROGFS_RECORD_DATA_SIZE        (1U)
 
 /** The size in bytes that a record metadata information
- * occupies on the actual disk.
+ * occupies on the actual disk:
+ * <type bit|index>|<data bit|pointer or size MSB>|...|<pointer or size LSB>
+ * The pointer or size takes 15 bits in the format version 1, 23 bits in the version 2.
+ * The index takes 7 bits, 14 bits with FROGFS_USE_EXTENDED_INDEX.
+ */
+#define FROGFS_RECORD_METADATA_SIZE    (FROGFS_RECORD_INDEX_SIZE + FROGFS_RECORD_POINTER_SIZE)
+
+/** The largest pointer or size a metadata block can hold */
+#define FROGFS_RECORD_POINTER_MAX      ((1UL << ((8U * FROGFS_RECORD_POINTER_SIZE) - 1U)) - 1UL)
+
+#ifdef FROGFS_USE_EXTENDED_INDEX
+/** The checkpoint entry of a slot also holds its key (see t_s_frogfsram_record) */
+#define FROGFS_CHECKPOINT_KEY_SIZE     (2U)
+
+/** The record index of a slot of the allocation table */
+#define FROGFS_RECORD_ID(volume, slot) ((t_frogfs_record)((volume)->records[(slot)].key - FROGFS_MIN_RECORD_INDEX_OFFSET))
+#else
+#define FROGFS_CHECKPOINT_KEY_SIZE     (0U)
+
+/* The allocation table is indexed by the record index */
+#define FROGFS_RECORD_ID(volume, slot) (slot)
+#define frogfs_record_slot(volume, record)          (((record) < FROGFS_MAX_RECORD_COUNT) ? (record) : FROGFS_MAX_RECORD_COUNT)
+#define frogfs_record_claim(volume, slot, record)
+#define frogfs_record_release(volume, slot)
+#endif
+
+/** The minimum contiguous free space that can hold a new block:
+ * the record metadata, 1 byte of actual data, the metadata of a
+ * potential further fragment pointer record plus 1 spare byte.
+ */
+#define FROGFS_MIN_CONTIGUOUS_SPACE    ((2U * FROGFS_RECORD_METADATA_SIZE) + 1U)
+
+/** The space kept after the data of the last block of a record: room for the
+ * fragment pointer plus the spare byte, so that the record can be
+ * appended to later on (see frogfs_open_append).
  */
-#define FROGFS_RECORD_METADATA_SIZE    (3U)
+#define FROGFS_APPEND_RESERVED_SPACE   (FROGFS_RECORD_METADATA_SIZE + 1U)
+
+/** Check the size given to a single read or write call against the record size limit */
+#if (FROGFS_MAX_RECORD_SIZE < UINT16_MAX)
+#define FROGFS_CALL_SIZE_VALID(size)   ((size) <= FROGFS_MAX_RECORD_SIZE)
+#else
+#define FROGFS_CALL_SIZE_VALID(size)   (true)
+#endif
 
 /**
  * Helper macro that sets the error flag if the storage
@@ -153,948 +335,3873 @@
 #define FROGFS_SET_IOERROR_FLAG(flag, retval)   ((flag) |= (((retval) != FROGFS_ERR_OK) ? true : false))
 #define FROGFS_SET_NOSPACE_FLAG(flag, retval)   ((flag) |= (((retval) != FROGFS_ERR_NOSPACE) ? true : false))
 
-t_s_frogfsram_record frogfs_RAM[FROGFS_MAX_RECORD_COUNT];
-
-#warning "add in all methods a check that the requested offset is not outside physical size of the storage"
-#warning "Always allow multiple reads if no erase or write operation is ongoing. First version: one file at a time only ?"
-
-#warning "add a feature that if the disk has been formated, all operations are inhibit till storage_init is done again"
-t_e_frogfs_error frogfs_format(void)
+/* Implementations of the public functions, called with the volume locks already held */
+static t_e_frogfs_error frogfs_format_unlocked(t_s_frogfs_volume *volume);
+static t_e_frogfs_error frogfs_init_unlocked(t_s_frogfs_volume *volume);
+static t_e_frogfs_error frogfs_checkpoint_unlocked(t_s_frogfs_volume *volume);
+static t_e_frogfs_error frogfs_compact_unlocked(t_s_frogfs_volume *volume);
+static t_e_frogfs_error frogfs_maintenance_step_unlocked(t_s_frogfs_volume *volume, t_frogfs_offset budget_bytes, bool *more);
+static t_e_frogfs_error frogfs_find_contiguous_space_unlocked(t_s_frogfs_volume *volume, t_frogfs_offset size_hint, t_frogfs_offset *space_start, t_frogfs_offset *data_start, t_frogfs_offset *data_size);
+static t_e_frogfs_error frogfs_list_unlocked(t_s_frogfs_volume *volume, t_frogfs_record *list, t_frogfs_record list_size, t_frogfs_record *file_num);
+static t_e_frogfs_error frogfs_get_available_unlocked(t_s_frogfs_volume *volume, t_frogfs_record *record);
+static t_e_frogfs_error frogfs_open_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record);
+static t_e_frogfs_error frogfs_open_sized_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset expected_size, bool whole);
+static t_e_frogfs_error frogfs_reserve_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset size);
+static t_e_frogfs_error frogfs_open_append_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record);
+static t_e_frogfs_error frogfs_write_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, const uint8_t *data, uint16_t size);
+static t_e_frogfs_error frogfs_flush_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record);
+static t_e_frogfs_error frogfs_close_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record);
+static t_e_frogfs_error frogfs_erase_range_unlocked(t_s_frogfs_volume *volume, t_frogfs_offset pos, t_frogfs_offset size);
+static t_e_frogfs_error frogfs_erase_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record);
+static t_e_frogfs_error frogfs_read_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, uint8_t *data, uint16_t size, uint16_t *effective_read);
+static t_e_frogfs_error frogfs_seek_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset offset);
+static t_e_frogfs_error frogfs_pread_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset offset, uint8_t *data, uint16_t size, uint16_t *effective_read);
+static t_e_frogfs_error frogfs_stat_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, t_s_frogfs_record_info *info);
+static t_e_frogfs_error frogfs_handle_open_unlocked(t_s_frogfs_volume *volume, t_s_frogfs_handle *handle, t_frogfs_record record);
+static t_e_frogfs_error frogfs_handle_read_unlocked(t_s_frogfs_handle *handle, uint8_t *data, uint16_t size, uint16_t *effective_read);
+static t_e_frogfs_error frogfs_handle_seek_unlocked(t_s_frogfs_handle *handle, t_frogfs_offset offset);
+static t_e_frogfs_error frogfs_traverse_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, uint8_t *data, uint16_t size, uint16_t *effective_read, bool erase);
+
+#ifdef FROGFS_USE_EXTENDED_INDEX
+/**
+ * Look a record up in the allocation table: open addressing on the record index, with
+ * linear probing. The probing goes on past the released slots and stops at the first
+ * slot that has never been used.
+ *
+ * @return the slot of the record if it exists (or has been claimed), otherwise the free
+ *         slot it would be claimed in; FROGFS_MAX_RECORD_COUNT if the record index is out
+ *         of range or the table is full.
+ */
+static t_frogfs_record frogfs_record_slot(const t_s_frogfs_volume *volume, t_frogfs_record record)
 {
-    t_e_frogfs_error retval = FROGFS_ERR_IO;
-    uint8_t tmp[16];
-    uint16_t disk_size;
-    uint8_t to_write;
+    t_frogfs_record key = (t_frogfs_record)FROGFS_RECORD_INDEX_OFFSET(record);
+    t_frogfs_record slot = (t_frogfs_record)(record % FROGFS_MAX_RECORD_COUNT);
+    t_frogfs_record free_slot = FROGFS_MAX_RECORD_COUNT;
+    t_frogfs_record i;
 
-    (void)memset(tmp, 0, sizeof(tmp));
-
-    retval = storage_seek(0);
-    if (retval != FROGFS_ERR_OK)
+    if (record >= FROGFS_RECORD_ID_LIMIT)
     {
-        return FROGFS_ERR_IO;
+        return FROGFS_MAX_RECORD_COUNT;
     }
 
-    /* Erase all the disk */
-    disk_size = storage_size();
-    do
+    for (i = 0U; i < FROGFS_MAX_RECORD_COUNT; i++)
     {
-        if (disk_size >= sizeof(tmp))
+        if (volume->records[slot].key == key)
         {
-            to_write = sizeof(tmp);
+            /* Found */
+            free_slot = slot;
+            break;
         }
-        else
+
+        if ((free_slot == FROGFS_MAX_RECORD_COUNT) &&
+            ((volume->records[slot].key == 0U) || (volume->records[slot].key == FROGFS_RECORD_NONE)))
         {
-            to_write = disk_size;
+            /* First slot the record could take */
+            free_slot = slot;
         }
-        retval = storage_write(tmp, to_write);
-        disk_size -= (uint8_t)to_write;
-    } while ((retval == FROGFS_ERR_OK) && (disk_size > 0));
-
-    if (retval == FROGFS_ERR_OK)
-    {
-        /* Prepare the signature and version */
-        tmp[0] = (uint8_t)((uint32_t)(FROGFS_SIGNATURE      ) & 0xFFUL);
-        tmp[1] = (uint8_t)((uint32_t)(FROGFS_SIGNATURE >> 8 ) & 0xFFUL);
-        tmp[2] = (uint8_t)((uint32_t)(FROGFS_SIGNATURE >> 16) & 0xFFUL);
-        tmp[3] = (uint8_t)((uint32_t)(FROGFS_SIGNATURE >> 24) & 0xFFUL);
-        tmp[4] = FROGFS_VERSION;
-
-        /* Go to the beginning of the storage */
-        retval = storage_seek(0);
 
-        if (retval == FROGFS_ERR_OK)
+        if (volume->records[slot].key == 0U)
         {
-            /* Write the header */
-            retval = storage_write(tmp, 5);
+            /* End of the probe sequence: the record is not in the table */
+            break;
         }
+
+        slot = (t_frogfs_record)((slot + 1U) % FROGFS_MAX_RECORD_COUNT);
     }
 
-    return retval;
+    return free_slot;
 }
 
-t_e_frogfs_error frogfs_init(void)
+/**
+ * Make the slot (given by frogfs_record_slot) belong to the record. The slot state
+ * is reset if it was free.
+ */
+static void frogfs_record_claim(t_s_frogfs_volume *volume, t_frogfs_record slot, t_frogfs_record record)
 {
-    t_e_frogfs_error retval = FROGFS_ERR_IO;
-    uint8_t tmp[5];
-    uint16_t pointer;
-    uint16_t pos_cur;
-    uint8_t index;
-
-    /* Erase the in-RAM allocation table */
-    (void)memset(frogfs_RAM, 0, sizeof(frogfs_RAM));
+    if (volume->records[slot].key != (t_frogfs_record)FROGFS_RECORD_INDEX_OFFSET(record))
+    {
+        (void)memset(&volume->records[slot], 0, sizeof(volume->records[slot]));
+        volume->records[slot].key = (t_frogfs_record)FROGFS_RECORD_INDEX_OFFSET(record);
+    }
+}
 
-    /* Go to the beginning of the storage */
-    storage_seek(0);
+/**
+ * Give back the slot of a record that does not exist anymore. It stays in the probe
+ * sequence of the other records unless the sequence ends right after it.
+ */
+static void frogfs_record_release(t_s_frogfs_volume *volume, t_frogfs_record slot)
+{
+    if (volume->records[(slot + 1U) % FROGFS_MAX_RECORD_COUNT].key == 0U)
+    {
+        volume->records[slot].key = 0U;
+    }
+    else
+    {
+        volume->records[slot].key = FROGFS_RECORD_NONE;
+    }
+}
+#endif
 
-    /* Read the header */
-    retval = storage_read(tmp, 5);
+#ifdef FROGFS_USE_LOCKING
+/**
+ * Volume locking. The operations that allocate or change the storage hold the volume
+ * lock exclusively. The read-only ones share it and serialize on the record they work
+ * on, as the read position of a record lives in its work registers and extent cache.
+ */
+static void frogfs_lock_exclusive(t_s_frogfs_volume *volume)
+{
+    (void)pthread_rwlock_wrlock(&volume->lock);
+}
 
-    if (retval == FROGFS_ERR_OK)
-    {
-        if (((uint32_t)tmp[0] == (uint32_t)((FROGFS_SIGNATURE      ) & 0xFFUL)) &&
-            ((uint32_t)tmp[1] == (uint32_t)((FROGFS_SIGNATURE >> 8 ) & 0xFFUL)) &&
-            ((uint32_t)tmp[2] == (uint32_t)((FROGFS_SIGNATURE >> 16) & 0xFFUL)) &&
-            ((uint32_t)tmp[3] == (uint32_t)((FROGFS_SIGNATURE >> 24) & 0xFFUL)) &&
-            (tmp[4] == FROGFS_VERSION))
-        {
-            /* Version and magic match, hence we have a formatted drive */
-            retval = FROGFS_ERR_OK;
+static void frogfs_unlock_exclusive(t_s_frogfs_volume *volume)
+{
+    (void)pthread_rwlock_unlock(&volume->lock);
+}
 
-            /* Read the file offset table */
-            bool nil = false;
-            do
-            {
-                //null_counter = 0;
+/**
+ * @param record    the record to work on, FROGFS_MAX_RECORD_COUNT (or any invalid record) for none
+ */
+static void frogfs_lock_shared(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    (void)pthread_rwlock_rdlock(&volume->lock);
 
-                do
-                {
-                    retval = storage_read(tmp, 1);
-                    if (tmp[0] != 0x00U)
-                    {
-                        /* Advance by 2 (Metadata is 3 bytes) and quit */
-                        retval = storage_backtrack(1);
-                        if (retval == FROGFS_ERR_OK)
-                        {
-                            retval = storage_read(tmp, 3);
-                        }
-                        break;
-                    }
-                } while (retval == FROGFS_ERR_OK);
+    if (record < FROGFS_MAX_RECORD_COUNT)
+    {
+        (void)pthread_mutex_lock(&volume->record_lock[record]);
+    }
+}
 
-                if (retval == FROGFS_ERR_OK)
-                {
-                    if (nil == false)
-                    {
-                        index = FROGFS_RECORD_INDEX(tmp[0]);
+static void frogfs_unlock_shared(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    if (record < FROGFS_MAX_RECORD_COUNT)
+    {
+        (void)pthread_mutex_unlock(&volume->record_lock[record]);
+    }
 
-                        if (index > FROGFS_MAX_RECORD_COUNT)
-                        {
-                            FROGFS_DEBUG_VERBOSE("assertion failed. Record index out of range. %d", index);
-                            retval = FROGFS_ERR_OUT_OF_RANGE;
-                            break;
-                        }
+    (void)pthread_rwlock_unlock(&volume->lock);
+}
 
-                        /* Extract the pointer value */
-                        pointer = FROGFS_RECORD_POINTER(tmp[0], tmp[1], tmp[2]);
+/**
+ * Same as frogfs_lock_shared, for a record given by its index: its slot is looked up
+ * once the volume lock is held.
+ * @return the slot of the record (see frogfs_record_slot)
+ */
+static t_frogfs_record frogfs_lock_shared_record(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    t_frogfs_record slot;
 
-                        /* determine record type */
-                        if ((FROGFS_RECORD_TYPE(tmp[0]) == FROGFS_RECORD_TYPE_NORMAL) &&
-                            (FROGFS_RECORD_DATA(tmp[1]) == FROGFS_RECORD_DATA_SIZE) )
-                        {
-                            /* it is a Normal - Size record: indicates the start of a record */
+    (void)pthread_rwlock_rdlock(&volume->lock);
 
-                            if (index > FROGFS_MAX_RECORD_COUNT)
-                            {
-                                FROGFS_DEBUG_VERBOSE("assertion failed. Record index out of range. %d", index);
-                                retval = FROGFS_ERR_OUT_OF_RANGE;
-                                break;
-                            }
+    slot = frogfs_record_slot(volume, record);
+    if (slot < FROGFS_MAX_RECORD_COUNT)
+    {
+        (void)pthread_mutex_lock(&volume->record_lock[slot]);
+    }
 
-                            /* record size of next bytes. Check if first occurrence.
-                             * If it is, then save this as file-start offset. */
-                            if (frogfs_RAM[index].offset == 0)
-                            {
-                                /* First time that record index has been encountered,
-                                 * OR
-                                 * Pointer is less than the saved pointer (occurs before i.e. frst entry) */
-                                retval = storage_pos(&frogfs_RAM[index].offset);
-                                frogfs_RAM[index].offset -= 3U;                  /* record offset is including the record block */
-                            }
-                            else
-                            {
-                                /* already saved, skip and go on */
-                                FROGFS_DEBUG_VERBOSE("assertion failed. Cannot find two normal-size blocks for a record");
-                                retval = FROGFS_ERR_OUT_OF_RANGE;
-                                break;
-                            }
+    return slot;
+}
+#else
+#define frogfs_lock_exclusive(volume)
+#define frogfs_unlock_exclusive(volume)
+#define frogfs_lock_shared(volume, record)
+#define frogfs_unlock_shared(volume, record)
+#define frogfs_lock_shared_record(volume, record)   frogfs_record_slot((volume), (record))
+#endif
 
-                            retval = storage_advance(pointer);
-                        }
-                        else if ((FROGFS_RECORD_TYPE(tmp[0]) == FROGFS_RECORD_TYPE_FRAGMENT) &&
-                                 (FROGFS_RECORD_DATA(tmp[1]) == FROGFS_RECORD_DATA_POINTER) )
-                        {
-                            /* It is a fragment-pointer */
+#ifdef FROGFS_USE_EXTENT_CACHE
+#define FROGFS_EXTENT_CACHE_EMPTY      (0U)    /**< The record has not been traversed yet */
+#define FROGFS_EXTENT_CACHE_PARTIAL    (1U)    /**< The first FROGFS_EXTENT_CACHE_SIZE blocks are cached */
+#define FROGFS_EXTENT_CACHE_COMPLETE   (2U)    /**< All the blocks of the record are cached */
+#endif
 
-                            /* just skip the record metadata, next will be something else */
+/**
+ * Encode a metadata block in the given buffer (FROGFS_RECORD_METADATA_SIZE bytes).
+ * @param record        the record index
+ * @param record_type   FROGFS_RECORD_TYPE_NORMAL or FROGFS_RECORD_TYPE_FRAGMENT
+ * @param data_type     FROGFS_RECORD_DATA_POINTER or FROGFS_RECORD_DATA_SIZE
+ * @param value         the pointer or size, up to FROGFS_RECORD_POINTER_MAX
+ */
+static void frogfs_metadata_encode(uint8_t *tmp, t_frogfs_record record, uint8_t record_type, uint8_t data_type, t_frogfs_offset value)
+{
+    uint8_t i;
+
+#ifdef FROGFS_USE_EXTENDED_INDEX
+    tmp[0] = (uint8_t)((uint8_t)(record_type << 7U) | FROGFS_RECORD_INDEX_EXTENDED |
+                       (uint8_t)((FROGFS_RECORD_INDEX_OFFSET(record) >> 8U) & 0x3FU));
+    tmp[1] = (uint8_t)FROGFS_RECORD_INDEX_OFFSET(record);
+#else
+    tmp[0] = (uint8_t)((uint8_t)(record_type << 7U) | (uint8_t)FROGFS_RECORD_INDEX_OFFSET(record));
+#endif
+    for (i = (uint8_t)(FROGFS_RECORD_METADATA_SIZE - 1U); i >= FROGFS_RECORD_INDEX_SIZE; i--)
+    {
+        tmp[i] = (uint8_t)value;
+        value = (t_frogfs_offset)(value >> 8U);
+    }
+    tmp[FROGFS_RECORD_INDEX_SIZE] = (uint8_t)((tmp[FROGFS_RECORD_INDEX_SIZE] & 0x7FU) | (uint8_t)(data_type << 7U));
+}
 
-                            if ((pointer >= storage_size()) || (pointer <= 5U))
-                            {
-                                FROGFS_DEBUG_VERBOSE("assertion failed. Pointer out of range. %d", pointer);
-                                retval = FROGFS_ERR_OUT_OF_RANGE;
-                                break;
-                            }
+#if defined(FROGFS_USE_CHECKPOINT) || defined(FROGFS_USE_COMPACTION)
+/**
+ * CRC-8 (polynomial 0x07) update step used to protect the checkpoint and journal content.
+ */
+static uint8_t frogfs_crc8(uint8_t crc, uint8_t data)
+{
+    uint8_t i;
 
-                            retval = storage_advance(pointer);
-                        }
-                        else if ((FROGFS_RECORD_TYPE(tmp[0]) == FROGFS_RECORD_TYPE_FRAGMENT) &&
-                                 (FROGFS_RECORD_DATA(tmp[1]) == FROGFS_RECORD_DATA_SIZE) )
-                        {
-                            /* It is a fragment-size */
-                            retval = storage_advance(pointer);
-                        }
-                        else
-                        {
-                            /* record not supported. */
-                            FROGFS_ASSERT_UNCHECKED("assertion failed. Invalid record found.\r\n");
-                        }
-                    }
-                }
-                else
-                {
-                    retval = storage_pos(&pos_cur);
-                    if ((pos_cur + 3U) >= storage_size())
-                    {
-                        FROGFS_DEBUG_VERBOSE("end of storage reached,");
-                        retval = FROGFS_ERR_OK;
-                        break;
-                    }
-                }
-            } while ((retval == FROGFS_ERR_OK) && (storage_end_of_storage() != FROGFS_ERR_OK));    // TILL EOF
-        }
-        else
-        {
-            /* The drive is not formatted */
-            retval = FROGFS_ERR_NOT_FORMATTED;
-        }
+    crc ^= data;
+    for (i = 0; i < 8U; i++)
+    {
+        crc = (crc & 0x80U) ? (uint8_t)((uint8_t)(crc << 1U) ^ 0x07U) : (uint8_t)(crc << 1U);
     }
 
-    return retval;
+    return crc;
 }
+#endif
 
+#ifdef FROGFS_USE_CHECKPOINT
 /**
- * Find the contiguous space which has the following space requirements:
- * - at least 3 bytes plus 1 bytes data plus 3 bytes for an additional fragment pointer record.
- * - everything is zeroed i.e. it is free space.
- * The searching process takes into account space already occupied by other fragments.
- *
+ * Load the allocation table from the checkpoint.
+ * On any error (marker cleared, torn write, corrupted content) the caller shall
+ * fall back to the full storage scan.
  */
-t_e_frogfs_error frogfs_find_contiguous_space(uint16_t *space_start, uint16_t *data_start, uint16_t *data_size)
+static t_e_frogfs_error frogfs_checkpoint_load(t_s_frogfs_volume *volume)
 {
     t_e_frogfs_error retval = FROGFS_ERR_IO;
-    uint8_t tmp[3];
-    bool start_zero_find = false;
-    uint16_t blank_cnt = 0U;
-    uint16_t size_advance = 0U;
+    uint8_t tmp[FROGFS_RECORD_METADATA_SIZE + FROGFS_CHECKPOINT_KEY_SIZE];
+    uint8_t crc = 0U;
+    t_frogfs_record i;
+    uint8_t j;
+    t_frogfs_offset offset;
+    t_frogfs_offset pos = FROGFS_CHECKPOINT_OFFSET;
+
+    volume->checkpoint_valid = false;
 
-    /* Goto after the header */
-    storage_seek(5);
+    retval = storage_cache_read_at(&volume->storage, pos, tmp, 3U);
+    pos += 3U;
 
-    do
+    if ((retval == FROGFS_ERR_OK) && (tmp[0] != FROGFS_CHECKPOINT_MARKER))
     {
-        /* Reset flags here */
-        start_zero_find = false;
-        blank_cnt = 0;
+        FROGFS_DEBUG_VERBOSE("checkpoint is stale");
+        retval = FROGFS_ERR_NOT_FORMATTED;
+    }
 
-        /* Read record metadata */
-        retval = storage_read(tmp, 3U);
+    if (retval == FROGFS_ERR_OK)
+    {
+        crc = frogfs_crc8(crc, tmp[1]);
+        crc = frogfs_crc8(crc, tmp[2]);
+        volume->checkpoint_generation = (uint16_t)((uint16_t)tmp[2] << 8U) | (uint16_t)tmp[1];
 
-        if (retval == FROGFS_ERR_OK)
-        {  /* No error, could ready fully */
-            if ((tmp[0] == 0) || (tmp[1] == 0) || (tmp[2] == 0))
-            {
-                /* This is free space: it is not a metadata */
-                /* Count already 3 bytes free */
-                blank_cnt += FROGFS_RECORD_METADATA_SIZE;
-                /* Continue looking for more free space */
-                start_zero_find = true;
-                /* Save the space address (potential) and remove the metadata size from it */
-                retval = storage_pos(space_start);
-                *space_start -= FROGFS_RECORD_METADATA_SIZE;
-            }
-            else
+        for (i = 0; (i < FROGFS_MAX_RECORD_COUNT) && (retval == FROGFS_ERR_OK); i++)
+        {
+            retval = storage_cache_read_at(&volume->storage, pos, tmp, FROGFS_CHECKPOINT_ENTRY_SIZE);
+            pos += FROGFS_CHECKPOINT_ENTRY_SIZE;
+            offset = 0U;
+            for (j = 0; j < FROGFS_CHECKPOINT_ENTRY_SIZE; j++)
             {
-                if (FROGFS_RECORD_DATA(tmp[1]) == FROGFS_RECORD_DATA_SIZE)
-                {
-                    /* Retrieve the size and ask the storage layer to advance by that amount */
-                    size_advance = FROGFS_RECORD_POINTER(tmp[0], tmp[1], tmp[2]);
-                    retval = storage_advance(size_advance);
-
-                    if (retval == FROGFS_ERR_OK)
-                    {
-                        // TODO if the error is different here it means the filesystem suffers
-                        // of rotten data...
-                    }
-
-                }
-                else
-                {
-                    /* It is of pointer type, just restart iteration */
-                }
+                crc = frogfs_crc8(crc, tmp[j]);
             }
-        }
-        else
-        {  /* partly not read due to out of physical space or IO error */
-            /* Get out of the loop */
-            break;
-        }
-
-        if (start_zero_find == true)
-        {
-            for (;;)    /* The loop is eventually terminated */
+            for (j = 0; j < FROGFS_RECORD_POINTER_SIZE; j++)
             {
-                /* Storage read bytes and increment the null counter */
-                retval = storage_read(tmp, 1U);
-
-                if (retval == FROGFS_ERR_OK)
-                {
-                    if (tmp[0] == 0)
-                    {
-                        /* empty hole has been found */
-                        blank_cnt++;
-                    }
-                    else
-                    {
-                        /* reset the blank counter */
-                        blank_cnt = 0;
-                        /* Go back by one position */
-                        retval = storage_backtrack(1);
-                        /* Exit the loop */
-                        break;
-                    }
-                }
-                else if (retval == FROGFS_ERR_NOSPACE)
-                {
-                    /* Out of space: exit the loop with the bytes that could be marked as free */
-                    break;
-                }
-                else
-                {
-                    /* IO error or other error: exit the loop */
-                    break;
-                }
+                offset |= (t_frogfs_offset)((t_frogfs_offset)tmp[j] << (8U * j));
             }
 
-            if (blank_cnt >= 7U)
+            if ((offset != 0U) && ((offset < FROGFS_DATA_OFFSET) || (offset >= storage_cache_size(&volume->storage))))
             {
-                /* We have enough space:
-                 * 1 byte of actual data
-                 * 3 bytes the record metadata
-                 * 3 bytes for potential further fragmented data pointer
-                 */
-                /* The data write offset shall not count the record */
-                *data_start = *space_start + 3U;
-                /* Determine the size of the data */
-                *data_size = (blank_cnt - 7U);
-
-                FROGFS_DEBUG_VERBOSE("space found at 0x%04x", *space_start);
-                FROGFS_DEBUG_VERBOSE("write offset set at 0x%04x", *data_start);
-                FROGFS_DEBUG_VERBOSE("of size 0x%04x", *data_size);
-
-                /* Override error: it is "ok" even if NOSPACE or other non fatal error
-                 * e.g. I/O error on some bytes at the end of the storage while other bytes
-                 * are correctly accessible -> go on and allocate as necessary. */
-                // TODO: maybe an API to check "storage" sanity i.e. these uncaught / masked
-                // errors could be interesting for an application demanding high reliability
-                retval = FROGFS_ERR_OK;
-
-                /* Finally, exit the loop */
-                break;
+                FROGFS_DEBUG_VERBOSE("checkpoint offset out of range. %d", offset);
+                retval = FROGFS_ERR_OUT_OF_RANGE;
             }
-            else
+            volume->records[i].offset = offset;
+#ifdef FROGFS_USE_EXTENDED_INDEX
+            volume->records[i].key = (t_frogfs_record)((t_frogfs_record)((t_frogfs_record)tmp[FROGFS_RECORD_POINTER_SIZE + 1U] << 8U) |
+                                                       (t_frogfs_record)tmp[FROGFS_RECORD_POINTER_SIZE]);
+            if ((offset != 0U) && ((volume->records[i].key == 0U) || (volume->records[i].key > FROGFS_RECORD_ID_LIMIT)))
             {
-                blank_cnt = 0;
+                FROGFS_DEBUG_VERBOSE("checkpoint key out of range. %d", volume->records[i].key);
+                retval = FROGFS_ERR_OUT_OF_RANGE;
             }
-        } /* End of zero-find condition */
-
-    } while(1);
+#endif
+        }
 
-    return retval;
-}
+        if (retval == FROGFS_ERR_OK)
+        {
+            retval = storage_cache_read_at(&volume->storage, pos, tmp, 1U);
+        }
 
-t_e_frogfs_error frogfs_list(uint8_t *list, uint8_t list_size, uint8_t *file_num)
-{
-    uint8_t i = 0;
-    uint8_t list_i = 0;
-    t_e_frogfs_error retval = FROGFS_ERR_OK;
+        if ((retval == FROGFS_ERR_OK) && (tmp[0] != crc))
+        {
+            FROGFS_DEBUG_VERBOSE("checkpoint is torn or corrupted");
+            retval = FROGFS_ERR_IO;
+        }
+    }
 
-    if ((list == NULL) || (file_num == NULL))
+    if (retval == FROGFS_ERR_OK)
     {
-        retval = FROGFS_ERR_NULL_POINTER;
+        volume->checkpoint_valid = true;
     }
     else
     {
-        *file_num = 0;
-
-        for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
-        {
-            if (frogfs_RAM[i].offset != 0)
-            {
-                if (list_i < list_size)
-                {
-                    list[list_i] = i;
-                    (*file_num)++;
-                }
-                list_i++;
-            }
-        }
+        /* Do not leave a partially loaded table around */
+        (void)memset(volume->records, 0, sizeof(volume->records));
     }
 
-
     return retval;
 }
 
-t_e_frogfs_error frogfs_get_available(uint8_t *record)
+/**
+ * Mark the checkpoint as stale. Shall be called before the allocation table
+ * (i.e. the record start offsets) is changed on the storage.
+ */
+static t_e_frogfs_error frogfs_checkpoint_invalidate(t_s_frogfs_volume *volume)
 {
-    uint8_t i = 0;
-    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    uint8_t tmp = 0U;
 
-    if (record == NULL)
+    if (volume->checkpoint_valid == true)
     {
-        retval = FROGFS_ERR_NULL_POINTER;
-    }
-    else
-    {
-        retval = FROGFS_ERR_OUT_OF_RANGE;
-        *record = UINT8_MAX;
+        retval = storage_cache_write_at(&volume->storage, FROGFS_CHECKPOINT_OFFSET, &tmp, 1U);
 
-        for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
+        /* The stale marker shall reach the storage before the allocation table changes */
+        if (retval == FROGFS_ERR_OK)
         {
-            if (frogfs_RAM[i].offset == 0)
-            {
-                retval = FROGFS_ERR_OK;
-                *record = i;
-                break;
-            }
+            retval = storage_cache_flush(&volume->storage);
+        }
+
+        if (retval == FROGFS_ERR_OK)
+        {
+            volume->checkpoint_valid = false;
         }
     }
 
     return retval;
 }
+#endif
 
-t_e_frogfs_error frogfs_open(uint8_t record)
+/**
+ * Store the in-RAM allocation table in the checkpoint, so that the next frogfs_init
+ * does not need to scan the storage. Nothing is written if the checkpoint is already
+ * up to date.
+ */
+static t_e_frogfs_error frogfs_checkpoint_unlocked(t_s_frogfs_volume *volume)
 {
-    t_e_frogfs_error retval = FROGFS_ERR_IO;
-    uint8_t tmp[3];
+#ifdef FROGFS_USE_CHECKPOINT
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    uint8_t tmp[FROGFS_CHECKPOINT_ENTRY_SIZE];
+    uint8_t crc = 0U;
+    t_frogfs_record i;
+    uint8_t j;
+    t_frogfs_offset pos = FROGFS_CHECKPOINT_OFFSET + 1U;
 
-#ifdef FROGFS_FORCE_INIT_AT_EVERY_OPEN
-    FROGFS_DEBUG_VERBOSE("Unit Testing Enabled. You shall not see that normally.");
-    retval = frogfs_init();
-    FROGFS_ASSERT_VERBOSE(retval, FROGFS_ERR_OK, "not ok that init does not work.");
-#endif
+    if (volume->checkpoint_valid == false)
+    {
+        volume->checkpoint_generation++;
 
-    FROGFS_DEBUG_VERBOSE("%s: record %d", __FUNCTION__, record);
+        /* The marker is still cleared: write the content first */
+        tmp[0] = (uint8_t)(volume->checkpoint_generation);
+        tmp[1] = (uint8_t)(volume->checkpoint_generation >> 8U);
+        crc = frogfs_crc8(crc, tmp[0]);
+        crc = frogfs_crc8(crc, tmp[1]);
+        retval = storage_cache_write_at(&volume->storage, pos, tmp, 2U);
+        pos += 2U;
 
-    /* Check if the file exists or not */
-    if (record < FROGFS_MAX_RECORD_COUNT)
-    {
-        if (frogfs_RAM[record].offset > 0)
-        {
-            /* File exists. Can read. */
-            retval = FROGFS_ERR_OK;
-            frogfs_RAM[record].work_reg_1 = 0;       /* reset the block start pos */
-            frogfs_RAM[record].work_reg_2 = 0;       /* reset the read pos */
-            frogfs_RAM[record].write_offset = 0;
-        }
-        else
+        for (i = 0; (i < FROGFS_MAX_RECORD_COUNT) && (retval == FROGFS_ERR_OK); i++)
         {
-            /* File does not exists. Create record */
-            retval = frogfs_find_contiguous_space(&frogfs_RAM[record].offset, &frogfs_RAM[record].write_offset, &frogfs_RAM[record].work_reg_1);
-
-            if (retval == FROGFS_ERR_OK)
+            for (j = 0; j < FROGFS_RECORD_POINTER_SIZE; j++)
             {
-                /* Create the actual record: Normal - Size */
-                tmp[0] = FROGFS_RECORD_INDEX_OFFSET(record) | (FROGFS_RECORD_TYPE_NORMAL << 7U);
-                tmp[1] = (FROGFS_RECORD_DATA_SIZE << 7U);
-                tmp[2] = 0;
-
-                retval = storage_seek(frogfs_RAM[record].offset);
-                if (retval == FROGFS_ERR_OK)
-                {
-                    /* Write */
-                    retval = storage_write(tmp, 3);
-                }
+                tmp[j] = (uint8_t)(volume->records[i].offset >> (8U * j));
             }
-            else
+#ifdef FROGFS_USE_EXTENDED_INDEX
+            tmp[FROGFS_RECORD_POINTER_SIZE] = (uint8_t)volume->records[i].key;
+            tmp[FROGFS_RECORD_POINTER_SIZE + 1U] = (uint8_t)(volume->records[i].key >> 8U);
+#endif
+            for (j = 0; j < FROGFS_CHECKPOINT_ENTRY_SIZE; j++)
             {
-                /* No Space (more likely happening) or IO error */
-                FROGFS_DEBUG_VERBOSE("could not allocate spaced.");
-                printf_frogfserror(retval);
+                crc = frogfs_crc8(crc, tmp[j]);
             }
+            retval = storage_cache_write_at(&volume->storage, pos, tmp, FROGFS_CHECKPOINT_ENTRY_SIZE);
+            pos += FROGFS_CHECKPOINT_ENTRY_SIZE;
         }
-    }
-    else
-    {
-        FROGFS_DEBUG_VERBOSE("too large record %d", record);
-        retval = FROGFS_ERR_INVALID_RECORD;
-    }
-
-    return retval;
-}
-
-// work_reg_1: available contiguous space
-// work_reg_2: written size so far
 
-t_e_frogfs_error frogfs_write(uint8_t record, const uint8_t *data, uint16_t size)
-{
-    t_e_frogfs_error retval = FROGFS_ERR_IO;
-    uint8_t tmp[3];
-    uint16_t tmp_size = 0;
-    bool io_error = false;
-    bool exit_loop = false;
-    uint16_t written_bytes = 0;
-    bool update_block_record = false;
-    uint16_t space_start;
-    uint16_t data_start;
-    uint16_t data_size;
+        if (retval == FROGFS_ERR_OK)
+        {
+            retval = storage_cache_write_at(&volume->storage, pos, &crc, 1U);
+        }
 
-    FROGFS_DEBUG_VERBOSE("%s: record %d size %d", __FUNCTION__, (uint16_t)record, (uint16_t)size);
+        /* Finally, validate the checkpoint (content on the storage first) */
+        if (retval == FROGFS_ERR_OK)
+        {
+            retval = storage_cache_flush(&volume->storage);
+        }
 
-    /* Check if the file exists or not */
-    if ((record < FROGFS_MAX_RECORD_COUNT) && (size <= FROGFS_MAX_RECORD_SIZE))
-    {
-        if (frogfs_RAM[record].write_offset == 0)
+        if (retval == FROGFS_ERR_OK)
         {
-            /* Not open for writing */
-            retval = FROGFS_ERR_NOT_WRITABLE;
+            tmp[0] = FROGFS_CHECKPOINT_MARKER;
+            retval = storage_cache_write_at(&volume->storage, FROGFS_CHECKPOINT_OFFSET, tmp, 1U);
         }
-        else
+
+        if (retval == FROGFS_ERR_OK)
         {
-            do
-            {
-                /* Goto write pointer plus the written size pointer */
-                storage_seek((uint16_t)(frogfs_RAM[record].write_offset + frogfs_RAM[record].work_reg_2));
+            retval = storage_cache_flush(&volume->storage);
+        }
 
-                /* Check what has to be done */
-                if (written_bytes >= size)
-                {
-                    /* Last chunk of data has been written */
-                    exit_loop = true;
-                    /* update the block record's size */
-                    update_block_record = true;
-                    /* No error yet */
-                    retval = FROGFS_ERR_OK;
-                }
-                else if (frogfs_RAM[record].work_reg_2 < frogfs_RAM[record].work_reg_1)
-                {
-                    /* The contiguous space is still available: continue writing */
+        if (retval == FROGFS_ERR_OK)
+        {
+            volume->checkpoint_valid = true;
+        }
+    }
 
-                    /* determine how many bytes can we write in the contiguous space */
-                    tmp_size = frogfs_RAM[record].work_reg_1 - frogfs_RAM[record].work_reg_2;
-                    tmp_size = (size < tmp_size) ? size : tmp_size;
-                    if (tmp_size >= written_bytes)  tmp_size -= written_bytes;
+    return retval;
+#else
+    (void)volume;
+    return FROGFS_ERR_INVALID_OPERATION;
+#endif
+}
 
-                    if (tmp_size > 0)
-                    {
-                        /* Fits the free space */
-                        FROGFS_DEBUG_VERBOSE("contiguous write");
+/**
+ * Advance the given position over free (zeroed) space, up to the first non-zero byte
+ * or up to the end of the storage.
+ * The storage is read in chunks of FROGFS_SCAN_BUFFER_SIZE bytes and the zero runs are
+ * compared a word at a time; only the tail of a chunk is compared byte by byte.
+ *
+ * With FROGFS_USE_QUICK_FORMAT, the storage after the high-water mark is free and
+ * it is not read.
+ *
+ * @param pos   in: position to start from; out: position of the first non-zero byte,
+ *              storage_cache_size(&volume->storage) if the storage is free till its end,
+ *              limit if the space is free up to the limit.
+ * @param limit the scan stops there (storage_cache_size(&volume->storage) for no limit)
+ */
+static t_e_frogfs_error frogfs_skip_free_space(t_s_frogfs_volume *volume, t_frogfs_offset *pos, t_frogfs_offset limit)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    uint8_t buffer[FROGFS_SCAN_BUFFER_SIZE];
+    t_frogfs_offset disk_size = storage_cache_size(&volume->storage);
+#ifdef FROGFS_USE_QUICK_FORMAT
+    t_frogfs_offset scan_end = volume->high_water;
+#else
+    t_frogfs_offset scan_end = disk_size;
+#endif
+    t_frogfs_offset stop = (limit < scan_end) ? limit : scan_end;
+    t_frogfs_offset chunk;
+    t_frogfs_offset i;
+    uint32_t word;
 
-                        /* Write the portion of input data from written_bytes position of length tmp_size */
-                        retval = storage_write(&data[written_bytes], tmp_size);
+    while ((retval == FROGFS_ERR_OK) && (*pos < stop))
+    {
+        chunk = (t_frogfs_offset)(stop - *pos);
+        chunk = (chunk < sizeof(buffer)) ? chunk : (t_frogfs_offset)sizeof(buffer);
 
-                        if (retval != FROGFS_ERR_OK)
-                        {
-                            /* IO-Error occurred */
-                            io_error = true;
-                            /* update the block record which shall cover what has been written so far without error */
-                            exit_loop = true;
-#warning "We shall update the metadata only when really required to avoid early storage wear."
-                            update_block_record = true;
-                        }
-                        else
-                        {
-                            /* Update the block written size */
-                            frogfs_RAM[record].work_reg_2 += tmp_size;
-                            /* Increment the overall bytes counter */
-                            written_bytes += tmp_size;
-                        }
-                    }
-                    else
-                    {  /* Plausibility error condition */
-                        FROGFS_ASSERT_VERBOSE(0, 1, "shall never be zero here.");
-                    }
+        retval = storage_cache_read_at(&volume->storage, *pos, buffer, chunk);
 
-                    if (frogfs_RAM[record].work_reg_2 >= frogfs_RAM[record].work_reg_1)
-                    {
-                        /* Update now the record, as the space has been filled */
-                        update_block_record = true;
-                    }
+        if (retval == FROGFS_ERR_OK)
+        {
+            i = 0U;
 
-                }
-                else if (frogfs_RAM[record].work_reg_2 >= frogfs_RAM[record].work_reg_1)
+            /* Word-wide comparison of the zero run */
+            while ((t_frogfs_offset)(i + sizeof(word)) <= chunk)
+            {
+                (void)memcpy(&word, &buffer[i], sizeof(word));
+                if (word != 0UL)
                 {
-                    /* The contiguous space has been filled completely: search new contiguous space */
-                    retval = frogfs_find_contiguous_space(&space_start, &data_start, &data_size);
-
-                    if (retval == FROGFS_ERR_OK)
-                    {
-                        /* Space found for stuffing the fragmented block */
-                        /* Create the actual record: Fragment - Pointer and store the start address of the fragment */
-                        tmp[0] = FROGFS_RECORD_INDEX_OFFSET(record) | (FROGFS_RECORD_TYPE_FRAGMENT << 7U);
-                        tmp[1] = (FROGFS_RECORD_DATA_POINTER << 7U) | (uint8_t)(space_start >> 8U);
-                        tmp[2] = (uint8_t)space_start;
-
-                        retval = storage_seek((uint16_t)(frogfs_RAM[record].work_reg_1 + frogfs_RAM[record].write_offset));
-                        if (retval == FROGFS_ERR_OK)
-                        {
-                            /* Write */
-                            retval = storage_write(tmp, 3);
-                        }
-
-                        /* set the new write pointer to the write_offset */
-                        frogfs_RAM[record].write_offset = data_start;        /* update the data write pointer */
-                        frogfs_RAM[record].work_reg_1 = data_size;           /* update the free space available to the write operation */
-                        frogfs_RAM[record].work_reg_2 = 0;                   /* reset the free space written bytes counter */
-                        update_block_record = true;
-                    }
-                    else
-                    {
-                        /* Out of space, sorry */
-                        retval = FROGFS_ERR_NOSPACE;
-                        io_error = true;
-                    }
+                    break;
                 }
+                i += (t_frogfs_offset)sizeof(word);
+            }
 
-                /* Check if the block has to be updated now */
-                if (update_block_record == true)
-                {
-                    /* Check if it is the first record block */
-                    if (frogfs_RAM[record].offset == (uint16_t)(frogfs_RAM[record].write_offset - 3U))
-                    {
-                        /* Update the record size */
-                        storage_seek(frogfs_RAM[record].write_offset - 3U);  /* record is situated 3 bytes before */
-                        storage_read(tmp, 3U);
-
-                        tmp_size = frogfs_RAM[record].work_reg_2;
-                        tmp[1] = (tmp[1] & 0x80) | (uint8_t)(tmp_size >> 8U);
-                        tmp[2] = (uint8_t)(tmp_size);
-
-                        storage_seek(frogfs_RAM[record].write_offset - 3U);  /* record is situated 3 bytes before */
-                        storage_write(tmp, 3U);
-                    }
-                    else
-                    {
-                        /* Update the record size */
-                        storage_seek(frogfs_RAM[record].write_offset - 3U);  /* record is situated 3 bytes before */
-                        storage_read(tmp, 3U);
-
-                        tmp_size = frogfs_RAM[record].work_reg_2;
-
-                        tmp[0] = (uint8_t)(FROGFS_RECORD_TYPE_FRAGMENT << 7U) | FROGFS_RECORD_INDEX_OFFSET(record);
-                        tmp[1] = (uint8_t)((FROGFS_RECORD_DATA_SIZE << 7U)) | (uint8_t)(tmp_size >> 8U);
-                        tmp[2] = (uint8_t)(tmp_size);
+            /* Byte comparison for the tail and to locate the first non-zero byte */
+            while ((i < chunk) && (buffer[i] == 0U))
+            {
+                i++;
+            }
 
-                        storage_seek(frogfs_RAM[record].write_offset - 3U);  /* record is situated 3 bytes before */
-                        storage_write(tmp, 3U);
-                    }
-                }
+            *pos += i;
 
-            } while ((io_error == false) && (exit_loop == false));
+            if (i < chunk)
+            {
+                /* Non-zero byte found */
+                break;
+            }
         }
     }
-    else
+
+    if ((retval == FROGFS_ERR_OK) && (*pos >= scan_end))
     {
-        FROGFS_DEBUG_VERBOSE("too large record %d or size %d", record, size);
-        retval = FROGFS_ERR_INVALID_RECORD;
+        /* Free till the end */
+        *pos = disk_size;
     }
 
     return retval;
 }
 
-t_e_frogfs_error frogfs_close(uint8_t record)
+#ifdef FROGFS_USE_QUICK_FORMAT
+/**
+ * Write the high-water mark in the header of the storage.
+ */
+static t_e_frogfs_error frogfs_high_water_store(t_s_frogfs_volume *volume, t_frogfs_offset mark)
 {
-    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    uint8_t tmp[FROGFS_RECORD_POINTER_SIZE];
+    uint8_t i;
 
-    FROGFS_DEBUG_VERBOSE("%s: record %d", __FUNCTION__, record);
+    for (i = 0; i < FROGFS_RECORD_POINTER_SIZE; i++)
+    {
+        tmp[i] = (uint8_t)(mark >> (8U * i));
+    }
 
-    /* Check if the file exists or not */
-    if (record < FROGFS_MAX_RECORD_COUNT)
+    return storage_cache_write_at(&volume->storage, FROGFS_HEADER_MARK_OFFSET, tmp, FROGFS_RECORD_POINTER_SIZE);
+}
+
+/**
+ * Make sure that the storage is formatted up to the given offset before it is written:
+ * the bytes between the high-water mark and the offset (rounded up to
+ * FROGFS_HIGH_WATER_STEP) are zeroed, then the mark is moved after them.
+ *
+ * @param end   the offset after the last byte about to be written, including the
+ *              zeroed bytes that shall follow them (e.g. the room kept for appending)
+ */
+static t_e_frogfs_error frogfs_high_water_raise(t_s_frogfs_volume *volume, t_frogfs_offset end)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    uint32_t mark;
+
+    if (end > volume->high_water)
     {
-        if (frogfs_RAM[record].write_offset > 0U)
+        mark = (((uint32_t)end + FROGFS_HIGH_WATER_STEP - 1UL) / FROGFS_HIGH_WATER_STEP) * FROGFS_HIGH_WATER_STEP;
+        if (mark > storage_cache_size(&volume->storage))
         {
-            /* File was being written to. Close it and clean registers. */
-            frogfs_RAM[record].write_offset = 0;
-            frogfs_RAM[record].work_reg_1   = 0;
-            frogfs_RAM[record].work_reg_2   = 0;
-            retval = FROGFS_ERR_OK;
+            mark = storage_cache_size(&volume->storage);
         }
-        else if (frogfs_RAM[record].work_reg_1 > 0U)
+
+        retval = storage_cache_fill(&volume->storage, volume->high_water, 0U, (t_frogfs_offset)(mark - volume->high_water));
+
+        /* The mark shall reach the storage before anything is written after the former one */
+        if (retval == FROGFS_ERR_OK)
         {
-            frogfs_RAM[record].write_offset = 0;
-            frogfs_RAM[record].work_reg_1   = 0;
-            frogfs_RAM[record].work_reg_2   = 0;
-            retval = FROGFS_ERR_OK;
+            retval = frogfs_high_water_store(volume, (t_frogfs_offset)mark);
         }
-        else if (frogfs_RAM[record].offset > 0U)
+
+        if (retval == FROGFS_ERR_OK)
         {
-            /* The file has only been opened but no operation has been performed. Just do nothing close. */
-            retval = FROGFS_ERR_OK;
+            retval = storage_cache_flush(&volume->storage);
         }
-        else
+
+        if (retval == FROGFS_ERR_OK)
         {
-            /* Not open neither for read nor for write */
-            retval = FROGFS_ERR_INVALID_OPERATION;
+            volume->high_water = (t_frogfs_offset)mark;
         }
     }
-    else
-    {
-        FROGFS_DEBUG_VERBOSE("too large record %d", record);
-        retval = FROGFS_ERR_INVALID_RECORD;
-    }
 
     return retval;
 }
+#else
+/* The whole storage is formatted */
+#define frogfs_high_water_raise(volume, end)    (FROGFS_ERR_OK)
+#endif
+
+/**
+ * Empty the free-extent map. The map is considered valid (i.e. it is maintained) afterwards.
+ * An incremental scan in progress is dropped.
+ */
+static void frogfs_free_map_reset(t_s_frogfs_volume *volume)
+{
+    volume->free_map_count = 0U;
+    volume->free_map_valid = true;
+    volume->free_map_lossy = false;
+    volume->free_map_fresh = false;
+    volume->scan_pos = 0U;
+}
 
-t_e_frogfs_error frogfs_erase_range(uint16_t pos, uint16_t size)
+/**
+ * Remove the entry at the given index of the free-extent map.
+ */
+static void frogfs_free_map_delete(t_s_frogfs_volume *volume, uint8_t i)
 {
-    t_e_frogfs_error retval = FROGFS_ERR_IO;
-    uint16_t i;
-    uint8_t tmp = 0;
-    retval = storage_seek(pos);
+    volume->free_map_count--;
+    (void)memmove(&volume->free_map[i], &volume->free_map[i + 1U],
+                  (size_t)(volume->free_map_count - i) * sizeof(t_s_frogfs_extent));
+}
 
-    if (retval == FROGFS_ERR_OK)
+/**
+ * Insert an extent at the given index of the free-extent map.
+ * If the map is full, the smallest extent is dropped and the map is flagged as lossy.
+ *
+ * @return  the index of the inserted extent, FROGFS_MAX_FREE_EXTENTS if it has been dropped
+ */
+static uint8_t frogfs_free_map_insert(t_s_frogfs_volume *volume, uint8_t i, t_frogfs_offset start, t_frogfs_offset size)
+{
+    uint8_t j;
+    uint8_t smallest = 0U;
+
+    if (volume->free_map_count >= FROGFS_MAX_FREE_EXTENTS)
     {
-        for (i = 0; i < size; i++)
+        /* Overflow: drop the smallest extent (that could be the new one) */
+        for (j = 1U; j < volume->free_map_count; j++)
         {
-            retval = storage_write(&tmp, 1);
-            if (retval != FROGFS_ERR_OK)
+            if (volume->free_map[j].size < volume->free_map[smallest].size)
             {
-                break;
+                smallest = j;
+            }
+        }
+
+        volume->free_map_lossy = true;
+
+        if (volume->free_map[smallest].size <= size)
+        {
+            frogfs_free_map_delete(volume, smallest);
+            if (smallest < i)
+            {
+                i--;
             }
         }
+        else
+        {
+            return FROGFS_MAX_FREE_EXTENTS;
+        }
     }
 
-    return retval;
+    (void)memmove(&volume->free_map[i + 1U], &volume->free_map[i],
+                  (size_t)(volume->free_map_count - i) * sizeof(t_s_frogfs_extent));
+    volume->free_map[i].start = start;
+    volume->free_map[i].size = size;
+    volume->free_map_count++;
+
+    return i;
 }
 
-// work_reg_1: block start
-// work_reg_2: block size
-t_e_frogfs_error frogfs_traverse(uint8_t record, uint8_t *data, uint16_t size, uint16_t *effective_read, bool erase)
+/**
+ * Insert a free extent in the map, merging it with the adjacent ones, whether the map
+ * is valid or still being built by a scan.
+ */
+static void frogfs_free_map_merge(t_s_frogfs_volume *volume, t_frogfs_offset start, t_frogfs_offset size)
 {
-    t_e_frogfs_error retval = FROGFS_ERR_IO;
-    uint8_t tmp[3];
-    uint16_t tmp_read_size = 0;
-    bool io_error = false;
-    bool exit_loop = false;
-    uint8_t record_index;
+    uint8_t i = 0U;
 
-    *effective_read = 0;
+    if (size == 0U)
+    {
+        return;
+    }
 
-    FROGFS_DEBUG_VERBOSE("%s: record %d size %d", __FUNCTION__, (uint16_t)record, (uint16_t)size);
+    volume->free_map_fresh = false;
 
-    /* Check if the file exists or not */
-    if ((record < FROGFS_MAX_RECORD_COUNT) && (size <= FROGFS_MAX_RECORD_SIZE))
+    /* Find the insertion point */
+    while ((i < volume->free_map_count) && (volume->free_map[i].start < start))
+    {
+        i++;
+    }
+
+    if ((i > 0U) && ((t_frogfs_offset)(volume->free_map[i - 1U].start + volume->free_map[i - 1U].size) >= start))
     {
-        if (frogfs_RAM[record].write_offset != 0)
+        /* Merge with the previous extent */
+        i--;
+        if ((t_frogfs_offset)(start + size) > (t_frogfs_offset)(volume->free_map[i].start + volume->free_map[i].size))
         {
-            /* Open for writing */
-            retval = FROGFS_ERR_NOT_READABLE;
+            volume->free_map[i].size = (t_frogfs_offset)(start + size) - volume->free_map[i].start;
         }
-        else
+    }
+    else
+    {
+        i = frogfs_free_map_insert(volume, i, start, size);
+        if (i >= FROGFS_MAX_FREE_EXTENTS)
         {
-            /* Continue reading the required size until it is possible */
-            do
-            {
-                if ((frogfs_RAM[record].work_reg_1 > 0) && (frogfs_RAM[record].work_reg_2 == UINT16_MAX))
-                {
-                    /* Seek to the position since operations on more records might be interleaved */
-                    retval = storage_seek(frogfs_RAM[record].work_reg_1);
+            /* Dropped due to overflow */
+            return;
+        }
+    }
 
-                    /* The current block has been fully read:
-                     * - either it is the full record in a single block
-                     * - it is followed by fragments
-                     */
-                    retval = storage_read(tmp, 3U);
+    /* Merge with the following extents */
+    while (((uint8_t)(i + 1U) < volume->free_map_count) &&
+           ((t_frogfs_offset)(volume->free_map[i].start + volume->free_map[i].size) >= volume->free_map[i + 1U].start))
+    {
+        if ((t_frogfs_offset)(volume->free_map[i + 1U].start + volume->free_map[i + 1U].size) >
+            (t_frogfs_offset)(volume->free_map[i].start + volume->free_map[i].size))
+        {
+            volume->free_map[i].size = (t_frogfs_offset)(volume->free_map[i + 1U].start + volume->free_map[i + 1U].size) - volume->free_map[i].start;
+        }
+        frogfs_free_map_delete(volume, i + 1U);
+    }
+}
 
-                    /* decode the record index */
-                    record_index = FROGFS_RECORD_INDEX(tmp[0]);
+/**
+ * Add a free extent to the map, merging it with the adjacent ones.
+ */
+static void frogfs_free_map_add(t_s_frogfs_volume *volume, t_frogfs_offset start, t_frogfs_offset size)
+{
+    if (volume->free_map_valid == true)
+    {
+        frogfs_free_map_merge(volume, start, size);
+    }
+    else
+    {
+        /* The incremental scan may have passed the extent already: start it again */
+        volume->scan_pos = 0U;
+    }
+}
 
-                    if (retval != FROGFS_ERR_OK)
-                    {
-                        io_error = true;
-                    }
-                    else if (record != record_index)
-                    {
-                        // TODO this message is also happening normally i.e. empty space after file. Please check that ...
-                        FROGFS_DEBUG_VERBOSE("Record block found but of different record index %d. Skip.", record_index);
-                        exit_loop = true;
-                    }
-                    else
-                    {
-                        /* Check if it is a fragment */
-                        if ((tmp[0] >> 7U) == FROGFS_RECORD_TYPE_FRAGMENT)
-                        {
-                            /* Fragment type */
-                            FROGFS_DEBUG_VERBOSE("Fragment found. File read continues.");
-                            /* Determine fragment type */
-                            if ((tmp[1] >> 7U) == FROGFS_RECORD_DATA_SIZE)
-                            {
-                                /* Sized fragment */
-                                FROGFS_DEBUG_VERBOSE("Sized fragment. Continue reading from %d", frogfs_RAM[record].work_reg_1);
+/**
+ * Remove a range (that is going to be used) from the free-extent map.
+ */
+static void frogfs_free_map_remove(t_s_frogfs_volume *volume, t_frogfs_offset start, t_frogfs_offset size)
+{
+    uint8_t i = 0U;
+    t_frogfs_offset end = (t_frogfs_offset)(start + size);
+    t_frogfs_offset ext_end;
 
-                                retval = storage_pos(&frogfs_RAM[record].work_reg_1);                    /* save the data pointer */
-                                frogfs_RAM[record].work_reg_2 = FROGFS_RECORD_POINTER(tmp[0], tmp[1], tmp[2]);  /* Index - MSB (remove the size type bit) - LSB */
-                                FROGFS_DEBUG_VERBOSE("fragmented record size %d starting at %d", frogfs_RAM[record].work_reg_2, frogfs_RAM[record].work_reg_1);
-                            }
-                            else
-                            {
-                                /* Pointer fragment */
-                                tmp_read_size = (uint16_t)(tmp[1] << 8U) | (uint16_t)tmp[2];
-                                FROGFS_DEBUG_VERBOSE("Pointer fragment. Jump to %d", tmp_read_size);
-// not necessary here                                retval = storage_seek(tmp_read_size);
-                                frogfs_RAM[record].work_reg_1 = tmp_read_size;   /* save the pointer also in the working register 1 */
-                                frogfs_RAM[record].work_reg_2 = UINT16_MAX;      /* still no data to read, maybe in the next fragment */
+    if (volume->free_map_valid == false)
+    {
+        /* The incremental scan may have passed the range already: start it again */
+        volume->scan_pos = 0U;
+    }
+    else
+    {
+        volume->free_map_fresh = false;
+    }
 
-                                if (retval != FROGFS_ERR_OK)
-                                {
-                                    io_error = true;
-                                }
-                            }
+    while ((volume->free_map_valid == true) && (i < volume->free_map_count))
+    {
+        ext_end = (t_frogfs_offset)(volume->free_map[i].start + volume->free_map[i].size);
 
-                            /* check if erasing */
-                            if (erase == true)
-                            {
-                                /* If so, then erase the record */
-                                retval = storage_pos(&tmp_read_size);
-                                retval = frogfs_erase_range((uint16_t)(tmp_read_size - 3U), 3U);
+        if ((ext_end <= start) || (volume->free_map[i].start >= end))
+        {
+            /* No overlap */
+            i++;
+        }
+        else if ((volume->free_map[i].start < start) && (ext_end > end))
+        {
+            /* The range is in the middle of the extent: split it */
+            volume->free_map[i].size = start - volume->free_map[i].start;
+            (void)frogfs_free_map_insert(volume, (uint8_t)(i + 1U), end, (t_frogfs_offset)(ext_end - end));
+            break;
+        }
+        else if (volume->free_map[i].start < start)
+        {
+            /* Cut the tail of the extent */
+            volume->free_map[i].size = start - volume->free_map[i].start;
+            i++;
+        }
+        else if (ext_end > end)
+        {
+            /* Cut the head of the extent */
+            volume->free_map[i].start = end;
+            volume->free_map[i].size = ext_end - end;
+            i++;
+        }
+        else
+        {
+            /* The extent is entirely covered */
+            frogfs_free_map_delete(volume, i);
+        }
+    }
+}
 
-                                if (retval != FROGFS_ERR_OK)
-                                {
-                                    io_error = true;
-                                }
-                            }
-                        }
-                        else
-                        {
-                            /* Not a fragment. File read has been completed. */
-                            FROGFS_DEBUG_VERBOSE("not a fragment. File read done.");
-                            exit_loop = true;
-                        }
-                    }
-                }
-                else if (frogfs_RAM[record].work_reg_1 > 0)
-                {
-                    /* The file is already being read, continue */
+/**
+ * Store the given size in the header of the block being written. The header is rebuilt
+ * from the record state, so it does not need to be read back from the storage.
+ */
+static t_e_frogfs_error frogfs_store_block_header(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset size)
+{
+    t_e_frogfs_error retval;
+    uint8_t tmp[FROGFS_RECORD_METADATA_SIZE];
+    uint8_t record_type;
+    t_frogfs_offset pos = (t_frogfs_offset)(volume->records[record].write_offset - FROGFS_RECORD_METADATA_SIZE);
 
-                    /* move to the current read pointer */
-                    retval = storage_seek(frogfs_RAM[record].work_reg_1);
+    /* Check if it is the first record block */
+    if (volume->records[record].offset == pos)
+    {
+        record_type = FROGFS_RECORD_TYPE_NORMAL;
+    }
+    else
+    {
+        record_type = FROGFS_RECORD_TYPE_FRAGMENT;
+    }
+    frogfs_metadata_encode(tmp, FROGFS_RECORD_ID(volume, record), record_type, FROGFS_RECORD_DATA_SIZE, size);
 
-                    if (retval != FROGFS_ERR_OK)
-                    {
-                        io_error = true;
-                    }
-                    else
-                    {
-                        if (erase == true)
-                        {
-                            /* when erasing, always erase the entire record */
-                            tmp_read_size = frogfs_RAM[record].work_reg_2;
+    retval = storage_cache_write_at(&volume->storage, pos, tmp, FROGFS_RECORD_METADATA_SIZE);
 
-                            /* erase the whole length */
-                            retval = frogfs_erase_range(frogfs_RAM[record].work_reg_1, frogfs_RAM[record].work_reg_2);
-                        }
-                        else
-                        {
-                            /* not erasing but reading */
+    if (retval == FROGFS_ERR_OK)
+    {
+        volume->records[record].header_size = size;
+    }
 
-                            /* read the data: min between block size and remaining data */
-                            tmp_read_size = (size < frogfs_RAM[record].work_reg_2) ? size : frogfs_RAM[record].work_reg_2;
+    return retval;
+}
 
-                            /* read from disk */
-                            if (data != NULL)
-                            {
-                                retval = storage_read(&data[*effective_read], tmp_read_size);
-                            }
-                        }
+/**
+ * Store the size of the block being written (work_reg_2) in its header, if it
+ * changed since the last update.
+ */
+static t_e_frogfs_error frogfs_commit_block_header(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
 
-                        /* advance the effective read counter */
-                        *effective_read += tmp_read_size;
+    if (volume->records[record].header_size != volume->records[record].work_reg_2)
+    {
+        retval = frogfs_store_block_header(volume, record, volume->records[record].work_reg_2);
+    }
 
-                        if (retval != FROGFS_ERR_OK)
-                        {
-                            io_error = true;
-                        }
-                        else
-                        {
-                            /* update the read pointer */
-                            retval = storage_pos(&frogfs_RAM[record].work_reg_1);
-                            /* update the read size */
-                            frogfs_RAM[record].work_reg_2 -= tmp_read_size;
+    return retval;
+}
 
-                            if (frogfs_RAM[record].work_reg_2 == 0)
-                            {
-                                FROGFS_DEBUG_VERBOSE("end of block. Setting read size to UINT16_MAX");
-                                frogfs_RAM[record].work_reg_2 = UINT16_MAX;
-                            }
+/**
+ * Make the size stored in the header of the block being written cover its data up to
+ * end, before that data is written: the data on the storage never goes past the size of
+ * its block, where a scan would take it for metadata. With FROGFS_USE_DEFERRED_HEADER,
+ * the size goes up to FROGFS_HEADER_STEP bytes ahead of end (within the block), so that
+ * the header is not stored at every write; the bytes ahead are zeroed until written.
+ */
+static t_e_frogfs_error frogfs_extend_block_header(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset end)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    uint32_t size = end;
 
-                            if (retval != FROGFS_ERR_OK)
-                            {
-                                io_error = true;
-                            }
-                        }
-                    }
+    if (volume->records[record].header_size < end)
+    {
+#ifdef FROGFS_USE_DEFERRED_HEADER
+        size += FROGFS_HEADER_STEP;
+        if (size > volume->records[record].work_reg_1)
+        {
+            size = volume->records[record].work_reg_1;
+        }
+#endif
 
-                }
-                else
-                {
-                    /* First read operation. Seek to the start normal record */
+        /* The block data and the zeroed bytes that follow it are formatted (see FROGFS_USE_QUICK_FORMAT) */
+        retval = frogfs_high_water_raise(volume, (t_frogfs_offset)(volume->records[record].write_offset + size + FROGFS_APPEND_RESERVED_SPACE));
 
-                    /* Goto record start pointer */
-                    retval = storage_seek(frogfs_RAM[record].offset);
+        if (retval == FROGFS_ERR_OK)
+        {
+            retval = frogfs_store_block_header(volume, record, (t_frogfs_offset)size);
+        }
+    }
 
-                    if (retval == FROGFS_ERR_OK)
-                    {
-                        /* Read the size of the record */
-                        retval = storage_read(tmp, 3);
+    return retval;
+}
 
-                        if (retval == FROGFS_ERR_OK)
-                        {
-                            retval = storage_pos(&frogfs_RAM[record].work_reg_1);                            /* save the data pointer */
-                            frogfs_RAM[record].work_reg_2 = FROGFS_RECORD_POINTER(tmp[0], tmp[1], tmp[2]);   /* pick the block size from the metadata block */
-                            FROGFS_DEBUG_VERBOSE("record size %d", frogfs_RAM[record].work_reg_2);
-                        }
+/**
+ * Return the size of the free extent starting exactly at the given offset, 0 if none.
+ */
+static t_frogfs_offset frogfs_free_map_size_at(t_s_frogfs_volume *volume, t_frogfs_offset start)
+{
+    t_frogfs_offset size = 0U;
+    uint8_t i;
 
-                        if (erase == true)
-                        {
-                            /* Erase the record */
-                            retval = frogfs_erase_range(frogfs_RAM[record].offset, 3U);
-                            /* fake the rsize, iterating until all the record has been traversed */
-                            size = 0xFFFFU;
-                        }
-                    }
-                }
-            } while ((*effective_read < size) && (io_error == false) && (exit_loop == false));
+    for (i = 0; i < volume->free_map_count; i++)
+    {
+        if (volume->free_map[i].start == start)
+        {
+            size = volume->free_map[i].size;
+            break;
         }
     }
-    else
+
+    return size;
+}
+
+/**
+ * Add a hole found by a storage scan to the free-extent map. A hole right after the
+ * data of a sized block (i.e. after the last block of a record) begins with the
+ * FROGFS_APPEND_RESERVED_SPACE bytes kept for appending: those are not free.
+ *
+ * @param data_end  end of the data of the last sized block seen by the scan
+ */
+static void frogfs_free_map_add_scanned(t_s_frogfs_volume *volume, t_frogfs_offset hole_start, t_frogfs_offset hole_end, t_frogfs_offset data_end)
+{
+    if (hole_start == data_end)
     {
-        FROGFS_DEBUG_VERBOSE("too large record %d or size %d", record, size);
-        retval = FROGFS_ERR_INVALID_RECORD;
+        hole_start = ((t_frogfs_offset)(hole_end - hole_start) > FROGFS_APPEND_RESERVED_SPACE) ?
+                     (t_frogfs_offset)(hole_start + FROGFS_APPEND_RESERVED_SPACE) : hole_end;
     }
 
-    return retval;
+    frogfs_free_map_merge(volume, hole_start, (t_frogfs_offset)(hole_end - hole_start));
 }
 
-t_e_frogfs_error frogfs_read(uint8_t record, uint8_t *data, uint16_t size, uint16_t *effective_read)
+/**
+ * Give back to the free-extent map the space kept for appending after the last block
+ * of an erased record: the zeroed bytes (up to FROGFS_APPEND_RESERVED_SPACE) at data_end.
+ */
+static t_e_frogfs_error frogfs_free_map_release_append_space(t_s_frogfs_volume *volume, t_frogfs_offset data_end)
 {
-    return frogfs_traverse(record, data, size, effective_read, false);
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    uint8_t tmp[FROGFS_APPEND_RESERVED_SPACE];
+    t_frogfs_offset size = FROGFS_APPEND_RESERVED_SPACE;
+    t_frogfs_offset i = 0U;
+
+    if (((uint32_t)data_end + size) > storage_cache_size(&volume->storage))
+    {
+        size = (data_end < storage_cache_size(&volume->storage)) ? (t_frogfs_offset)(storage_cache_size(&volume->storage) - data_end) : 0U;
+    }
+
+    if (size > 0U)
+    {
+        retval = storage_cache_read_at(&volume->storage, data_end, tmp, size);
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        while ((i < size) && (tmp[i] == 0U))
+        {
+            i++;
+        }
+        frogfs_free_map_add(volume, data_end, i);
+    }
+
+    return retval;
 }
 
-t_e_frogfs_error frogfs_erase(uint8_t record)
+/**
+ * Read the size from the metadata of a block of the record (normal-size for the first
+ * block, fragment-size for the others).
+ */
+static t_e_frogfs_error frogfs_read_block_size(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset pos, t_frogfs_offset *size)
 {
     t_e_frogfs_error retval;
-    uint16_t effective_erased = 0;
+    uint8_t tmp[FROGFS_RECORD_METADATA_SIZE];
 
-    retval = frogfs_open(record);
+    retval = storage_cache_read_at(&volume->storage, pos, tmp, FROGFS_RECORD_METADATA_SIZE);
+    if ((retval == FROGFS_ERR_OK) &&
+        ((FROGFS_RECORD_INDEX(tmp) != FROGFS_RECORD_ID(volume, record)) || (FROGFS_RECORD_DATA(tmp) != FROGFS_RECORD_DATA_SIZE)))
+    {
+        retval = FROGFS_ERR_OUT_OF_RANGE;
+    }
 
     if (retval == FROGFS_ERR_OK)
     {
-        retval = frogfs_traverse(record, NULL, 0, &effective_erased, true);
+        *size = FROGFS_RECORD_POINTER(tmp);
+    }
 
-        if (retval == FROGFS_ERR_OK)
-        {
-            /* successful traversal and erasure */
+    return retval;
+}
 
-            /* close the record */
-            retval = frogfs_close(record);
+/**
+ * Look for the fragment pointer of the record after the data of a block.
+ *
+ * @param next  the position of the next block, 0 if the block is the last one
+ */
+static t_e_frogfs_error frogfs_read_next_block(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset data_end, t_frogfs_offset *next)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    uint8_t tmp[FROGFS_RECORD_METADATA_SIZE];
 
-            /* delete the record from the allocation table */
-            frogfs_RAM[record].offset = 0U;
+    *next = 0U;
+
+    if (((uint32_t)data_end + FROGFS_RECORD_METADATA_SIZE) <= storage_cache_size(&volume->storage))
+    {
+        retval = storage_cache_read_at(&volume->storage, data_end, tmp, FROGFS_RECORD_METADATA_SIZE);
+
+        if ((retval == FROGFS_ERR_OK) &&
+            (FROGFS_RECORD_INDEX(tmp) == FROGFS_RECORD_ID(volume, record)) &&
+            (FROGFS_RECORD_TYPE(tmp) == FROGFS_RECORD_TYPE_FRAGMENT) &&
+            (FROGFS_RECORD_DATA(tmp) == FROGFS_RECORD_DATA_POINTER))
+        {
+            *next = FROGFS_RECORD_POINTER(tmp);
         }
     }
 
     return retval;
 }
 
+#ifdef FROGFS_USE_EXTENT_CACHE
+/**
+ * Forget the data blocks of a record (all the records if record is FROGFS_MAX_RECORD_COUNT).
+ * Shall be called whenever the blocks of the record change on the storage.
+ */
+static void frogfs_extent_cache_reset(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    if (record < FROGFS_MAX_RECORD_COUNT)
+    {
+        (void)memset(&volume->extent_cache[record], 0, sizeof(volume->extent_cache[record]));
+    }
+    else
+    {
+        (void)memset(volume->extent_cache, 0, sizeof(volume->extent_cache));
+    }
+}
+
+/**
+ * Follow the fragment chain of a record, reading its metadata only, and cache its data blocks.
+ */
+static t_e_frogfs_error frogfs_extent_cache_fill(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    t_s_frogfs_extent_cache *cache = &volume->extent_cache[record];
+    t_s_frogfs_extent *extent;
+    t_frogfs_offset pos = volume->records[record].offset;
+
+    while ((retval == FROGFS_ERR_OK) && (cache->state == FROGFS_EXTENT_CACHE_EMPTY))
+    {
+        if (cache->count >= FROGFS_EXTENT_CACHE_SIZE)
+        {
+            /* The rest of the chain is read from the storage when traversed */
+            cache->state = FROGFS_EXTENT_CACHE_PARTIAL;
+            break;
+        }
+
+        extent = &cache->extents[cache->count];
+        extent->start = (t_frogfs_offset)(pos + FROGFS_RECORD_METADATA_SIZE);
+        retval = frogfs_read_block_size(volume, record, pos, &extent->size);
+
+        if (retval == FROGFS_ERR_OK)
+        {
+            cache->count++;
+            retval = frogfs_read_next_block(volume, record, (t_frogfs_offset)(extent->start + extent->size), &pos);
+        }
+
+        if ((retval == FROGFS_ERR_OK) && (pos == 0U))
+        {
+            cache->state = FROGFS_EXTENT_CACHE_COMPLETE;
+        }
+    }
+
+    if (retval != FROGFS_ERR_OK)
+    {
+        /* Inconsistent chain: let the traversal deal with the metadata */
+        frogfs_extent_cache_reset(volume, record);
+    }
+
+    return retval;
+}
+
+/**
+ * Move the traversal of a record from the end of the current block to the next block,
+ * through the extent cache. When erasing, the metadata in between is erased as well.
+ *
+ * @param end       set to true if the record has no further block
+ * @return false if the next block is not cached: its metadata shall be read from the storage
+ */
+static bool frogfs_extent_cache_next(t_s_frogfs_volume *volume, t_frogfs_record record, bool erase, bool *end, t_e_frogfs_error *retval)
+{
+    t_s_frogfs_extent_cache *cache = &volume->extent_cache[record];
+    t_frogfs_offset block_end = volume->records[record].work_reg_1;
+    bool handled = false;
+
+    if ((uint8_t)(cache->cursor + 1U) < cache->count)
+    {
+        cache->cursor++;
+        *retval = FROGFS_ERR_OK;
+
+        if (erase == true)
+        {
+            /* Fragment - Pointer after the block and Fragment - Size before the next one */
+            *retval = frogfs_erase_range_unlocked(volume, block_end, FROGFS_RECORD_METADATA_SIZE);
+            if (*retval == FROGFS_ERR_OK)
+            {
+                *retval = frogfs_erase_range_unlocked(volume, (t_frogfs_offset)(cache->extents[cache->cursor].start - FROGFS_RECORD_METADATA_SIZE),
+                                             FROGFS_RECORD_METADATA_SIZE);
+            }
+        }
+
+        volume->records[record].work_reg_1 = cache->extents[cache->cursor].start;
+        volume->records[record].work_reg_2 = cache->extents[cache->cursor].size;
+        handled = true;
+    }
+    else if (((uint8_t)(cache->cursor + 1U) == cache->count) && (cache->state == FROGFS_EXTENT_CACHE_COMPLETE))
+    {
+        /* Last block */
+        *end = true;
+        *retval = FROGFS_ERR_OK;
+
+        if (erase == true)
+        {
+            /* Its room for appending is free again */
+            *retval = frogfs_free_map_release_append_space(volume, block_end);
+        }
+        handled = true;
+    }
+
+    return handled;
+}
+#endif
+
+#ifdef FROGFS_USE_QUICK_FORMAT
+/**
+ * Move the high-water mark back to the free space at the end of the storage (rounded up to
+ * FROGFS_HIGH_WATER_STEP), once the records there have been erased: the scans stop right
+ * after the last allocated byte again. The free space below the mark is zeroed already.
+ */
+static t_e_frogfs_error frogfs_high_water_trim(t_s_frogfs_volume *volume)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    const t_s_frogfs_extent *tail;
+    uint32_t mark;
+
+    if ((volume->free_map_valid == true) && (volume->free_map_count > 0U))
+    {
+        tail = &volume->free_map[volume->free_map_count - 1U];
+
+        if (((uint32_t)tail->start + tail->size) >= volume->high_water)
+        {
+            mark = (((uint32_t)tail->start + FROGFS_HIGH_WATER_STEP - 1UL) / FROGFS_HIGH_WATER_STEP) * FROGFS_HIGH_WATER_STEP;
+
+            if (mark < volume->high_water)
+            {
+                /* A mark left too high is harmless: no ordering with the other writes */
+                retval = frogfs_high_water_store(volume, (t_frogfs_offset)mark);
+
+                if (retval == FROGFS_ERR_OK)
+                {
+                    volume->high_water = (t_frogfs_offset)mark;
+                }
+            }
+        }
+    }
+
+    return retval;
+}
+#else
+#define frogfs_high_water_trim(volume)          (FROGFS_ERR_OK)
+#endif
+
+/**
+ * Build the free-extent map by scanning the whole storage.
+ */
+static t_e_frogfs_error frogfs_free_map_build(t_s_frogfs_volume *volume)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    uint8_t tmp[FROGFS_RECORD_METADATA_SIZE];
+    t_frogfs_offset pos_cur = FROGFS_DATA_OFFSET;
+    t_frogfs_offset hole_start;
+    t_frogfs_offset data_end = 0U;
+    t_frogfs_record i;
+
+    /* The block headers of the records being written shall describe their data */
+    for (i = 0; (i < FROGFS_MAX_RECORD_COUNT) && (retval == FROGFS_ERR_OK); i++)
+    {
+        if (volume->records[i].write_offset > 0U)
+        {
+            retval = frogfs_commit_block_header(volume, i);
+        }
+    }
+
+    frogfs_free_map_reset(volume);
+
+    while ((retval == FROGFS_ERR_OK) && (pos_cur < storage_cache_size(&volume->storage)) && (pos_cur >= FROGFS_DATA_OFFSET))
+    {
+        hole_start = pos_cur;
+        retval = frogfs_skip_free_space(volume, &pos_cur, storage_cache_size(&volume->storage));
+        frogfs_free_map_add_scanned(volume, hole_start, pos_cur, data_end);
+
+        if ((retval != FROGFS_ERR_OK) || (((uint32_t)pos_cur + FROGFS_RECORD_METADATA_SIZE) > storage_cache_size(&volume->storage)))
+        {
+            break;
+        }
+
+        retval = storage_cache_read_at(&volume->storage, pos_cur, tmp, FROGFS_RECORD_METADATA_SIZE);
+
+        pos_cur += FROGFS_RECORD_METADATA_SIZE;
+        if (FROGFS_RECORD_DATA(tmp) == FROGFS_RECORD_DATA_SIZE)
+        {
+            /* Skip the data */
+            pos_cur += FROGFS_RECORD_POINTER(tmp);
+            data_end = pos_cur;
+        }
+    }
+
+    /* The blocks being written keep their whole space, up to the fragment pointer and spare byte */
+    for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
+    {
+        if (volume->records[i].write_offset > 0U)
+        {
+            frogfs_free_map_remove(volume, (t_frogfs_offset)(volume->records[i].write_offset + volume->records[i].work_reg_2),
+                                   (t_frogfs_offset)(volume->records[i].work_reg_1 - volume->records[i].work_reg_2 + FROGFS_APPEND_RESERVED_SPACE));
+        }
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        retval = frogfs_high_water_trim(volume);
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        volume->free_map_fresh = true;
+    }
+    else
+    {
+        volume->free_map_valid = false;
+    }
+
+    return retval;
+}
+
+/**
+ * Build the free-extent map a piece at a time: scan about budget bytes of the storage
+ * from where the previous call stopped. The map is not used till the scan is complete;
+ * the scan starts again if the storage changes in the meantime (see frogfs_free_map_add).
+ * The records open for writing shall be closed, as their block headers may lag behind.
+ * @param budget    in: bytes that can be read; out: bytes left
+ */
+static t_e_frogfs_error frogfs_free_map_scan_step(t_s_frogfs_volume *volume, t_frogfs_offset *budget)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    uint8_t tmp[FROGFS_RECORD_METADATA_SIZE];
+    t_frogfs_offset disk_size = storage_cache_size(&volume->storage);
+    t_frogfs_offset hole_start;
+    t_frogfs_offset done;
+    uint32_t limit;
+
+    if (volume->scan_pos == 0U)
+    {
+        /* Start over: the map stays unused till the end of the scan */
+        frogfs_free_map_reset(volume);
+        volume->free_map_valid = false;
+        volume->scan_pos = FROGFS_DATA_OFFSET;
+        volume->scan_data_end = 0U;
+    }
+
+    while ((retval == FROGFS_ERR_OK) && (*budget > 0U) && (volume->scan_pos < disk_size) && (volume->scan_pos >= FROGFS_DATA_OFFSET))
+    {
+        /* A hole split by the budget keeps the reserved space of the block before it whole */
+        limit = (uint32_t)volume->scan_pos + ((*budget > FROGFS_MIN_CONTIGUOUS_SPACE) ? *budget : FROGFS_MIN_CONTIGUOUS_SPACE);
+        if (limit > disk_size)
+        {
+            limit = disk_size;
+        }
+
+        hole_start = volume->scan_pos;
+        retval = frogfs_skip_free_space(volume, &volume->scan_pos, (t_frogfs_offset)limit);
+        frogfs_free_map_add_scanned(volume, hole_start, volume->scan_pos, volume->scan_data_end);
+
+        done = (t_frogfs_offset)(volume->scan_pos - hole_start);
+        *budget = (done < *budget) ? (t_frogfs_offset)(*budget - done) : 0U;
+
+        if ((retval != FROGFS_ERR_OK) || (volume->scan_pos == limit) || (volume->scan_pos >= disk_size))
+        {
+            /* Free space up to the limit, or till the end */
+            continue;
+        }
+
+        if (((uint32_t)volume->scan_pos + FROGFS_RECORD_METADATA_SIZE) > disk_size)
+        {
+            volume->scan_pos = disk_size;
+            break;
+        }
+
+        retval = storage_cache_read_at(&volume->storage, volume->scan_pos, tmp, FROGFS_RECORD_METADATA_SIZE);
+        *budget = (*budget > FROGFS_RECORD_METADATA_SIZE) ? (t_frogfs_offset)(*budget - FROGFS_RECORD_METADATA_SIZE) : 0U;
+
+        volume->scan_pos += FROGFS_RECORD_METADATA_SIZE;
+        if (FROGFS_RECORD_DATA(tmp) == FROGFS_RECORD_DATA_SIZE)
+        {
+            /* Skip the data */
+            volume->scan_pos += FROGFS_RECORD_POINTER(tmp);
+            volume->scan_data_end = volume->scan_pos;
+        }
+    }
+
+    if (retval != FROGFS_ERR_OK)
+    {
+        volume->scan_pos = 0U;
+    }
+    else if ((volume->scan_pos >= disk_size) || (volume->scan_pos < FROGFS_DATA_OFFSET))
+    {
+        /* Complete */
+        volume->scan_pos = 0U;
+        volume->free_map_valid = true;
+        retval = frogfs_high_water_trim(volume);
+        volume->free_map_fresh = true;
+    }
+    else
+    {
+        /* To be continued */
+    }
+
+    return retval;
+}
+
+/**
+ * Find contiguous free space and remove it from the free-extent map, as it is
+ * going to be used by the caller for writing. The data size is limited to
+ * FROGFS_MAX_BLOCK_SIZE: a longer write continues in a new fragment.
+ * @param size_hint     expected data size (best fit), 0 if not known (first fit)
+ * @param whole         true if the space shall take size_hint bytes of data, otherwise
+ *                      FROGFS_ERR_NOSPACE is returned and nothing is allocated
+ */
+static t_e_frogfs_error frogfs_allocate_space(t_s_frogfs_volume *volume, t_frogfs_offset size_hint, bool whole, t_frogfs_offset *space_start, t_frogfs_offset *data_start, t_frogfs_offset *data_size)
+{
+    t_e_frogfs_error retval;
+
+    retval = frogfs_find_contiguous_space_unlocked(volume, size_hint, space_start, data_start, data_size);
+
+    if ((retval == FROGFS_ERR_OK) && (whole == true) && (*data_size < size_hint))
+    {
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        /* The rest of a hole larger than a block stays free for the other records */
+        if (*data_size > (t_frogfs_offset)FROGFS_MAX_BLOCK_SIZE)
+        {
+            *data_size = (t_frogfs_offset)FROGFS_MAX_BLOCK_SIZE;
+        }
+        frogfs_free_map_remove(volume, *space_start, (t_frogfs_offset)(*data_size + FROGFS_MIN_CONTIGUOUS_SPACE));
+#ifdef FROGFS_USE_NEXT_FIT
+        volume->alloc_cursor = *space_start;
+#endif
+
+        /* The new (empty) block is followed by zeroed bytes */
+        retval = frogfs_high_water_raise(volume, (t_frogfs_offset)(*data_start + FROGFS_APPEND_RESERVED_SPACE));
+    }
+
+    return retval;
+}
+
+#ifdef FROGFS_USE_COMPACTION
+/**
+ * Decode an offset stored LSB first in a journal slot.
+ */
+static t_frogfs_offset frogfs_journal_value(const uint8_t *tmp)
+{
+    t_frogfs_offset value = 0U;
+    uint8_t i;
+
+    for (i = 0; i < FROGFS_RECORD_POINTER_SIZE; i++)
+    {
+        value |= (t_frogfs_offset)((t_frogfs_offset)tmp[i] << (8U * i));
+    }
+
+    return value;
+}
+
+/**
+ * Store a new state of the compaction journal, in the slot not holding the current one.
+ * The state is on the storage when the function returns.
+ */
+static t_e_frogfs_error frogfs_journal_store(t_s_frogfs_volume *volume, uint8_t phase, t_frogfs_offset start, t_frogfs_offset length, t_frogfs_offset next)
+{
+    t_e_frogfs_error retval;
+    uint8_t tmp[FROGFS_JOURNAL_SLOT_SIZE];
+    uint8_t slot = (uint8_t)(1U - volume->journal_slot);
+    uint8_t crc = 0U;
+    uint8_t i;
+
+    tmp[0] = (uint8_t)(volume->journal_sequence + 1U);
+    tmp[1] = phase;
+    for (i = 0; i < FROGFS_RECORD_POINTER_SIZE; i++)
+    {
+        tmp[2U + i] = (uint8_t)(start >> (8U * i));
+        tmp[2U + FROGFS_RECORD_POINTER_SIZE + i] = (uint8_t)(length >> (8U * i));
+        tmp[2U + (2U * FROGFS_RECORD_POINTER_SIZE) + i] = (uint8_t)(next >> (8U * i));
+    }
+    for (i = 0; i < (FROGFS_JOURNAL_SLOT_SIZE - 1U); i++)
+    {
+        crc = frogfs_crc8(crc, tmp[i]);
+    }
+    tmp[FROGFS_JOURNAL_SLOT_SIZE - 1U] = crc;
+
+    /* The data written before shall reach the storage before the new state, the new
+     * state before the data written after */
+    retval = storage_cache_flush(&volume->storage);
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        retval = storage_cache_write_at(&volume->storage, (t_frogfs_offset)(FROGFS_JOURNAL_OFFSET + (slot * FROGFS_JOURNAL_SLOT_SIZE)),
+                                        tmp, FROGFS_JOURNAL_SLOT_SIZE);
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        retval = storage_cache_flush(&volume->storage);
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        volume->journal_sequence = tmp[0];
+        volume->journal_slot = slot;
+    }
+
+    return retval;
+}
+
+/**
+ * Decode a data block of a record on the storage.
+ * @param size      out: the size of the data of the block
+ * @param next      out: the block the fragment pointer after the data leads to, 0 if none
+ */
+static t_e_frogfs_error frogfs_journal_block(t_s_frogfs_volume *volume, t_frogfs_offset pos, t_frogfs_offset *size, t_frogfs_offset *next)
+{
+    t_e_frogfs_error retval;
+    uint8_t header[FROGFS_RECORD_METADATA_SIZE];
+    uint8_t tmp[FROGFS_RECORD_METADATA_SIZE];
+    t_frogfs_offset data_end;
+
+    *next = 0U;
+
+    retval = storage_cache_read_at(&volume->storage, pos, header, FROGFS_RECORD_METADATA_SIZE);
+    if ((retval == FROGFS_ERR_OK) && (FROGFS_RECORD_DATA(header) != FROGFS_RECORD_DATA_SIZE))
+    {
+        retval = FROGFS_ERR_OUT_OF_RANGE;
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        *size = FROGFS_RECORD_POINTER(header);
+        data_end = (t_frogfs_offset)(pos + FROGFS_RECORD_METADATA_SIZE + *size);
+
+        if (((uint32_t)data_end + FROGFS_RECORD_METADATA_SIZE) <= storage_cache_size(&volume->storage))
+        {
+            retval = storage_cache_read_at(&volume->storage, data_end, tmp, FROGFS_RECORD_METADATA_SIZE);
+
+            if ((retval == FROGFS_ERR_OK) &&
+                (FROGFS_RECORD_INDEX(tmp) == FROGFS_RECORD_INDEX(header)) &&
+                (FROGFS_RECORD_TYPE(tmp) == FROGFS_RECORD_TYPE_FRAGMENT) &&
+                (FROGFS_RECORD_DATA(tmp) == FROGFS_RECORD_DATA_POINTER))
+            {
+                *next = FROGFS_RECORD_POINTER(tmp);
+                if ((*next < FROGFS_DATA_OFFSET) || (*next >= storage_cache_size(&volume->storage)))
+                {
+                    retval = FROGFS_ERR_OUT_OF_RANGE;
+                }
+            }
+        }
+    }
+
+    return retval;
+}
+
+/**
+ * Erase the old blocks of a moved record: the block at start, of length bytes, then the
+ * blocks chained from next. The journal is updated before every block is erased, so that
+ * the erasure can be completed after a power cut.
+ */
+static t_e_frogfs_error frogfs_journal_erase_chain(t_s_frogfs_volume *volume, t_frogfs_offset start, t_frogfs_offset length, t_frogfs_offset next)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    t_frogfs_offset size = 0U;
+    t_frogfs_offset blocks = 0U;
+
+    while (retval == FROGFS_ERR_OK)
+    {
+        /* Idempotent: the block may have been (partially) erased before a power cut */
+        retval = frogfs_erase_range_unlocked(volume, start, length);
+
+        if ((retval == FROGFS_ERR_OK) && (next == 0U))
+        {
+            /* Last block of the record: its room for appending is free again */
+            retval = frogfs_free_map_release_append_space(volume, (t_frogfs_offset)(start + length));
+            break;
+        }
+
+        if ((retval == FROGFS_ERR_OK) && (++blocks > (storage_cache_size(&volume->storage) / FROGFS_RECORD_METADATA_SIZE)))
+        {
+            /* The chain loops */
+            retval = FROGFS_ERR_OUT_OF_RANGE;
+        }
+
+        if (retval == FROGFS_ERR_OK)
+        {
+            start = next;
+            retval = frogfs_journal_block(volume, start, &size, &next);
+        }
+
+        if (retval == FROGFS_ERR_OK)
+        {
+            length = (t_frogfs_offset)(FROGFS_RECORD_METADATA_SIZE + size + ((next != 0U) ? FROGFS_RECORD_METADATA_SIZE : 0U));
+            retval = frogfs_journal_store(volume, FROGFS_JOURNAL_ERASE, start, length, next);
+        }
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        retval = frogfs_journal_store(volume, FROGFS_JOURNAL_IDLE, 0U, 0U, 0U);
+    }
+
+    return retval;
+}
+
+/**
+ * Load the compaction journal and complete (or roll back) the record move that was
+ * in progress when the power was cut. Called at mount time, before the allocation table
+ * is built.
+ */
+static t_e_frogfs_error frogfs_journal_recover(t_s_frogfs_volume *volume)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    uint8_t tmp[2U][FROGFS_JOURNAL_SLOT_SIZE];
+    bool valid[2U];
+    uint8_t crc;
+    uint8_t slot;
+    uint8_t i;
+    t_frogfs_offset value[3U];
+
+    for (slot = 0U; (slot < 2U) && (retval == FROGFS_ERR_OK); slot++)
+    {
+        retval = storage_cache_read_at(&volume->storage, (t_frogfs_offset)(FROGFS_JOURNAL_OFFSET + (slot * FROGFS_JOURNAL_SLOT_SIZE)),
+                                       tmp[slot], FROGFS_JOURNAL_SLOT_SIZE);
+        crc = 0U;
+        for (i = 0; i < (FROGFS_JOURNAL_SLOT_SIZE - 1U); i++)
+        {
+            crc = frogfs_crc8(crc, tmp[slot][i]);
+        }
+        valid[slot] = ((crc == tmp[slot][FROGFS_JOURNAL_SLOT_SIZE - 1U]) && (tmp[slot][1] <= FROGFS_JOURNAL_ERASE)) ? true : false;
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        /* The latest valid state (sequence numbers wrap around) */
+        if ((valid[0] == true) && (valid[1] == true))
+        {
+            slot = ((uint8_t)(tmp[1][0] - tmp[0][0]) < 0x80U) ? 1U : 0U;
+        }
+        else if ((valid[0] == true) || (valid[1] == true))
+        {
+            slot = (valid[1] == true) ? 1U : 0U;
+        }
+        else
+        {
+            FROGFS_DEBUG_VERBOSE("assertion failed. Both journal slots are corrupted.");
+            retval = FROGFS_ERR_OUT_OF_RANGE;
+        }
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        volume->journal_sequence = tmp[slot][0];
+        volume->journal_slot = slot;
+
+        for (i = 0; i < 3U; i++)
+        {
+            value[i] = frogfs_journal_value(&tmp[slot][2U + (i * FROGFS_RECORD_POINTER_SIZE)]);
+        }
+
+        if (tmp[slot][1] != FROGFS_JOURNAL_IDLE)
+        {
+            if (((uint32_t)value[0] + value[1]) > storage_cache_size(&volume->storage))
+            {
+                retval = FROGFS_ERR_OUT_OF_RANGE;
+            }
+            else if (tmp[slot][1] == FROGFS_JOURNAL_COPY)
+            {
+                /* The copy is not complete: the old blocks are still the valid ones */
+                FROGFS_DEBUG_VERBOSE("rolling back the move to %d", value[0]);
+                retval = storage_cache_fill(&volume->storage, value[0], 0U, value[1]);
+
+                if (retval == FROGFS_ERR_OK)
+                {
+                    retval = frogfs_journal_store(volume, FROGFS_JOURNAL_IDLE, 0U, 0U, 0U);
+                }
+            }
+            else
+            {
+                /* The copy is complete: finish erasing the old blocks */
+                FROGFS_DEBUG_VERBOSE("completing the erasure of %d", value[0]);
+                retval = frogfs_journal_erase_chain(volume, value[0], value[1], value[2]);
+            }
+        }
+    }
+
+    return retval;
+}
+#endif
+
+/**
+ * Set up a volume on the given storage instance. The volume is not mounted:
+ * frogfs_init (or frogfs_format) shall be called before any other operation.
+ * @param volume    the volume to set up
+ * @param ops       the operations of the storage backend (e.g. file_storage_ops)
+ * @param context   the backend instance, NULL for the default instance of the backend
+ */
+void frogfs_volume_setup(t_s_frogfs_volume *volume, const t_s_storage_ops *ops, void *context)
+{
+#ifdef FROGFS_USE_LOCKING
+    t_frogfs_record i;
+#endif
+
+    (void)memset(volume, 0, sizeof(*volume));
+    storage_cache_init(&volume->storage, ops, context);
+
+#ifdef FROGFS_USE_LOCKING
+    (void)pthread_rwlock_init(&volume->lock, NULL);
+    for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
+    {
+        (void)pthread_mutex_init(&volume->record_lock[i], NULL);
+    }
+#endif
+}
+
+/**
+ * Release the resources of a volume set up with frogfs_volume_setup. The storage is
+ * not closed (see storage_cache_close).
+ */
+void frogfs_volume_release(t_s_frogfs_volume *volume)
+{
+#ifdef FROGFS_USE_LOCKING
+    t_frogfs_record i;
+
+    (void)pthread_rwlock_destroy(&volume->lock);
+    for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
+    {
+        (void)pthread_mutex_destroy(&volume->record_lock[i]);
+    }
+#endif
+    storage_cache_release(&volume->storage);
+}
+
+#warning "add in all methods a check that the requested offset is not outside physical size of the storage"
+#warning "Always allow multiple reads if no erase or write operation is ongoing. First version: one file at a time only ?"
+
+#warning "add a feature that if the disk has been formated, all operations are inhibit till storage_init is done again"
+static t_e_frogfs_error frogfs_format_unlocked(t_s_frogfs_volume *volume)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    uint8_t tmp[FROGFS_HEADER_SIZE];
+#ifdef FROGFS_USE_QUICK_FORMAT
+    uint8_t i;
+#endif
+
+    if ((uint32_t)storage_cache_size(&volume->storage) > (FROGFS_RECORD_POINTER_MAX + 1UL))
+    {
+        /* The metadata pointers cannot address the whole storage (see FROGFS_USE_LARGE_STORAGE) */
+        retval = FROGFS_ERR_OUT_OF_RANGE;
+    }
+    else
+    {
+#ifdef FROGFS_USE_QUICK_FORMAT
+        /* Quick format: the storage is only erased up to the high-water mark,
+         * the data area is zeroed later on, ahead of the writes */
+        volume->high_water = FROGFS_DATA_OFFSET;
+        retval = storage_cache_fill(&volume->storage, 0U, 0U, FROGFS_DATA_OFFSET);
+#else
+        /* Erase all the disk */
+        retval = storage_cache_fill(&volume->storage, 0U, 0U, storage_cache_size(&volume->storage));
+#endif
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        /* Prepare the signature and version */
+        tmp[0] = (uint8_t)((uint32_t)(FROGFS_SIGNATURE      ) & 0xFFUL);
+        tmp[1] = (uint8_t)((uint32_t)(FROGFS_SIGNATURE >> 8 ) & 0xFFUL);
+        tmp[2] = (uint8_t)((uint32_t)(FROGFS_SIGNATURE >> 16) & 0xFFUL);
+        tmp[3] = (uint8_t)((uint32_t)(FROGFS_SIGNATURE >> 24) & 0xFFUL);
+        tmp[4] = FROGFS_VERSION | FROGFS_VERSION_FLAGS;
+#ifdef FROGFS_USE_QUICK_FORMAT
+        for (i = 0; i < FROGFS_RECORD_POINTER_SIZE; i++)
+        {
+            tmp[FROGFS_HEADER_MARK_OFFSET + i] = (uint8_t)(volume->high_water >> (8U * i));
+        }
+#endif
+
+        /* Write the header at the beginning of the storage */
+        retval = storage_cache_write_at(&volume->storage, 0U, tmp, FROGFS_HEADER_SIZE);
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        /* All the storage after the header is free */
+        frogfs_free_map_reset(volume);
+        frogfs_free_map_add(volume, FROGFS_DATA_OFFSET, (t_frogfs_offset)(storage_cache_size(&volume->storage) - FROGFS_DATA_OFFSET));
+#ifdef FROGFS_USE_EXTENT_CACHE
+        frogfs_extent_cache_reset(volume, FROGFS_MAX_RECORD_COUNT);
+#endif
+#ifdef FROGFS_USE_COMPACTION
+        /* Both journal slots are zeroed: a valid idle state */
+        volume->journal_sequence = 0U;
+        volume->journal_slot = 0U;
+#endif
+#ifdef FROGFS_USE_NEXT_FIT
+        volume->alloc_cursor = 0U;
+#endif
+    }
+
+#ifdef FROGFS_USE_CHECKPOINT
+    if (retval == FROGFS_ERR_OK)
+    {
+        /* The formatted storage has an empty allocation table: store it right away */
+        (void)memset(volume->records, 0, sizeof(volume->records));
+        volume->checkpoint_generation = 0U;
+        volume->checkpoint_valid = false;
+        retval = frogfs_checkpoint_unlocked(volume);
+    }
+#endif
+
+    return retval;
+}
+
+static t_e_frogfs_error frogfs_init_unlocked(t_s_frogfs_volume *volume)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    uint8_t tmp[FROGFS_HEADER_SIZE];
+#ifdef FROGFS_USE_QUICK_FORMAT
+    uint8_t i;
+#endif
+    t_frogfs_offset pointer;
+    t_frogfs_offset pos_cur;
+    t_frogfs_offset hole_start;
+    t_frogfs_offset data_end = 0U;
+    t_frogfs_record slot;
+
+    /* Erase the in-RAM allocation table */
+    (void)memset(volume->records, 0, sizeof(volume->records));
+#ifdef FROGFS_USE_EXTENT_CACHE
+    frogfs_extent_cache_reset(volume, FROGFS_MAX_RECORD_COUNT);
+#endif
+    volume->free_map_valid = false;
+
+    /* Read the header at the beginning of the storage */
+    retval = storage_cache_read_at(&volume->storage, 0U, tmp, FROGFS_HEADER_SIZE);
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        if (((uint32_t)tmp[0] == (uint32_t)((FROGFS_SIGNATURE      ) & 0xFFUL)) &&
+            ((uint32_t)tmp[1] == (uint32_t)((FROGFS_SIGNATURE >> 8 ) & 0xFFUL)) &&
+            ((uint32_t)tmp[2] == (uint32_t)((FROGFS_SIGNATURE >> 16) & 0xFFUL)) &&
+            ((uint32_t)tmp[3] == (uint32_t)((FROGFS_SIGNATURE >> 24) & 0xFFUL)) &&
+            (tmp[4] == (FROGFS_VERSION | FROGFS_VERSION_FLAGS)))
+        {
+            /* Version and magic match, hence we have a formatted drive */
+            retval = FROGFS_ERR_OK;
+
+#ifdef FROGFS_USE_QUICK_FORMAT
+            volume->high_water = 0U;
+            for (i = 0; i < FROGFS_RECORD_POINTER_SIZE; i++)
+            {
+                volume->high_water |= (t_frogfs_offset)((t_frogfs_offset)tmp[FROGFS_HEADER_MARK_OFFSET + i] << (8U * i));
+            }
+            if ((volume->high_water < FROGFS_DATA_OFFSET) || (volume->high_water > storage_cache_size(&volume->storage)))
+            {
+                FROGFS_DEBUG_VERBOSE("assertion failed. High-water mark out of range. %d", volume->high_water);
+                return FROGFS_ERR_OUT_OF_RANGE;
+            }
+#endif
+
+#ifdef FROGFS_USE_COMPACTION
+            /* Complete the record move cut by a power loss, before the allocation table is read */
+            retval = frogfs_journal_recover(volume);
+            if (retval != FROGFS_ERR_OK)
+            {
+                return retval;
+            }
+#endif
+
+#ifdef FROGFS_USE_CHECKPOINT
+            /* Try the fast path first: load the allocation table from the checkpoint */
+            if (frogfs_checkpoint_load(volume) == FROGFS_ERR_OK)
+            {
+                FROGFS_DEBUG_VERBOSE("allocation table loaded from checkpoint %d", volume->checkpoint_generation);
+                return FROGFS_ERR_OK;
+            }
+
+            /* Stale or torn checkpoint: scan the storage */
+#endif
+
+            /* Read the file offset table and map the holes on the way */
+            frogfs_free_map_reset(volume);
+            pos_cur = FROGFS_DATA_OFFSET;
+            do
+            {
+                /* Skip the free space up to the next metadata block */
+                hole_start = pos_cur;
+                retval = frogfs_skip_free_space(volume, &pos_cur, storage_cache_size(&volume->storage));
+                frogfs_free_map_add_scanned(volume, hole_start, pos_cur, data_end);
+
+                if ((retval != FROGFS_ERR_OK) || (((uint32_t)pos_cur + FROGFS_RECORD_METADATA_SIZE) > storage_cache_size(&volume->storage)))
+                {
+                    FROGFS_DEBUG_VERBOSE("end of storage reached,");
+                    break;
+                }
+
+                retval = storage_cache_read_at(&volume->storage, pos_cur, tmp, FROGFS_RECORD_METADATA_SIZE);
+
+                if (retval == FROGFS_ERR_OK)
+                {
+                    slot = frogfs_record_slot(volume, FROGFS_RECORD_INDEX(tmp));
+
+                    if (slot >= FROGFS_MAX_RECORD_COUNT)
+                    {
+                        FROGFS_DEBUG_VERBOSE("assertion failed. Record index out of range or allocation table full. %d", FROGFS_RECORD_INDEX(tmp));
+                        retval = FROGFS_ERR_OUT_OF_RANGE;
+                        break;
+                    }
+                    frogfs_record_claim(volume, slot, FROGFS_RECORD_INDEX(tmp));
+
+                    /* Extract the pointer value */
+                    pointer = FROGFS_RECORD_POINTER(tmp);
+
+                    /* determine record type */
+                    if ((FROGFS_RECORD_TYPE(tmp) == FROGFS_RECORD_TYPE_NORMAL) &&
+                        (FROGFS_RECORD_DATA(tmp) == FROGFS_RECORD_DATA_SIZE) )
+                    {
+                        /* it is a Normal - Size record: indicates the start of a record */
+
+                        /* record size of next bytes. Check if first occurrence.
+                         * If it is, then save this as file-start offset. */
+                        if (volume->records[slot].offset == 0)
+                        {
+                            /* First time that record index has been encountered */
+                            volume->records[slot].offset = pos_cur;     /* record offset is including the record block */
+                        }
+                        else
+                        {
+                            /* already saved, skip and go on */
+                            FROGFS_DEBUG_VERBOSE("assertion failed. Cannot find two normal-size blocks for a record");
+                            retval = FROGFS_ERR_OUT_OF_RANGE;
+                            break;
+                        }
+
+                        volume->records[slot].size += pointer;
+                        volume->records[slot].fragments++;
+
+                        pos_cur += FROGFS_RECORD_METADATA_SIZE + pointer;
+                        data_end = pos_cur;
+                    }
+                    else if ((FROGFS_RECORD_TYPE(tmp) == FROGFS_RECORD_TYPE_FRAGMENT) &&
+                             (FROGFS_RECORD_DATA(tmp) == FROGFS_RECORD_DATA_POINTER) )
+                    {
+                        /* It is a fragment-pointer */
+
+                        /* just skip the record metadata, next will be something else */
+
+                        if ((pointer >= storage_cache_size(&volume->storage)) || (pointer < FROGFS_DATA_OFFSET))
+                        {
+                            FROGFS_DEBUG_VERBOSE("assertion failed. Pointer out of range. %d", pointer);
+                            retval = FROGFS_ERR_OUT_OF_RANGE;
+                            break;
+                        }
+
+                        pos_cur += FROGFS_RECORD_METADATA_SIZE;
+                    }
+                    else if ((FROGFS_RECORD_TYPE(tmp) == FROGFS_RECORD_TYPE_FRAGMENT) &&
+                             (FROGFS_RECORD_DATA(tmp) == FROGFS_RECORD_DATA_SIZE) )
+                    {
+                        /* It is a fragment-size */
+                        volume->records[slot].size += pointer;
+                        volume->records[slot].fragments++;
+
+                        pos_cur += FROGFS_RECORD_METADATA_SIZE + pointer;
+                        data_end = pos_cur;
+                    }
+                    else
+                    {
+                        /* record not supported. */
+                        FROGFS_ASSERT_UNCHECKED("assertion failed. Invalid record found.\r\n");
+                    }
+                }
+            } while ((retval == FROGFS_ERR_OK) && (pos_cur < storage_cache_size(&volume->storage)) && (pos_cur >= FROGFS_DATA_OFFSET));    // TILL EOF
+
+            if (retval == FROGFS_ERR_OK)
+            {
+                /* The mark may be left high by records erased or written when the power was cut */
+                retval = frogfs_high_water_trim(volume);
+            }
+
+            if (retval != FROGFS_ERR_OK)
+            {
+                volume->free_map_valid = false;
+            }
+
+#ifdef FROGFS_USE_CHECKPOINT
+            if (retval == FROGFS_ERR_OK)
+            {
+                /* Refresh the checkpoint so that the next boot can skip the scan */
+                retval = frogfs_checkpoint_unlocked(volume);
+            }
+#endif
+        }
+        else
+        {
+            /* The drive is not formatted */
+            retval = FROGFS_ERR_NOT_FORMATTED;
+        }
+    }
+
+    return retval;
+}
+
+/**
+ * Best fit in the free-extent map: the smallest hole that takes size bytes of data in a
+ * single block, so that the large holes are kept for the large records. If there is
+ * none, the largest hole: the data continues in as few fragments as possible.
+ *
+ * @return  the index of the hole, free_map_count if there is no usable hole
+ */
+static uint8_t frogfs_free_map_best_fit(const t_s_frogfs_volume *volume, t_frogfs_offset size)
+{
+    uint8_t i;
+    uint8_t best = volume->free_map_count;
+    uint8_t largest = volume->free_map_count;
+
+    for (i = 0; i < volume->free_map_count; i++)
+    {
+        if (volume->free_map[i].size < FROGFS_MIN_CONTIGUOUS_SPACE)
+        {
+            continue;
+        }
+
+        if (((uint32_t)volume->free_map[i].size >= ((uint32_t)size + FROGFS_MIN_CONTIGUOUS_SPACE)) &&
+            ((best >= volume->free_map_count) || (volume->free_map[i].size < volume->free_map[best].size)))
+        {
+            best = i;
+        }
+
+        if ((largest >= volume->free_map_count) || (volume->free_map[i].size > volume->free_map[largest].size))
+        {
+            largest = i;
+        }
+    }
+
+    return (best < volume->free_map_count) ? best : largest;
+}
+
+#ifdef FROGFS_USE_NEXT_FIT
+/**
+ * Next fit in the free-extent map: the first hole after the last allocated block, else
+ * (wrapping around) the first hole of the storage. The holes left behind are reused only
+ * once the end of the storage is reached, spreading the writes over the whole storage.
+ *
+ * @return  the index of the hole, free_map_count if there is no usable hole
+ */
+static uint8_t frogfs_free_map_next_fit(const t_s_frogfs_volume *volume)
+{
+    uint8_t i;
+    uint8_t first = volume->free_map_count;
+
+    for (i = 0; i < volume->free_map_count; i++)
+    {
+        if (volume->free_map[i].size >= FROGFS_MIN_CONTIGUOUS_SPACE)
+        {
+            if (volume->free_map[i].start >= volume->alloc_cursor)
+            {
+                break;
+            }
+
+            if (first >= volume->free_map_count)
+            {
+                first = i;
+            }
+        }
+    }
+
+    return (i < volume->free_map_count) ? i : first;
+}
+#endif
+
+/**
+ * Find the contiguous space which has the following space requirements:
+ * - at least 3 bytes plus 1 bytes data plus 3 bytes for an additional fragment pointer record.
+ * - everything is zeroed i.e. it is free space.
+ * The lookup is done in the in-RAM free-extent map: first fit (next fit with
+ * FROGFS_USE_NEXT_FIT), or best fit when the data size is known in advance
+ * (see frogfs_free_map_best_fit). The storage is only
+ * scanned if the map has not been built yet or if it has overflowed and cannot tell
+ * for sure that there is no (large enough) space left.
+ *
+ * @param size_hint     expected data size, 0 if not known
+ */
+static t_e_frogfs_error frogfs_find_contiguous_space_unlocked(t_s_frogfs_volume *volume, t_frogfs_offset size_hint, t_frogfs_offset *space_start, t_frogfs_offset *data_start, t_frogfs_offset *data_size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    uint8_t i = 0U;
+    bool rescan = false;
+
+    if (volume->free_map_valid == false)
+    {
+        retval = frogfs_free_map_build(volume);
+    }
+
+    while (retval == FROGFS_ERR_OK)
+    {
+        if (size_hint > 0U)
+        {
+            i = frogfs_free_map_best_fit(volume, size_hint);
+        }
+        else
+        {
+#ifdef FROGFS_USE_NEXT_FIT
+            i = frogfs_free_map_next_fit(volume);
+#else
+            /* First fit */
+            for (i = 0; i < volume->free_map_count; i++)
+            {
+                if (volume->free_map[i].size >= FROGFS_MIN_CONTIGUOUS_SPACE)
+                {
+                    break;
+                }
+            }
+#endif
+        }
+
+        if ((volume->free_map_lossy == true) && (rescan == false) && (size_hint > 0U) && (i < volume->free_map_count) &&
+            ((uint32_t)volume->free_map[i].size < ((uint32_t)size_hint + FROGFS_MIN_CONTIGUOUS_SPACE)))
+        {
+            /* A hole that takes the whole data may have been dropped from the map: refresh it */
+            rescan = true;
+            retval = frogfs_free_map_build(volume);
+        }
+        else if (i < volume->free_map_count)
+        {
+            *space_start = volume->free_map[i].start;
+            /* The data write offset shall not count the record */
+            *data_start = *space_start + FROGFS_RECORD_METADATA_SIZE;
+            /* Determine the size of the data */
+            *data_size = volume->free_map[i].size - FROGFS_MIN_CONTIGUOUS_SPACE;
+
+            FROGFS_DEBUG_VERBOSE("space found at 0x%04x", *space_start);
+            FROGFS_DEBUG_VERBOSE("write offset set at 0x%04x", *data_start);
+            FROGFS_DEBUG_VERBOSE("of size 0x%04x", *data_size);
+            break;
+        }
+        else if ((volume->free_map_lossy == true) && (rescan == false))
+        {
+            /* Some holes have been dropped from the map: refresh it */
+            rescan = true;
+            retval = frogfs_free_map_build(volume);
+        }
+        else
+        {
+            retval = FROGFS_ERR_NOSPACE;
+        }
+    }
+
+    return retval;
+}
+
+static t_e_frogfs_error frogfs_list_unlocked(t_s_frogfs_volume *volume, t_frogfs_record *list, t_frogfs_record list_size, t_frogfs_record *file_num)
+{
+    t_frogfs_record i = 0;
+    t_frogfs_record list_i = 0;
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+
+    if ((list == NULL) || (file_num == NULL))
+    {
+        retval = FROGFS_ERR_NULL_POINTER;
+    }
+    else
+    {
+        *file_num = 0;
+
+        for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
+        {
+            if (volume->records[i].offset != 0)
+            {
+                if (list_i < list_size)
+                {
+                    list[list_i] = FROGFS_RECORD_ID(volume, i);
+                    (*file_num)++;
+                }
+                list_i++;
+            }
+        }
+    }
+
+
+    return retval;
+}
+
+static t_e_frogfs_error frogfs_get_available_unlocked(t_s_frogfs_volume *volume, t_frogfs_record *record)
+{
+    t_frogfs_record i = 0;
+    t_frogfs_record slot;
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+
+    if (record == NULL)
+    {
+        retval = FROGFS_ERR_NULL_POINTER;
+    }
+    else
+    {
+        retval = FROGFS_ERR_OUT_OF_RANGE;
+        *record = FROGFS_RECORD_NONE;
+
+        for (i = 0; i < FROGFS_RECORD_ID_LIMIT; i++)
+        {
+            slot = frogfs_record_slot(volume, i);
+            if (slot >= FROGFS_MAX_RECORD_COUNT)
+            {
+                /* The allocation table is full */
+                break;
+            }
+
+            if (volume->records[slot].offset == 0)
+            {
+                retval = FROGFS_ERR_OK;
+                *record = i;
+                break;
+            }
+        }
+    }
+
+    return retval;
+}
+
+static t_e_frogfs_error frogfs_open_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    return frogfs_open_sized_unlocked(volume, record, 0U, false);
+}
+
+/**
+ * Open a record, as frogfs_open. A record that does not exist yet is created in the
+ * smallest hole that takes expected_size bytes of data (or in the largest hole), instead
+ * of the first one, so that it is written in as few fragments as possible.
+ * @param expected_size     expected size of the record data, 0 if not known (first fit)
+ * @param whole             true if a new record shall get expected_size bytes in its first
+ *                          block, otherwise FROGFS_ERR_NOSPACE is returned (see frogfs_reserve)
+ */
+static t_e_frogfs_error frogfs_open_sized_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset expected_size, bool whole)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    uint8_t tmp[FROGFS_RECORD_METADATA_SIZE];
+    t_frogfs_record slot;
+
+#ifdef FROGFS_FORCE_INIT_AT_EVERY_OPEN
+    FROGFS_DEBUG_VERBOSE("Unit Testing Enabled. You shall not see that normally.");
+    retval = frogfs_init_unlocked(volume);
+    FROGFS_ASSERT_VERBOSE(retval, FROGFS_ERR_OK, "not ok that init does not work.");
+#endif
+
+    FROGFS_DEBUG_VERBOSE("%s: record %d", __FUNCTION__, record);
+
+    /* Check if the file exists or not */
+    slot = frogfs_record_slot(volume, record);
+    if (slot < FROGFS_MAX_RECORD_COUNT)
+    {
+        if (volume->records[slot].offset > 0)
+        {
+            /* File exists. Can read. */
+            retval = FROGFS_ERR_OK;
+            volume->records[slot].work_reg_1 = 0;       /* reset the block start pos */
+            volume->records[slot].work_reg_2 = 0;       /* reset the read pos */
+            volume->records[slot].write_offset = 0;
+        }
+        else
+        {
+            /* File does not exists. Create record */
+#ifdef FROGFS_USE_CHECKPOINT
+            /* The allocation table is about to change */
+            retval = frogfs_checkpoint_invalidate(volume);
+            if (retval != FROGFS_ERR_OK)
+            {
+                return retval;
+            }
+#endif
+            frogfs_record_claim(volume, slot, record);
+            retval = frogfs_allocate_space(volume, expected_size, whole, &volume->records[slot].offset, &volume->records[slot].write_offset, &volume->records[slot].work_reg_1);
+
+            if (retval == FROGFS_ERR_OK)
+            {
+                /* Create the actual record: Normal - Size */
+                frogfs_metadata_encode(tmp, record, FROGFS_RECORD_TYPE_NORMAL, FROGFS_RECORD_DATA_SIZE, 0U);
+
+                /* Write */
+                retval = storage_cache_write_at(&volume->storage, volume->records[slot].offset, tmp, FROGFS_RECORD_METADATA_SIZE);
+                volume->records[slot].header_size = 0U;
+                volume->records[slot].size = 0U;
+                volume->records[slot].fragments = 1U;
+#ifdef FROGFS_USE_EXTENT_CACHE
+                frogfs_extent_cache_reset(volume, slot);
+#endif
+            }
+            else
+            {
+                /* No Space (more likely happening) or IO error: the record does not exist */
+                volume->records[slot].offset = 0U;
+                volume->records[slot].write_offset = 0U;
+                volume->records[slot].work_reg_1 = 0U;
+                frogfs_record_release(volume, slot);
+                FROGFS_DEBUG_VERBOSE("could not allocate spaced.");
+                printf_frogfserror(retval);
+            }
+        }
+    }
+    else
+    {
+        FROGFS_DEBUG_VERBOSE("too large record %d or allocation table full", record);
+        retval = FROGFS_ERR_INVALID_RECORD;
+    }
+
+    return retval;
+}
+
+/**
+ * Create a record and open it for writing in a single block that takes size bytes of
+ * data (best fit): the frogfs_write calls up to that size do not look for free space
+ * and do not chain fragments. The space is kept for the record as long as it is open
+ * for writing; frogfs_close gives back what has not been written.
+ * @param size  the data size to reserve, up to FROGFS_MAX_BLOCK_SIZE
+ * @return FROGFS_ERR_INVALID_OPERATION if the record exists already,
+ *         FROGFS_ERR_NOSPACE if no hole takes size bytes in a single block
+ */
+static t_e_frogfs_error frogfs_reserve_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset size)
+{
+    t_e_frogfs_error retval;
+    t_frogfs_record slot;
+
+    if (size > (t_frogfs_offset)FROGFS_MAX_BLOCK_SIZE)
+    {
+        return FROGFS_ERR_OUT_OF_RANGE;
+    }
+
+    slot = frogfs_record_slot(volume, record);
+    if ((slot < FROGFS_MAX_RECORD_COUNT) && (volume->records[slot].offset > 0U))
+    {
+        FROGFS_DEBUG_VERBOSE("record %d exists already", record);
+        return FROGFS_ERR_INVALID_OPERATION;
+    }
+
+    retval = frogfs_open_sized_unlocked(volume, record, size, true);
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        /* The whole block is formatted now rather than along the writes (see FROGFS_USE_QUICK_FORMAT) */
+        slot = frogfs_record_slot(volume, record);
+        retval = frogfs_high_water_raise(volume, (t_frogfs_offset)(volume->records[slot].write_offset + size + FROGFS_APPEND_RESERVED_SPACE));
+    }
+
+    return retval;
+}
+
+/**
+ * Open a record for writing at its end. An existing record is not rewritten:
+ * its last block is located by following the fragment chain and the writing
+ * resumes there, first in the free space after it, then in new fragments.
+ * A record that does not exist yet is created (as frogfs_open does).
+ *
+ * @return FROGFS_ERR_NOSPACE if the record has been written without the room
+ *         for appending after its last block (i.e. by an older version)
+ */
+static t_e_frogfs_error frogfs_open_append_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    uint8_t tmp[FROGFS_APPEND_RESERVED_SPACE];
+    t_frogfs_offset block_pos;
+    t_frogfs_offset block_size = 0U;
+    t_frogfs_offset data_end = 0U;
+    t_frogfs_offset space;
+    t_frogfs_offset hops;
+    t_frogfs_offset total_size = 0U;
+    uint16_t blocks = 0U;
+    uint8_t i;
+    t_frogfs_record slot;
+    bool tail_found = false;
+
+#ifdef FROGFS_FORCE_INIT_AT_EVERY_OPEN
+    FROGFS_DEBUG_VERBOSE("Unit Testing Enabled. You shall not see that normally.");
+    retval = frogfs_init_unlocked(volume);
+    FROGFS_ASSERT_VERBOSE(retval, FROGFS_ERR_OK, "not ok that init does not work.");
+#endif
+
+    FROGFS_DEBUG_VERBOSE("%s: record %d", __FUNCTION__, record);
+
+    slot = frogfs_record_slot(volume, record);
+    if (slot >= FROGFS_MAX_RECORD_COUNT)
+    {
+        FROGFS_DEBUG_VERBOSE("too large record %d or allocation table full", record);
+        return FROGFS_ERR_INVALID_RECORD;
+    }
+
+    if (volume->records[slot].offset == 0U)
+    {
+        /* File does not exist: create it */
+        return frogfs_open_unlocked(volume, record);
+    }
+
+    if (volume->records[slot].write_offset > 0U)
+    {
+        /* Already open for writing: nothing to locate */
+        return FROGFS_ERR_OK;
+    }
+
+    /* Follow the fragment chain up to the last block. Every block takes at least
+     * FROGFS_RECORD_METADATA_SIZE bytes: a longer chain is a loop. */
+    block_pos = volume->records[slot].offset;
+    retval = FROGFS_ERR_OK;
+    for (hops = 0U; (retval == FROGFS_ERR_OK) && (tail_found == false); hops++)
+    {
+        if (hops > (storage_cache_size(&volume->storage) / FROGFS_RECORD_METADATA_SIZE))
+        {
+            retval = FROGFS_ERR_OUT_OF_RANGE;
+            break;
+        }
+
+        /* Sized block: normal-size for the first one, fragment-size afterwards */
+        retval = storage_cache_read_at(&volume->storage, block_pos, tmp, FROGFS_RECORD_METADATA_SIZE);
+        if ((retval == FROGFS_ERR_OK) &&
+            ((FROGFS_RECORD_INDEX(tmp) != record) || (FROGFS_RECORD_DATA(tmp) != FROGFS_RECORD_DATA_SIZE)))
+        {
+            retval = FROGFS_ERR_OUT_OF_RANGE;
+        }
+
+        if (retval == FROGFS_ERR_OK)
+        {
+            block_size = FROGFS_RECORD_POINTER(tmp);
+            data_end = (t_frogfs_offset)(block_pos + FROGFS_RECORD_METADATA_SIZE + block_size);
+            total_size += block_size;
+            blocks++;
+
+            if (((uint32_t)data_end + FROGFS_APPEND_RESERVED_SPACE) > storage_cache_size(&volume->storage))
+            {
+                /* No room after the block, not even for a pointer */
+                retval = FROGFS_ERR_NOSPACE;
+            }
+            else
+            {
+                retval = storage_cache_read_at(&volume->storage, data_end, tmp, FROGFS_APPEND_RESERVED_SPACE);
+            }
+        }
+
+        if (retval == FROGFS_ERR_OK)
+        {
+            if ((FROGFS_RECORD_INDEX(tmp) == record) &&
+                (FROGFS_RECORD_TYPE(tmp) == FROGFS_RECORD_TYPE_FRAGMENT) &&
+                (FROGFS_RECORD_DATA(tmp) == FROGFS_RECORD_DATA_POINTER))
+            {
+                /* Fragment pointer: jump to the next block */
+                block_pos = FROGFS_RECORD_POINTER(tmp);
+            }
+            else
+            {
+                for (i = 0U; (i < FROGFS_APPEND_RESERVED_SPACE) && (tmp[i] == 0U); i++)
+                {
+                    /* Look for the room kept for appending */
+                }
+
+                if (i == FROGFS_APPEND_RESERVED_SPACE)
+                {
+                    /* Last block, followed by the room kept for appending */
+                    tail_found = true;
+                }
+                else
+                {
+                    /* Last block, but another block is right after it */
+                    retval = FROGFS_ERR_NOSPACE;
+                }
+            }
+        }
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        if (volume->free_map_valid == false)
+        {
+            retval = frogfs_free_map_build(volume);
+        }
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        /* The block grows over the free space after the room for appending (if mapped),
+         * the room itself stays at its end for the next fragment pointer */
+        space = frogfs_free_map_size_at(volume, (t_frogfs_offset)(data_end + FROGFS_APPEND_RESERVED_SPACE));
+        if (block_size >= (t_frogfs_offset)FROGFS_MAX_BLOCK_SIZE)
+        {
+            /* Full block: the writing continues in a new fragment right away */
+            space = 0U;
+        }
+        else if (space > (t_frogfs_offset)(FROGFS_MAX_BLOCK_SIZE - block_size))
+        {
+            space = (t_frogfs_offset)(FROGFS_MAX_BLOCK_SIZE - block_size);
+        }
+        frogfs_free_map_remove(volume, (t_frogfs_offset)(data_end + FROGFS_APPEND_RESERVED_SPACE), space);
+
+        volume->records[slot].write_offset = (t_frogfs_offset)(block_pos + FROGFS_RECORD_METADATA_SIZE);
+        volume->records[slot].work_reg_1   = (t_frogfs_offset)(block_size + space);
+        volume->records[slot].work_reg_2   = block_size;
+        volume->records[slot].header_size  = block_size;
+        volume->records[slot].size         = total_size;
+        volume->records[slot].fragments    = blocks;
+#ifdef FROGFS_USE_EXTENT_CACHE
+        /* The last block grows and further blocks may follow */
+        frogfs_extent_cache_reset(volume, slot);
+#endif
+    }
+
+    return retval;
+}
+
+// work_reg_1: available contiguous space
+// work_reg_2: written size so far
+// header_size: size stored in the header of the current block (see FROGFS_USE_DEFERRED_HEADER)
+
+static t_e_frogfs_error frogfs_write_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, const uint8_t *data, uint16_t size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    uint8_t tmp[FROGFS_RECORD_METADATA_SIZE];
+    t_frogfs_offset tmp_size = 0;
+    bool io_error = false;
+    bool exit_loop = false;
+    uint16_t written_bytes = 0;
+    bool update_block_record = false;
+    t_e_frogfs_error header_retval;
+    t_frogfs_offset space_start;
+    t_frogfs_offset data_start;
+    t_frogfs_offset data_size;
+
+    FROGFS_DEBUG_VERBOSE("%s: record %d size %d", __FUNCTION__, (uint16_t)record, (uint16_t)size);
+
+    /* Check if the file exists or not */
+    if ((record < FROGFS_MAX_RECORD_COUNT) && FROGFS_CALL_SIZE_VALID(size))
+    {
+        if (volume->records[record].write_offset == 0)
+        {
+            /* Not open for writing */
+            retval = FROGFS_ERR_NOT_WRITABLE;
+        }
+        else
+        {
+            do
+            {
+                /* Check what has to be done */
+                if (written_bytes >= size)
+                {
+                    /* Last chunk of data has been written */
+                    exit_loop = true;
+#ifndef FROGFS_USE_DEFERRED_HEADER
+                    /* update the block record's size */
+                    update_block_record = true;
+#endif
+                    /* No error yet */
+                    retval = FROGFS_ERR_OK;
+                }
+                else if (volume->records[record].work_reg_2 < volume->records[record].work_reg_1)
+                {
+                    /* The contiguous space is still available: continue writing */
+
+                    /* determine how many bytes can we write in the contiguous space */
+                    tmp_size = volume->records[record].work_reg_1 - volume->records[record].work_reg_2;
+                    if ((t_frogfs_offset)(size - written_bytes) < tmp_size)
+                    {
+                        tmp_size = (t_frogfs_offset)(size - written_bytes);
+                    }
+
+                    if (tmp_size > 0)
+                    {
+                        /* Fits the free space */
+                        FROGFS_DEBUG_VERBOSE("contiguous write");
+
+                        /* The header covers the data before it is written */
+                        retval = frogfs_extend_block_header(volume, record, (t_frogfs_offset)(volume->records[record].work_reg_2 + tmp_size));
+
+                        /* Write the portion of input data from written_bytes position of length tmp_size,
+                         * at the write pointer plus the written size pointer */
+                        if (retval == FROGFS_ERR_OK)
+                        {
+                            retval = storage_cache_write_at(&volume->storage, (t_frogfs_offset)(volume->records[record].write_offset + volume->records[record].work_reg_2),
+                                                            &data[written_bytes], (uint16_t)tmp_size);
+                        }
+
+                        if (retval != FROGFS_ERR_OK)
+                        {
+                            /* IO-Error occurred */
+                            io_error = true;
+                            /* update the block record which shall cover what has been written so far without error */
+                            exit_loop = true;
+                            update_block_record = true;
+                        }
+                        else
+                        {
+                            /* Update the block written size */
+                            volume->records[record].work_reg_2 += tmp_size;
+                            volume->records[record].size += tmp_size;
+                            /* Increment the overall bytes counter */
+                            written_bytes += (uint16_t)tmp_size;
+                        }
+                    }
+                    else
+                    {  /* Plausibility error condition */
+                        FROGFS_ASSERT_VERBOSE(0, 1, "shall never be zero here.");
+                    }
+
+                    if (volume->records[record].work_reg_2 >= volume->records[record].work_reg_1)
+                    {
+                        /* Update now the record, as the space has been filled */
+                        update_block_record = true;
+                    }
+
+                }
+                else if (volume->records[record].work_reg_2 >= volume->records[record].work_reg_1)
+                {
+                    /* The contiguous space has been filled completely: search new contiguous space */
+                    retval = frogfs_allocate_space(volume, 0U, false, &space_start, &data_start, &data_size);
+
+                    if (retval == FROGFS_ERR_OK)
+                    {
+                        /* Space found for stuffing the fragmented block */
+                        /* Create the actual record: Fragment - Pointer and store the start address of the fragment */
+                        frogfs_metadata_encode(tmp, FROGFS_RECORD_ID(volume, record), FROGFS_RECORD_TYPE_FRAGMENT,
+                                               FROGFS_RECORD_DATA_POINTER, space_start);
+
+                        /* Write */
+                        retval = storage_cache_write_at(&volume->storage, (t_frogfs_offset)(volume->records[record].work_reg_1 + volume->records[record].write_offset), tmp, FROGFS_RECORD_METADATA_SIZE);
+
+                        /* the spare byte after the fragment pointer is not used */
+                        frogfs_free_map_add(volume, (t_frogfs_offset)(volume->records[record].work_reg_1 + volume->records[record].write_offset + FROGFS_RECORD_METADATA_SIZE), 1U);
+
+                        /* set the new write pointer to the write_offset */
+                        volume->records[record].write_offset = data_start;        /* update the data write pointer */
+                        volume->records[record].work_reg_1 = data_size;           /* update the free space available to the write operation */
+                        volume->records[record].work_reg_2 = 0;                   /* reset the free space written bytes counter */
+                        volume->records[record].fragments++;
+
+                        /* Create the empty Fragment - Size block right away: the pointer shall never lead to free space */
+                        if (retval == FROGFS_ERR_OK)
+                        {
+                            volume->records[record].header_size = FROGFS_OFFSET_MAX;
+                            retval = frogfs_commit_block_header(volume, record);
+                        }
+
+                        if (retval != FROGFS_ERR_OK)
+                        {
+                            io_error = true;
+                        }
+                    }
+                    else
+                    {
+                        /* Out of space, sorry */
+                        retval = FROGFS_ERR_NOSPACE;
+                        io_error = true;
+                    }
+                }
+
+                /* Check if the block has to be updated now */
+                if (update_block_record == true)
+                {
+                    update_block_record = false;
+                    header_retval = frogfs_commit_block_header(volume, record);
+
+                    if ((header_retval != FROGFS_ERR_OK) && (io_error == false))
+                    {
+                        retval = header_retval;
+                        io_error = true;
+                    }
+                }
+
+            } while ((io_error == false) && (exit_loop == false));
+        }
+    }
+    else
+    {
+        FROGFS_DEBUG_VERBOSE("too large record %d or size %d", record, size);
+        retval = FROGFS_ERR_INVALID_RECORD;
+    }
+
+    return retval;
+}
+
+/**
+ * Commit the data written so far to the storage, leaving the record open for writing:
+ * the header of the block being written is updated and the cache is flushed.
+ */
+static t_e_frogfs_error frogfs_flush_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+
+    FROGFS_DEBUG_VERBOSE("%s: record %d", __FUNCTION__, record);
+
+    if (record < FROGFS_MAX_RECORD_COUNT)
+    {
+        if (volume->records[record].write_offset == 0U)
+        {
+            /* Not open for writing */
+            retval = FROGFS_ERR_NOT_WRITABLE;
+        }
+        else
+        {
+            retval = frogfs_commit_block_header(volume, record);
+
+            if (retval == FROGFS_ERR_OK)
+            {
+                retval = storage_cache_flush(&volume->storage);
+            }
+        }
+    }
+    else
+    {
+        FROGFS_DEBUG_VERBOSE("too large record %d", record);
+        retval = FROGFS_ERR_INVALID_RECORD;
+    }
+
+    return retval;
+}
+
+static t_e_frogfs_error frogfs_close_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+
+    FROGFS_DEBUG_VERBOSE("%s: record %d", __FUNCTION__, record);
+
+    /* Check if the file exists or not */
+    if (record < FROGFS_MAX_RECORD_COUNT)
+    {
+        if (volume->records[record].write_offset > 0U)
+        {
+            /* File was being written to. Close it and clean registers. */
+            retval = frogfs_commit_block_header(volume, record);
+
+            /* The space after the written data is free again, except the room kept for appending */
+            frogfs_free_map_add(volume, (t_frogfs_offset)(volume->records[record].write_offset + volume->records[record].work_reg_2 + FROGFS_APPEND_RESERVED_SPACE),
+                                (t_frogfs_offset)(volume->records[record].work_reg_1 - volume->records[record].work_reg_2));
+
+            volume->records[record].write_offset = 0;
+            volume->records[record].work_reg_1   = 0;
+            volume->records[record].work_reg_2   = 0;
+            volume->records[record].header_size  = 0;
+
+            /* Written data and header are committed to the storage */
+            if (retval == FROGFS_ERR_OK)
+            {
+                retval = storage_cache_flush(&volume->storage);
+            }
+        }
+        else if (volume->records[record].work_reg_1 > 0U)
+        {
+            volume->records[record].write_offset = 0;
+            volume->records[record].work_reg_1   = 0;
+            volume->records[record].work_reg_2   = 0;
+            retval = FROGFS_ERR_OK;
+        }
+        else if (volume->records[record].offset > 0U)
+        {
+            /* The file has only been opened but no operation has been performed. Just do nothing close. */
+            retval = FROGFS_ERR_OK;
+        }
+        else
+        {
+            /* Not open neither for read nor for write */
+            retval = FROGFS_ERR_INVALID_OPERATION;
+        }
+    }
+    else
+    {
+        FROGFS_DEBUG_VERBOSE("too large record %d", record);
+        retval = FROGFS_ERR_INVALID_RECORD;
+    }
+
+    return retval;
+}
+
+static t_e_frogfs_error frogfs_erase_range_unlocked(t_s_frogfs_volume *volume, t_frogfs_offset pos, t_frogfs_offset size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+
+    retval = storage_cache_fill(&volume->storage, pos, 0U, size);
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        frogfs_free_map_add(volume, pos, size);
+    }
+
+    return retval;
+}
+
+// work_reg_1: block start
+// work_reg_2: block size
+
+static t_e_frogfs_error frogfs_traverse_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, uint8_t *data, uint16_t size, uint16_t *effective_read, bool erase)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    uint8_t tmp[FROGFS_RECORD_METADATA_SIZE];
+    t_frogfs_offset tmp_read_size = 0;
+    t_frogfs_offset block_pos;
+    bool io_error = false;
+    bool exit_loop = false;
+    t_frogfs_record record_index;
+
+    *effective_read = 0;
+
+    FROGFS_DEBUG_VERBOSE("%s: record %d size %d", __FUNCTION__, (uint16_t)record, (uint16_t)size);
+
+    /* Check if the file exists or not */
+    if ((record < FROGFS_MAX_RECORD_COUNT) && FROGFS_CALL_SIZE_VALID(size))
+    {
+        if (volume->records[record].write_offset != 0)
+        {
+            /* Open for writing */
+            retval = FROGFS_ERR_NOT_READABLE;
+        }
+        else
+        {
+            /* Continue reading the required size until it is possible */
+            do
+            {
+#ifdef FROGFS_USE_EXTENT_CACHE
+                if ((volume->records[record].work_reg_1 > 0) && (volume->records[record].work_reg_2 == FROGFS_OFFSET_MAX) &&
+                    (frogfs_extent_cache_next(volume, record, erase, &exit_loop, &retval) == true))
+                {
+                    /* The next block has been located through the extent cache */
+                    if (retval != FROGFS_ERR_OK)
+                    {
+                        io_error = true;
+                    }
+                }
+                else
+#endif
+                if ((volume->records[record].work_reg_1 > 0) && (volume->records[record].work_reg_2 == FROGFS_OFFSET_MAX))
+                {
+                    /* The current block has been fully read:
+                     * - either it is the full record in a single block
+                     * - it is followed by fragments
+                     */
+                    block_pos = volume->records[record].work_reg_1;
+                    retval = storage_cache_read_at(&volume->storage, block_pos, tmp, FROGFS_RECORD_METADATA_SIZE);
+
+                    /* decode the record index */
+                    record_index = FROGFS_RECORD_INDEX(tmp);
+
+                    if (retval != FROGFS_ERR_OK)
+                    {
+                        io_error = true;
+                    }
+                    else if (FROGFS_RECORD_ID(volume, record) != record_index)
+                    {
+                        // TODO this message is also happening normally i.e. empty space after file. Please check that ...
+                        FROGFS_DEBUG_VERBOSE("Record block found but of different record index %d. Skip.", record_index);
+                        exit_loop = true;
+
+                        if (erase == true)
+                        {
+                            /* Last block of the record: its room for appending is free again */
+                            retval = frogfs_free_map_release_append_space(volume, block_pos);
+                        }
+                    }
+                    else
+                    {
+                        /* Check if it is a fragment */
+                        if (FROGFS_RECORD_TYPE(tmp) == FROGFS_RECORD_TYPE_FRAGMENT)
+                        {
+                            /* Fragment type */
+                            FROGFS_DEBUG_VERBOSE("Fragment found. File read continues.");
+                            /* Determine fragment type */
+                            if (FROGFS_RECORD_DATA(tmp) == FROGFS_RECORD_DATA_SIZE)
+                            {
+                                /* Sized fragment */
+                                FROGFS_DEBUG_VERBOSE("Sized fragment. Continue reading from %d", volume->records[record].work_reg_1);
+
+                                volume->records[record].work_reg_1 = block_pos + FROGFS_RECORD_METADATA_SIZE;                      /* save the data pointer */
+                                volume->records[record].work_reg_2 = FROGFS_RECORD_POINTER(tmp);  /* Index - MSB (remove the size type bit) - LSB */
+                                FROGFS_DEBUG_VERBOSE("fragmented record size %d starting at %d", volume->records[record].work_reg_2, volume->records[record].work_reg_1);
+                            }
+                            else
+                            {
+                                /* Pointer fragment */
+                                tmp_read_size = FROGFS_RECORD_POINTER(tmp);
+                                FROGFS_DEBUG_VERBOSE("Pointer fragment. Jump to %d", tmp_read_size);
+                                volume->records[record].work_reg_1 = tmp_read_size;   /* save the pointer also in the working register 1 */
+                                volume->records[record].work_reg_2 = FROGFS_OFFSET_MAX;      /* still no data to read, maybe in the next fragment */
+
+                                if (retval != FROGFS_ERR_OK)
+                                {
+                                    io_error = true;
+                                }
+                            }
+
+                            /* check if erasing */
+                            if (erase == true)
+                            {
+                                /* If so, then erase the record */
+                                retval = frogfs_erase_range_unlocked(volume, block_pos, FROGFS_RECORD_METADATA_SIZE);
+
+                                if (retval != FROGFS_ERR_OK)
+                                {
+                                    io_error = true;
+                                }
+                            }
+                        }
+                        else
+                        {
+                            /* Not a fragment. File read has been completed. */
+                            FROGFS_DEBUG_VERBOSE("not a fragment. File read done.");
+                            exit_loop = true;
+
+                            if (erase == true)
+                            {
+                                /* Last block of the record: its room for appending is free again */
+                                retval = frogfs_free_map_release_append_space(volume, block_pos);
+                            }
+                        }
+                    }
+                }
+                else if (volume->records[record].work_reg_1 > 0)
+                {
+                    /* The file is already being read, continue from the current read pointer */
+                    if (erase == true)
+                    {
+                        /* when erasing, always erase the entire record */
+                        tmp_read_size = volume->records[record].work_reg_2;
+
+                        /* erase the whole length */
+                        retval = frogfs_erase_range_unlocked(volume, volume->records[record].work_reg_1, volume->records[record].work_reg_2);
+                    }
+                    else
+                    {
+                        /* not erasing but reading */
+
+                        /* read the data: min between block size and remaining data */
+                        tmp_read_size = (t_frogfs_offset)(size - *effective_read);
+                        tmp_read_size = (tmp_read_size < volume->records[record].work_reg_2) ? tmp_read_size : volume->records[record].work_reg_2;
+
+                        /* read from disk */
+                        if (data != NULL)
+                        {
+                            retval = storage_cache_read_at(&volume->storage, volume->records[record].work_reg_1, &data[*effective_read], tmp_read_size);
+                        }
+                    }
+
+                    /* advance the effective read counter (erasing: the loop ends with the record) */
+                    if (erase == false)
+                    {
+                        *effective_read += (uint16_t)tmp_read_size;
+                    }
+
+                    if (retval != FROGFS_ERR_OK)
+                    {
+                        io_error = true;
+                    }
+                    else
+                    {
+                        /* update the read pointer */
+                        volume->records[record].work_reg_1 += tmp_read_size;
+                        /* update the read size */
+                        volume->records[record].work_reg_2 -= tmp_read_size;
+
+                        if (volume->records[record].work_reg_2 == 0)
+                        {
+                            FROGFS_DEBUG_VERBOSE("end of block. Setting read size to FROGFS_OFFSET_MAX");
+                            volume->records[record].work_reg_2 = FROGFS_OFFSET_MAX;
+                        }
+                    }
+                }
+                else
+                {
+                    /* First read operation. Read the size of the record from the normal record */
+#ifdef FROGFS_USE_EXTENT_CACHE
+                    /* Locate all the blocks at once (no error: without cache the metadata is read as usual) */
+                    (void)frogfs_extent_cache_fill(volume, record);
+                    volume->extent_cache[record].cursor = 0U;
+
+                    if (volume->extent_cache[record].count > 0U)
+                    {
+                        retval = FROGFS_ERR_OK;
+                        volume->records[record].work_reg_1 = volume->extent_cache[record].extents[0].start;
+                        volume->records[record].work_reg_2 = volume->extent_cache[record].extents[0].size;
+                    }
+                    else
+#endif
+                    {
+                        retval = storage_cache_read_at(&volume->storage, volume->records[record].offset, tmp, FROGFS_RECORD_METADATA_SIZE);
+
+                        if (retval == FROGFS_ERR_OK)
+                        {
+                            volume->records[record].work_reg_1 = volume->records[record].offset + FROGFS_RECORD_METADATA_SIZE;              /* save the data pointer */
+                            volume->records[record].work_reg_2 = FROGFS_RECORD_POINTER(tmp);   /* pick the block size from the metadata block */
+                            FROGFS_DEBUG_VERBOSE("record size %d", volume->records[record].work_reg_2);
+                        }
+                    }
+
+                    if (erase == true)
+                    {
+#ifdef FROGFS_USE_CHECKPOINT
+                        /* The allocation table is about to change */
+                        if (retval == FROGFS_ERR_OK)
+                        {
+                            retval = frogfs_checkpoint_invalidate(volume);
+                        }
+                        if (retval != FROGFS_ERR_OK)
+                        {
+                            return retval;
+                        }
+#endif
+                        /* Erase the record */
+                        retval = frogfs_erase_range_unlocked(volume, volume->records[record].offset, FROGFS_RECORD_METADATA_SIZE);
+                        /* fake the rsize, iterating until all the record has been traversed */
+                        size = 0xFFFFU;
+                    }
+                }
+            } while ((*effective_read < size) && (io_error == false) && (exit_loop == false));
+        }
+    }
+    else
+    {
+        FROGFS_DEBUG_VERBOSE("too large record %d or size %d", record, size);
+        retval = FROGFS_ERR_INVALID_RECORD;
+    }
+
+    return retval;
+}
+
+static t_e_frogfs_error frogfs_read_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, uint8_t *data, uint16_t size, uint16_t *effective_read)
+{
+    return frogfs_traverse_unlocked(volume, record, data, size, effective_read, false);
+}
+
+/**
+ * Move the read position of a record to the given offset of its data.
+ * Whole blocks are skipped by their size metadata, their data is not read.
+ * The offset can be the record size (end of the record).
+ */
+static t_e_frogfs_error frogfs_seek_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset offset)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    t_frogfs_offset pos;
+    t_frogfs_offset data_start = 0U;
+    t_frogfs_offset data_size = 0U;
+    t_frogfs_offset data_end = 0U;
+    t_frogfs_offset hops;
+    uint16_t block = 0U;
+    bool found = false;
+#ifdef FROGFS_USE_EXTENT_CACHE
+    t_s_frogfs_extent_cache *cache;
+#endif
+
+    FROGFS_DEBUG_VERBOSE("%s: record %d offset %d", __FUNCTION__, record, offset);
+
+    if (record >= FROGFS_MAX_RECORD_COUNT)
+    {
+        FROGFS_DEBUG_VERBOSE("too large record %d", record);
+        return FROGFS_ERR_INVALID_RECORD;
+    }
+
+    if (volume->records[record].offset == 0U)
+    {
+        /* Record does not exist */
+        return FROGFS_ERR_INVALID_OPERATION;
+    }
+
+    if (volume->records[record].write_offset != 0U)
+    {
+        /* Open for writing */
+        return FROGFS_ERR_NOT_READABLE;
+    }
+
+#ifdef FROGFS_USE_EXTENT_CACHE
+    cache = &volume->extent_cache[record];
+    (void)frogfs_extent_cache_fill(volume, record);
+#endif
+
+    pos = volume->records[record].offset;
+    for (hops = 0U; (retval == FROGFS_ERR_OK) && (found == false); hops++)
+    {
+        if (hops > (storage_cache_size(&volume->storage) / FROGFS_RECORD_METADATA_SIZE))
+        {
+            retval = FROGFS_ERR_OUT_OF_RANGE;
+            break;
+        }
+
+        /* Locate the block: pos is left to 0 if there is no further block */
+#ifdef FROGFS_USE_EXTENT_CACHE
+        if (block < cache->count)
+        {
+            data_start = cache->extents[block].start;
+            data_size = cache->extents[block].size;
+        }
+        else if ((block > 0U) && (cache->state == FROGFS_EXTENT_CACHE_COMPLETE))
+        {
+            pos = 0U;
+        }
+        else
+#endif
+        {
+            if (block > 0U)
+            {
+                /* Follow the fragment pointer after the previous block */
+                retval = frogfs_read_next_block(volume, record, data_end, &pos);
+            }
+
+            if ((retval == FROGFS_ERR_OK) && (pos != 0U))
+            {
+                data_start = (t_frogfs_offset)(pos + FROGFS_RECORD_METADATA_SIZE);
+                retval = frogfs_read_block_size(volume, record, pos, &data_size);
+            }
+        }
+
+        if (retval != FROGFS_ERR_OK)
+        {
+            break;
+        }
+
+        if (pos == 0U)
+        {
+            /* No further block */
+            if (offset > 0U)
+            {
+                retval = FROGFS_ERR_OUT_OF_RANGE;
+            }
+            else
+            {
+                /* End of the record: the last block has been fully read */
+                volume->records[record].work_reg_1 = data_end;
+                volume->records[record].work_reg_2 = FROGFS_OFFSET_MAX;
+                found = true;
+                block--;
+            }
+        }
+        else if (offset < data_size)
+        {
+            /* The offset is in this block */
+            volume->records[record].work_reg_1 = (t_frogfs_offset)(data_start + offset);
+            volume->records[record].work_reg_2 = (t_frogfs_offset)(data_size - offset);
+            found = true;
+        }
+        else
+        {
+            offset = (t_frogfs_offset)(offset - data_size);
+            data_end = (t_frogfs_offset)(data_start + data_size);
+            block++;
+        }
+    }
+
+#ifdef FROGFS_USE_EXTENT_CACHE
+    /* The traversal continues through the cache if the block is described there */
+    if (cache->count > 0U)
+    {
+        cache->cursor = (block < cache->count) ? (uint8_t)block : (uint8_t)(cache->count - 1U);
+    }
+#endif
+
+    return retval;
+}
+
+/**
+ * Get the size and the number of blocks of a record without reading it.
+ * Both are known from the storage scan of frogfs_init and kept up to date by the write
+ * operations; only when the allocation table came from the checkpoint, the metadata of
+ * the record is read once.
+ */
+static t_e_frogfs_error frogfs_stat_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, t_s_frogfs_record_info *info)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    t_frogfs_offset pos;
+    t_frogfs_offset block_size;
+    t_frogfs_offset total_size = 0U;
+    uint16_t blocks = 0U;
+
+    if (info == NULL)
+    {
+        return FROGFS_ERR_NULL_POINTER;
+    }
+
+    if (record >= FROGFS_MAX_RECORD_COUNT)
+    {
+        FROGFS_DEBUG_VERBOSE("too large record %d", record);
+        return FROGFS_ERR_INVALID_RECORD;
+    }
+
+    if (volume->records[record].offset == 0U)
+    {
+        /* Record does not exist */
+        return FROGFS_ERR_INVALID_OPERATION;
+    }
+
+    if (volume->records[record].fragments == 0U)
+    {
+        /* Not scanned: follow the fragment chain */
+        pos = volume->records[record].offset;
+        while ((retval == FROGFS_ERR_OK) && (pos != 0U))
+        {
+            if (blocks > (storage_cache_size(&volume->storage) / FROGFS_RECORD_METADATA_SIZE))
+            {
+                retval = FROGFS_ERR_OUT_OF_RANGE;
+                break;
+            }
+
+            retval = frogfs_read_block_size(volume, record, pos, &block_size);
+
+            if (retval == FROGFS_ERR_OK)
+            {
+                total_size += block_size;
+                blocks++;
+                retval = frogfs_read_next_block(volume, record, (t_frogfs_offset)(pos + FROGFS_RECORD_METADATA_SIZE + block_size), &pos);
+            }
+        }
+
+        if (retval == FROGFS_ERR_OK)
+        {
+            volume->records[record].size = total_size;
+            volume->records[record].fragments = blocks;
+        }
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        info->size = volume->records[record].size;
+        info->fragments = volume->records[record].fragments;
+    }
+
+    return retval;
+}
+
+/**
+ * Read from the given offset of a record: same as frogfs_seek followed by frogfs_read.
+ */
+static t_e_frogfs_error frogfs_pread_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset offset, uint8_t *data, uint16_t size, uint16_t *effective_read)
+{
+    t_e_frogfs_error retval;
+
+    *effective_read = 0U;
+
+    retval = frogfs_seek_unlocked(volume, record, offset);
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        retval = frogfs_traverse_unlocked(volume, record, data, size, effective_read, false);
+    }
+
+    return retval;
+}
+
+/**
+ * Exchange the read position of a handle with the one of its record, so that the
+ * record based read functions operate on the handle. Calling it twice restores both.
+ */
+static void frogfs_handle_swap(t_s_frogfs_handle *handle)
+{
+    t_frogfs_offset tmp;
+#ifdef FROGFS_USE_EXTENT_CACHE
+    uint8_t cursor;
+
+    cursor = handle->volume->extent_cache[handle->record].cursor;
+    handle->volume->extent_cache[handle->record].cursor = handle->cursor;
+    handle->cursor = cursor;
+#endif
+
+    tmp = handle->volume->records[handle->record].work_reg_1;
+    handle->volume->records[handle->record].work_reg_1 = handle->work_reg_1;
+    handle->work_reg_1 = tmp;
+
+    tmp = handle->volume->records[handle->record].work_reg_2;
+    handle->volume->records[handle->record].work_reg_2 = handle->work_reg_2;
+    handle->work_reg_2 = tmp;
+}
+
+/**
+ * Check that a handle can be used: open, on a record that exists and is not being written.
+ */
+static t_e_frogfs_error frogfs_handle_check(const t_s_frogfs_handle *handle)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+
+    if (handle == NULL)
+    {
+        retval = FROGFS_ERR_NULL_POINTER;
+    }
+    else if ((handle->volume == NULL) || (handle->record >= FROGFS_MAX_RECORD_COUNT) ||
+             (handle->volume->records[handle->record].offset == 0U))
+    {
+        retval = FROGFS_ERR_INVALID_OPERATION;
+    }
+    else if (handle->volume->records[handle->record].write_offset != 0U)
+    {
+        retval = FROGFS_ERR_NOT_READABLE;
+    }
+
+    return retval;
+}
+
+/**
+ * Open a read handle on a record, positioned at its start. Each handle keeps its own
+ * read position: several handles (and frogfs_read) can read the same record at the
+ * same time. Handles shall be closed before the record is written or erased, and
+ * before the volume is compacted.
+ */
+static t_e_frogfs_error frogfs_handle_open_unlocked(t_s_frogfs_volume *volume, t_s_frogfs_handle *handle, t_frogfs_record record)
+{
+    t_e_frogfs_error retval;
+
+    FROGFS_DEBUG_VERBOSE("%s: record %d", __FUNCTION__, record);
+
+    if (handle == NULL)
+    {
+        return FROGFS_ERR_NULL_POINTER;
+    }
+
+    if (record >= FROGFS_MAX_RECORD_COUNT)
+    {
+        FROGFS_DEBUG_VERBOSE("too large record %d", record);
+        return FROGFS_ERR_INVALID_RECORD;
+    }
+
+    handle->volume = volume;
+    handle->record = record;
+    handle->cursor = 0U;
+    handle->work_reg_1 = 0U;
+    handle->work_reg_2 = 0U;
+
+    retval = frogfs_handle_check(handle);
+
+    if (retval != FROGFS_ERR_OK)
+    {
+        handle->record = FROGFS_MAX_RECORD_COUNT;
+    }
+
+    return retval;
+}
+
+static t_e_frogfs_error frogfs_handle_read_unlocked(t_s_frogfs_handle *handle, uint8_t *data, uint16_t size, uint16_t *effective_read)
+{
+    t_e_frogfs_error retval;
+
+    *effective_read = 0U;
+
+    retval = frogfs_handle_check(handle);
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        frogfs_handle_swap(handle);
+        retval = frogfs_traverse_unlocked(handle->volume, handle->record, data, size, effective_read, false);
+        frogfs_handle_swap(handle);
+    }
+
+    return retval;
+}
+
+static t_e_frogfs_error frogfs_handle_seek_unlocked(t_s_frogfs_handle *handle, t_frogfs_offset offset)
+{
+    t_e_frogfs_error retval;
+
+    retval = frogfs_handle_check(handle);
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        frogfs_handle_swap(handle);
+        retval = frogfs_seek_unlocked(handle->volume, handle->record, offset);
+        frogfs_handle_swap(handle);
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_handle_close(t_s_frogfs_handle *handle)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+
+    if (handle == NULL)
+    {
+        retval = FROGFS_ERR_NULL_POINTER;
+    }
+    else if (handle->record >= FROGFS_MAX_RECORD_COUNT)
+    {
+        /* Not open */
+        retval = FROGFS_ERR_INVALID_OPERATION;
+    }
+    else
+    {
+        handle->record = FROGFS_MAX_RECORD_COUNT;
+    }
+
+    return retval;
+}
+
+static t_e_frogfs_error frogfs_erase_unlocked(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    t_e_frogfs_error retval;
+    uint16_t effective_erased = 0;
+    t_frogfs_record slot;
+
+    retval = frogfs_open_unlocked(volume, record);
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        /* Looked up after the opening, that could have created the record */
+        slot = frogfs_record_slot(volume, record);
+        retval = frogfs_traverse_unlocked(volume, slot, NULL, 0, &effective_erased, true);
+
+        if (retval == FROGFS_ERR_OK)
+        {
+            /* successful traversal and erasure */
+
+            /* close the record */
+            retval = frogfs_close_unlocked(volume, slot);
+
+            /* delete the record from the allocation table */
+            volume->records[slot].offset = 0U;
+            volume->records[slot].size = 0U;
+            volume->records[slot].fragments = 0U;
+            frogfs_record_release(volume, slot);
+#ifdef FROGFS_USE_EXTENT_CACHE
+            frogfs_extent_cache_reset(volume, slot);
+#endif
+
+            /* The scans shall not go over the space of the record if it was the last one */
+            if (retval == FROGFS_ERR_OK)
+            {
+                retval = frogfs_high_water_trim(volume);
+            }
+        }
+    }
+
+    return retval;
+}
+
+#ifdef FROGFS_USE_COMPACTION
+/**
+ * Move one record into a single block at a lower free extent (or out of its fragments).
+ * The record chosen is the lowest one that fits a free extent before it, so that the
+ * data is packed towards the beginning of the storage and the holes merge at its end.
+ * A fragmented record with no room before it is joined in the first free extent that fits.
+ * @param limit     the records larger than this are not moved
+ * @param moved     out: false if no record can be moved any more
+ */
+static t_e_frogfs_error frogfs_compact_step(t_s_frogfs_volume *volume, t_frogfs_offset limit, bool *moved)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    t_s_frogfs_record_info info;
+    uint8_t buffer[FROGFS_SCAN_BUFFER_SIZE];
+    t_frogfs_record slot;
+    t_frogfs_record best = FROGFS_MAX_RECORD_COUNT;
+    t_frogfs_offset best_size = 0U;
+    t_frogfs_offset dest = 0U;
+    t_frogfs_offset pos;
+    t_frogfs_offset dst;
+    t_frogfs_offset size;
+    t_frogfs_offset next;
+    t_frogfs_offset chunk;
+    t_frogfs_offset first_length = 0U;
+    t_frogfs_offset first_next = 0U;
+    t_frogfs_offset copied = 0U;
+    uint16_t length;
+    uint8_t i;
+    bool down;
+    bool best_down = false;
+
+    *moved = false;
+
+    for (slot = 0; (slot < FROGFS_MAX_RECORD_COUNT) && (retval == FROGFS_ERR_OK); slot++)
+    {
+        /* The records being written keep their blocks */
+        if ((volume->records[slot].offset == 0U) || (volume->records[slot].write_offset != 0U))
+        {
+            continue;
+        }
+
+        retval = frogfs_stat_unlocked(volume, slot, &info);
+
+        if ((retval != FROGFS_ERR_OK) || (info.size > limit))
+        {
+            continue;
+        }
+
+        /* First fit, as the allocation */
+        for (i = 0; i < volume->free_map_count; i++)
+        {
+            if ((uint32_t)volume->free_map[i].size >= ((uint32_t)info.size + FROGFS_MIN_CONTIGUOUS_SPACE))
+            {
+                break;
+            }
+        }
+
+        if ((i < volume->free_map_count) &&
+            ((info.fragments > 1U) || (volume->free_map[i].start < volume->records[slot].offset)))
+        {
+            down = (volume->free_map[i].start < volume->records[slot].offset) ? true : false;
+
+            /* The moves towards the beginning first, then the ones joining fragments */
+            if ((best < FROGFS_MAX_RECORD_COUNT) && ((best_down == true) || (down == false)) &&
+                ((down != best_down) || (volume->records[slot].offset > volume->records[best].offset)))
+            {
+                continue;
+            }
+
+            best = slot;
+            best_down = down;
+            best_size = info.size;
+            dest = volume->free_map[i].start;
+        }
+    }
+
+    if ((retval != FROGFS_ERR_OK) || (best >= FROGFS_MAX_RECORD_COUNT))
+    {
+        return retval;
+    }
+
+    FROGFS_DEBUG_VERBOSE("moving record %d from 0x%04x to 0x%04x", FROGFS_RECORD_ID(volume, best), volume->records[best].offset, dest);
+
+#ifdef FROGFS_USE_CHECKPOINT
+    /* The allocation table is about to change */
+    retval = frogfs_checkpoint_invalidate(volume);
+#endif
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        frogfs_free_map_remove(volume, dest, (t_frogfs_offset)(best_size + FROGFS_MIN_CONTIGUOUS_SPACE));
+
+        /* The new block is followed by zeroed bytes, as a newly allocated one */
+        retval = frogfs_high_water_raise(volume, (t_frogfs_offset)(dest + FROGFS_RECORD_METADATA_SIZE + best_size + FROGFS_APPEND_RESERVED_SPACE));
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        retval = frogfs_journal_store(volume, FROGFS_JOURNAL_COPY, dest, (t_frogfs_offset)(FROGFS_RECORD_METADATA_SIZE + best_size), 0U);
+    }
+
+    /* Copy the data of all the blocks, in order, after the new header */
+    pos = volume->records[best].offset;
+    dst = (t_frogfs_offset)(dest + FROGFS_RECORD_METADATA_SIZE);
+    while ((retval == FROGFS_ERR_OK) && (pos != 0U))
+    {
+        retval = frogfs_journal_block(volume, pos, &size, &next);
+
+        if ((retval == FROGFS_ERR_OK) && (((uint32_t)copied + size) > best_size))
+        {
+            retval = FROGFS_ERR_OUT_OF_RANGE;
+        }
+
+        if ((retval == FROGFS_ERR_OK) && (pos == volume->records[best].offset))
+        {
+            first_length = (t_frogfs_offset)(FROGFS_RECORD_METADATA_SIZE + size + ((next != 0U) ? FROGFS_RECORD_METADATA_SIZE : 0U));
+            first_next = next;
+        }
+
+        for (chunk = 0U; (retval == FROGFS_ERR_OK) && (chunk < size); chunk += (t_frogfs_offset)sizeof(buffer))
+        {
+            length = (uint16_t)(((size - chunk) < (t_frogfs_offset)sizeof(buffer)) ? (t_frogfs_offset)(size - chunk) : (t_frogfs_offset)sizeof(buffer));
+            retval = storage_cache_read_at(&volume->storage, (t_frogfs_offset)(pos + FROGFS_RECORD_METADATA_SIZE + chunk), buffer, length);
+
+            if (retval == FROGFS_ERR_OK)
+            {
+                retval = storage_cache_write_at(&volume->storage, dst, buffer, length);
+                dst += length;
+            }
+        }
+
+        copied += size;
+        pos = next;
+    }
+
+    if ((retval == FROGFS_ERR_OK) && (copied != best_size))
+    {
+        retval = FROGFS_ERR_OUT_OF_RANGE;
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        /* The header last: the block is complete once it is there */
+        frogfs_metadata_encode(buffer, FROGFS_RECORD_ID(volume, best), FROGFS_RECORD_TYPE_NORMAL, FROGFS_RECORD_DATA_SIZE, best_size);
+        retval = storage_cache_write_at(&volume->storage, dest, buffer, FROGFS_RECORD_METADATA_SIZE);
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        /* From now on, the new block is the record: the old ones are erased */
+        retval = frogfs_journal_store(volume, FROGFS_JOURNAL_ERASE, volume->records[best].offset, first_length, first_next);
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        pos = volume->records[best].offset;
+        volume->records[best].offset = dest;
+        volume->records[best].size = best_size;
+        volume->records[best].fragments = 1U;
+        volume->records[best].work_reg_1 = 0U;
+        volume->records[best].work_reg_2 = 0U;
+#ifdef FROGFS_USE_EXTENT_CACHE
+        frogfs_extent_cache_reset(volume, best);
+#endif
+        *moved = true;
+
+        retval = frogfs_journal_erase_chain(volume, pos, first_length, first_next);
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        retval = frogfs_high_water_trim(volume);
+    }
+
+    return retval;
+}
+#endif
+
+/**
+ * Move the records towards the beginning of the storage, each one into a single block,
+ * until no record can be moved any more. See frogfs_compact_step.
+ */
+static t_e_frogfs_error frogfs_compact_unlocked(t_s_frogfs_volume *volume)
+{
+#ifdef FROGFS_USE_COMPACTION
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    bool moved = true;
+
+    if (volume->free_map_valid == false)
+    {
+        retval = frogfs_free_map_build(volume);
+    }
+
+    while ((retval == FROGFS_ERR_OK) && (moved == true))
+    {
+        retval = frogfs_compact_step(volume, (t_frogfs_offset)FROGFS_MAX_BLOCK_SIZE, &moved);
+
+        if ((retval == FROGFS_ERR_OK) && (moved == false) && (volume->free_map_lossy == true) && (volume->free_map_fresh == false))
+        {
+            /* A hole dropped from the map may take a record: refresh it */
+            retval = frogfs_free_map_build(volume);
+            moved = true;
+        }
+    }
+
+    return retval;
+#else
+    (void)volume;
+    return FROGFS_ERR_INVALID_OPERATION;
+#endif
+}
+
+/**
+ * Do a bounded amount of housekeeping, for the idle time of the application:
+ * - build the free-extent map (when it has not been built since frogfs_init) by
+ *   scanning about budget_bytes of the storage, merging the adjacent holes on the way,
+ * - or, with FROGFS_USE_COMPACTION, move one record of at most budget_bytes as
+ *   frogfs_compact does. When no record can be moved and the map has overflowed
+ *   since its last scan, the scan starts again to find the holes it dropped.
+ * The map is not built while a record is open for writing. An overflowed map that
+ * has been scanned completely stays in use.
+ * @param budget_bytes  bytes of the storage that can be read or copied
+ * @param more          out: true if there is more work to do
+ */
+static t_e_frogfs_error frogfs_maintenance_step_unlocked(t_s_frogfs_volume *volume, t_frogfs_offset budget_bytes, bool *more)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    t_frogfs_record i;
+#ifdef FROGFS_USE_COMPACTION
+    bool moved = false;
+#endif
+
+    if (more == NULL)
+    {
+        return FROGFS_ERR_NULL_POINTER;
+    }
+
+    *more = false;
+
+    if (volume->free_map_valid == false)
+    {
+        for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
+        {
+            if (volume->records[i].write_offset != 0U)
+            {
+                /* Postponed till the record is closed */
+                volume->scan_pos = 0U;
+                *more = true;
+                return FROGFS_ERR_OK;
+            }
+        }
+
+        /* Once complete, the moves get a whole budget with the next call */
+        retval = frogfs_free_map_scan_step(volume, &budget_bytes);
+        *more = true;
+    }
+#ifdef FROGFS_USE_COMPACTION
+    else if (budget_bytes > 0U)
+    {
+        retval = frogfs_compact_step(volume, budget_bytes, &moved);
+
+        if ((retval == FROGFS_ERR_OK) && (moved == false) && (volume->free_map_lossy == true) && (volume->free_map_fresh == false))
+        {
+            /* A hole dropped from the map may take a record: scan again */
+            volume->free_map_valid = false;
+            volume->scan_pos = 0U;
+            moved = true;
+        }
+
+        *more = moved;
+    }
+#endif
+
+    return retval;
+}
+
+/*
+ * Public entry points: the implementations above, with the volume locks held
+ * (see FROGFS_USE_LOCKING).
+ */
+
+t_e_frogfs_error frogfs_format(t_s_frogfs_volume *volume)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_format_unlocked(volume);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_init(t_s_frogfs_volume *volume)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_init_unlocked(volume);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_checkpoint(t_s_frogfs_volume *volume)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_checkpoint_unlocked(volume);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_compact(t_s_frogfs_volume *volume)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_compact_unlocked(volume);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_maintenance_step(t_s_frogfs_volume *volume, t_frogfs_offset budget_bytes, bool *more)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_maintenance_step_unlocked(volume, budget_bytes, more);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_find_contiguous_space(t_s_frogfs_volume *volume, t_frogfs_offset *space_start, t_frogfs_offset *data_start, t_frogfs_offset *data_size)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_find_contiguous_space_unlocked(volume, 0U, space_start, data_start, data_size);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_list(t_s_frogfs_volume *volume, t_frogfs_record *list, t_frogfs_record list_size, t_frogfs_record *file_num)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_shared(volume, FROGFS_MAX_RECORD_COUNT);
+    retval = frogfs_list_unlocked(volume, list, list_size, file_num);
+    frogfs_unlock_shared(volume, FROGFS_MAX_RECORD_COUNT);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_get_available(t_s_frogfs_volume *volume, t_frogfs_record *record)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_shared(volume, FROGFS_MAX_RECORD_COUNT);
+    retval = frogfs_get_available_unlocked(volume, record);
+    frogfs_unlock_shared(volume, FROGFS_MAX_RECORD_COUNT);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_open(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_open_unlocked(volume, record);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_open_sized(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset expected_size)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_open_sized_unlocked(volume, record, expected_size, false);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_reserve(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset size)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_reserve_unlocked(volume, record, size);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_open_append(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_open_append_unlocked(volume, record);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_write(t_s_frogfs_volume *volume, t_frogfs_record record, const uint8_t *data, uint16_t size)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_write_unlocked(volume, frogfs_record_slot(volume, record), data, size);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_flush(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_flush_unlocked(volume, frogfs_record_slot(volume, record));
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_close(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_close_unlocked(volume, frogfs_record_slot(volume, record));
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_erase_range(t_s_frogfs_volume *volume, t_frogfs_offset pos, t_frogfs_offset size)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_erase_range_unlocked(volume, pos, size);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_erase(t_s_frogfs_volume *volume, t_frogfs_record record)
+{
+    t_e_frogfs_error retval;
+
+    frogfs_lock_exclusive(volume);
+    retval = frogfs_erase_unlocked(volume, record);
+    frogfs_unlock_exclusive(volume);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_read(t_s_frogfs_volume *volume, t_frogfs_record record, uint8_t *data, uint16_t size, uint16_t *effective_read)
+{
+    t_e_frogfs_error retval;
+    t_frogfs_record slot;
+
+    slot = frogfs_lock_shared_record(volume, record);
+    retval = frogfs_read_unlocked(volume, slot, data, size, effective_read);
+    frogfs_unlock_shared(volume, slot);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_seek(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset offset)
+{
+    t_e_frogfs_error retval;
+    t_frogfs_record slot;
+
+    slot = frogfs_lock_shared_record(volume, record);
+    retval = frogfs_seek_unlocked(volume, slot, offset);
+    frogfs_unlock_shared(volume, slot);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_pread(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset offset, uint8_t *data, uint16_t size, uint16_t *effective_read)
+{
+    t_e_frogfs_error retval;
+    t_frogfs_record slot;
+
+    slot = frogfs_lock_shared_record(volume, record);
+    retval = frogfs_pread_unlocked(volume, slot, offset, data, size, effective_read);
+    frogfs_unlock_shared(volume, slot);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_stat(t_s_frogfs_volume *volume, t_frogfs_record record, t_s_frogfs_record_info *info)
+{
+    t_e_frogfs_error retval;
+    t_frogfs_record slot;
+
+    slot = frogfs_lock_shared_record(volume, record);
+    retval = frogfs_stat_unlocked(volume, slot, info);
+    frogfs_unlock_shared(volume, slot);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_handle_open(t_s_frogfs_volume *volume, t_s_frogfs_handle *handle, t_frogfs_record record)
+{
+    t_e_frogfs_error retval;
+    t_frogfs_record slot;
+
+    slot = frogfs_lock_shared_record(volume, record);
+    retval = frogfs_handle_open_unlocked(volume, handle, slot);
+    frogfs_unlock_shared(volume, slot);
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_handle_read(t_s_frogfs_handle *handle, uint8_t *data, uint16_t size, uint16_t *effective_read)
+{
+    t_e_frogfs_error retval;
+
+    if ((handle == NULL) || (handle->volume == NULL))
+    {
+        retval = frogfs_handle_read_unlocked(handle, data, size, effective_read);
+    }
+    else
+    {
+        frogfs_lock_shared(handle->volume, handle->record);
+        retval = frogfs_handle_read_unlocked(handle, data, size, effective_read);
+        frogfs_unlock_shared(handle->volume, handle->record);
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_handle_seek(t_s_frogfs_handle *handle, t_frogfs_offset offset)
+{
+    t_e_frogfs_error retval;
+
+    if ((handle == NULL) || (handle->volume == NULL))
+    {
+        retval = frogfs_handle_seek_unlocked(handle, offset);
+    }
+    else
+    {
+        frogfs_lock_shared(handle->volume, handle->record);
+        retval = frogfs_handle_seek_unlocked(handle, offset);
+        frogfs_unlock_shared(handle->volume, handle->record);
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error frogfs_traverse(t_s_frogfs_volume *volume, t_frogfs_record record, uint8_t *data, uint16_t size, uint16_t *effective_read, bool erase)
+{
+    t_e_frogfs_error retval;
+    t_frogfs_record slot;
+
+    if (erase == true)
+    {
+        frogfs_lock_exclusive(volume);
+        retval = frogfs_traverse_unlocked(volume, frogfs_record_slot(volume, record), data, size, effective_read, erase);
+        frogfs_unlock_exclusive(volume);
+    }
+    else
+    {
+        slot = frogfs_lock_shared_record(volume, record);
+        retval = frogfs_traverse_unlocked(volume, slot, data, size, effective_read, erase);
+        frogfs_unlock_shared(volume, slot);
+    }
+
+    return retval;
+}
+
 void printf_frogfserror(t_e_frogfs_error errno)
 {
     switch(errno)
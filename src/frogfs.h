@@ -27,53 +27,161 @@
 #define FROGFS_H_
 
 #include "frogfs_enums.h"
+#include "frogfs_config.h"
+#include "storage/storage_api.h"
+#include "storage/cache/storage_cache.h"
 
 #include <stdbool.h>
 
-#ifdef FROGFS_UNIT_TESTING
-#define FROGFS_FORCE_INIT_AT_EVERY_OPEN
+#ifdef FROGFS_USE_LOCKING
+#include <pthread.h>
 #endif
 
-/** The simplistic design needs to avoid zero's in the metadata block,
- *  especially at the beginning as the free space allocator cannot
- *  distinguish a metadata versus empty space otherwise.
+#ifdef FROGFS_USE_EXTENDED_INDEX
+/** Record index: 0 .. FROGFS_RECORD_ID_LIMIT - 1, whatever FROGFS_MAX_RECORD_COUNT is */
+typedef uint16_t t_frogfs_record;
+#define FROGFS_RECORD_ID_LIMIT          (0x3FFFU)
+#define FROGFS_RECORD_NONE              (UINT16_MAX)
+#else
+/** Record index: 0 .. FROGFS_MAX_RECORD_COUNT - 1 */
+typedef uint8_t t_frogfs_record;
+#define FROGFS_RECORD_ID_LIMIT          (FROGFS_MAX_RECORD_COUNT)
+#define FROGFS_RECORD_NONE              (UINT8_MAX)
+#endif
+
+typedef struct
+{
+    t_frogfs_offset offset;         /**< The allocation table of the first block of the record */
+#ifdef FROGFS_USE_EXTENDED_INDEX
+    t_frogfs_record key;            /**< Record index + FROGFS_MIN_RECORD_INDEX_OFFSET owning the slot,
+                                         0 if the slot has never been used, FROGFS_RECORD_NONE if released */
+#endif
+
+    t_frogfs_offset work_reg_1;     /**< Generic working register to support file operations.
+                                         Meaning is documented for each function/module using it. */
+    t_frogfs_offset work_reg_2;     /**< Generic working register to support file operations.
+                                         Meaning is documented for each function/module using it. */
+    t_frogfs_offset write_offset;   /**< Write pointer for write operations. If different from 0, then
+                                         a record is open for writing */
+    t_frogfs_offset header_size;    /**< Size stored in the header of the block being written */
+    t_frogfs_offset size;           /**< Size of the record data (see frogfs_stat) */
+    uint16_t fragments;             /**< Number of blocks of the record data, 0 if not known yet (see frogfs_stat) */
+} t_s_frogfsram_record;
+
+typedef struct
+{
+    t_frogfs_offset size;   /**< Size of the record data in bytes */
+    uint16_t fragments;     /**< Number of blocks the record data is split into (1 if contiguous) */
+} t_s_frogfs_record_info;
+
+/** A free (zeroed) extent of the storage, or a data block of a record */
+typedef struct
+{
+    t_frogfs_offset start;  /**< Offset of the first byte */
+    t_frogfs_offset size;   /**< Number of bytes */
+} t_s_frogfs_extent;
+
+#ifdef FROGFS_USE_EXTENT_CACHE
+/** Data blocks of a record, in fragment chain order */
+typedef struct
+{
+    t_s_frogfs_extent extents[FROGFS_EXTENT_CACHE_SIZE];  /**< Data start and data length of each block */
+    uint8_t count;          /**< Number of valid entries in extents */
+    uint8_t state;          /**< FROGFS_EXTENT_CACHE_EMPTY, _PARTIAL or _COMPLETE */
+    uint8_t cursor;         /**< Entry of the block being traversed */
+} t_s_frogfs_extent_cache;
+#endif
+
+/**
+ * A filesystem instance: the storage it lives on and all its RAM state.
+ * Every function works on the volume it is given, so that several volumes can be
+ * used in the same program (from different threads, each volume from one thread
+ * at a time unless FROGFS_USE_LOCKING is defined). Set it up with frogfs_volume_setup,
+ * then mount it with frogfs_init (or frogfs_format). Release it with
+ * frogfs_volume_release when it is not used anymore.
  */
-#define FROGFS_MIN_RECORD_INDEX_OFFSET (1U)
+typedef struct
+{
+    t_s_storage_cache storage;                              /**< The storage, through the cache if FROGFS_USE_CACHE */
+    t_s_frogfsram_record records[FROGFS_MAX_RECORD_COUNT];  /**< The allocation table (hashed on the record index
+                                                                 with FROGFS_USE_EXTENDED_INDEX) */
+
+    /** Free-extent map: the holes of the storage, sorted by offset. Adjacent extents are merged. */
+    t_s_frogfs_extent free_map[FROGFS_MAX_FREE_EXTENTS];
+    uint8_t free_map_count;                                 /**< Number of valid entries in free_map */
+    bool    free_map_valid;                                 /**< The map has been built and is maintained */
+    bool    free_map_lossy;                                 /**< Some extents did not fit in the map and were dropped */
+    bool    free_map_fresh;                                 /**< The map has not changed since the last complete scan */
+    t_frogfs_offset scan_pos;                               /**< Next offset of the map scan of frogfs_maintenance_step,
+                                                                 0 if no scan is in progress */
+    t_frogfs_offset scan_data_end;                          /**< End of the data of the last sized block seen by that scan */
+
+#ifdef FROGFS_USE_EXTENT_CACHE
+    t_s_frogfs_extent_cache extent_cache[FROGFS_MAX_RECORD_COUNT];
+#endif
+
+#ifdef FROGFS_USE_NEXT_FIT
+    t_frogfs_offset alloc_cursor;                           /**< Start of the last allocated block, where the search resumes */
+#endif
+
+#ifdef FROGFS_USE_QUICK_FORMAT
+    t_frogfs_offset high_water;                             /**< The storage is formatted up to this offset */
+#endif
+
+#ifdef FROGFS_USE_CHECKPOINT
+    uint16_t checkpoint_generation;                         /**< Generation of the last checkpoint stored or loaded */
+    bool     checkpoint_valid;                              /**< True if the checkpoint on storage matches records */
+#endif
 
-/** Maximum number of total records on the filesystem.
- *  Tune: adjust to match the RAM requirements for the application but do NOT
- *        exceed 126. The record index is internally offset by FROGFS_MIN_RECORD_INDEX_OFFSET. */
-#define FROGFS_MAX_RECORD_COUNT        (32U)
+#ifdef FROGFS_USE_COMPACTION
+    uint8_t journal_sequence;                               /**< Sequence number of the current compaction journal state */
+    uint8_t journal_slot;                                   /**< Journal slot holding the current state */
+#endif
 
-/** Maximum length of a single record. This is a hard limit that comes
- *  from the design of the filesystem. Anything below could work but has
- *  not meaning as records are dynamically allocated. */
-#define FROGFS_MAX_RECORD_SIZE         (32U*1024U)
+#ifdef FROGFS_USE_LOCKING
+    pthread_rwlock_t lock;                                  /**< Shared by the read-only operations, exclusive otherwise */
+    pthread_mutex_t record_lock[FROGFS_MAX_RECORD_COUNT];   /**< Read position (work registers) of each record */
+#endif
+} t_s_frogfs_volume;
 
+/** Independent read position in a record (see frogfs_handle_open) */
 typedef struct
 {
-    uint16_t offset;        /**< The allocation table of the first block of the record */
-
-    uint16_t work_reg_1;    /**< Generic working register to support file operations.
-                                 Meaning is documented for each function/module using it. */
-    uint16_t work_reg_2;    /**< Generic working register to support file operations.
-                                 Meaning is documented for each function/module using it. */
-    uint16_t write_offset;  /**< Write pointer for write operations. If different from 0, then
-                                 a record is open for writing */
-} t_s_frogfsram_record;
+    t_s_frogfs_volume *volume;  /**< Volume of the record */
+    t_frogfs_record record;     /**< Slot of the record being read, FROGFS_MAX_RECORD_COUNT if the handle is closed */
+    uint8_t  cursor;            /**< Block being read in the extent cache (FROGFS_USE_EXTENT_CACHE) */
+    t_frogfs_offset work_reg_1; /**< Read pointer, as work_reg_1 of t_s_frogfsram_record for reading */
+    t_frogfs_offset work_reg_2; /**< Bytes left in the block, as work_reg_2 of t_s_frogfsram_record for reading */
+} t_s_frogfs_handle;
 
-t_e_frogfs_error frogfs_format(void);
-t_e_frogfs_error frogfs_init(void);
-t_e_frogfs_error frogfs_find_contiguous_space(uint16_t *space_start, uint16_t *data_start, uint16_t *data_size);
-t_e_frogfs_error frogfs_list(uint8_t *list, uint8_t list_size, uint8_t *file_num);
-t_e_frogfs_error frogfs_get_available(uint8_t *record);
-t_e_frogfs_error frogfs_open(uint8_t record);
-t_e_frogfs_error frogfs_write(uint8_t record, const uint8_t *data, uint16_t size);
-t_e_frogfs_error frogfs_close(uint8_t record);
-t_e_frogfs_error frogfs_erase_range(uint16_t pos, uint16_t size);
-t_e_frogfs_error frogfs_erase(uint8_t record);
-t_e_frogfs_error frogfs_read(uint8_t record, uint8_t *data, uint16_t size, uint16_t *effective_read);
-t_e_frogfs_error frogfs_traverse(uint8_t record, uint8_t *data, uint16_t size, uint16_t *effective_read, bool erase);
+void frogfs_volume_setup(t_s_frogfs_volume *volume, const t_s_storage_ops *ops, void *context);
+void frogfs_volume_release(t_s_frogfs_volume *volume);
+t_e_frogfs_error frogfs_format(t_s_frogfs_volume *volume);
+t_e_frogfs_error frogfs_init(t_s_frogfs_volume *volume);
+t_e_frogfs_error frogfs_checkpoint(t_s_frogfs_volume *volume);
+t_e_frogfs_error frogfs_compact(t_s_frogfs_volume *volume);
+t_e_frogfs_error frogfs_maintenance_step(t_s_frogfs_volume *volume, t_frogfs_offset budget_bytes, bool *more);
+t_e_frogfs_error frogfs_find_contiguous_space(t_s_frogfs_volume *volume, t_frogfs_offset *space_start, t_frogfs_offset *data_start, t_frogfs_offset *data_size);
+t_e_frogfs_error frogfs_list(t_s_frogfs_volume *volume, t_frogfs_record *list, t_frogfs_record list_size, t_frogfs_record *file_num);
+t_e_frogfs_error frogfs_get_available(t_s_frogfs_volume *volume, t_frogfs_record *record);
+t_e_frogfs_error frogfs_open(t_s_frogfs_volume *volume, t_frogfs_record record);
+t_e_frogfs_error frogfs_open_sized(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset expected_size);
+t_e_frogfs_error frogfs_reserve(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset size);
+t_e_frogfs_error frogfs_open_append(t_s_frogfs_volume *volume, t_frogfs_record record);
+t_e_frogfs_error frogfs_write(t_s_frogfs_volume *volume, t_frogfs_record record, const uint8_t *data, uint16_t size);
+t_e_frogfs_error frogfs_flush(t_s_frogfs_volume *volume, t_frogfs_record record);
+t_e_frogfs_error frogfs_close(t_s_frogfs_volume *volume, t_frogfs_record record);
+t_e_frogfs_error frogfs_erase_range(t_s_frogfs_volume *volume, t_frogfs_offset pos, t_frogfs_offset size);
+t_e_frogfs_error frogfs_erase(t_s_frogfs_volume *volume, t_frogfs_record record);
+t_e_frogfs_error frogfs_read(t_s_frogfs_volume *volume, t_frogfs_record record, uint8_t *data, uint16_t size, uint16_t *effective_read);
+t_e_frogfs_error frogfs_seek(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset offset);
+t_e_frogfs_error frogfs_pread(t_s_frogfs_volume *volume, t_frogfs_record record, t_frogfs_offset offset, uint8_t *data, uint16_t size, uint16_t *effective_read);
+t_e_frogfs_error frogfs_stat(t_s_frogfs_volume *volume, t_frogfs_record record, t_s_frogfs_record_info *info);
+t_e_frogfs_error frogfs_handle_open(t_s_frogfs_volume *volume, t_s_frogfs_handle *handle, t_frogfs_record record);
+t_e_frogfs_error frogfs_handle_read(t_s_frogfs_handle *handle, uint8_t *data, uint16_t size, uint16_t *effective_read);
+t_e_frogfs_error frogfs_handle_seek(t_s_frogfs_handle *handle, t_frogfs_offset offset);
+t_e_frogfs_error frogfs_handle_close(t_s_frogfs_handle *handle);
+t_e_frogfs_error frogfs_traverse(t_s_frogfs_volume *volume, t_frogfs_record record, uint8_t *data, uint16_t size, uint16_t *effective_read, bool erase);
 void printf_frogfserror(t_e_frogfs_error errno);
 
 #endif /* FROGFS_H_ */
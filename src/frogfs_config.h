@@ -0,0 +1,206 @@
+/*
+ *  Project     FrogFS
+ *  @author     Lorenzo Miori
+ *  @license    MIT - Copyright (c) 2019 Lorenzo Miori
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the \"Software\"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED \"AS IS\", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef FROGFS_CONFIG_H_
+#define FROGFS_CONFIG_H_
+
+/* Build configuration of the filesystem: limits, tunables and options.
+ * Included by frogfs.h and by the storage layers depending on it. */
+
+#ifdef FROGFS_UNIT_TESTING
+#define FROGFS_FORCE_INIT_AT_EVERY_OPEN
+#define FROGFS_USE_CHECKPOINT
+#define FROGFS_USE_QUICK_FORMAT
+#define FROGFS_USE_COMPACTION
+#define FROGFS_USE_CACHE
+#define FROGFS_USE_DEFERRED_HEADER
+#define FROGFS_USE_EXTENT_CACHE
+#ifdef __linux__
+#define FROGFS_USE_LOCKING
+#endif
+#ifdef FROGFS_USE_LARGE_STORAGE
+/* Large records are chained in blocks of the format version 1 size */
+#define FROGFS_MAX_BLOCK_SIZE          (32U*1024U - 1U)
+#endif
+#endif
+
+/** The simplistic design needs to avoid zero's in the metadata block,
+ *  especially at the beginning as the free space allocator cannot
+ *  distinguish a metadata versus empty space otherwise.
+ */
+#define FROGFS_MIN_RECORD_INDEX_OFFSET (1U)
+
+/** Maximum number of total records on the filesystem.
+ *  Tune: adjust to match the RAM requirements for the application but do NOT
+ *        exceed 126. The record index is internally offset by FROGFS_MIN_RECORD_INDEX_OFFSET.
+ *        With FROGFS_USE_EXTENDED_INDEX, it is the number of records that can exist at the
+ *        same time, whatever their index (up to 16382); a power of two is cheaper to hash. */
+#define FROGFS_MAX_RECORD_COUNT        (32U)
+
+/** Maximum length of a single block of a record (and of a single read or write call).
+ *  This is a hard limit that comes from the design of the filesystem: the size field
+ *  of a block takes 15 bits (23 bits with FROGFS_USE_LARGE_STORAGE). A record is a
+ *  chain of blocks, so its total size is only bounded by the storage. */
+#ifdef FROGFS_USE_LARGE_STORAGE
+#define FROGFS_MAX_RECORD_SIZE         (8UL*1024UL*1024UL)
+#else
+#define FROGFS_MAX_RECORD_SIZE         (32U*1024U)
+#endif
+
+/** Maximum data size of a single block. When a block being written reaches it,
+ *  frogfs_write chains a new Fragment-Size block, as when the free space runs out.
+ *  Tune: define it (e.g. in the build flags) to a lower value (at least 1) so that a
+ *        record open for writing does not hold the whole largest hole of the storage,
+ *        leaving the rest of it to the other records. Do NOT exceed the default. */
+#ifndef FROGFS_MAX_BLOCK_SIZE
+#define FROGFS_MAX_BLOCK_SIZE          (FROGFS_MAX_RECORD_SIZE - 1U)
+#endif
+
+/** Maximum number of holes (free extents) tracked in RAM to speed up the allocation.
+ *  When more holes exist, the smallest ones are dropped and the storage is scanned
+ *  again only when no tracked hole is large enough.
+ *  Tune: adjust to match the RAM requirements (4 bytes per entry, 8 with FROGFS_USE_LARGE_STORAGE)
+ *        for the application. */
+#define FROGFS_MAX_FREE_EXTENTS        (8U)
+
+/** Size of the buffer used by the free space scanners (frogfs_init and the allocator).
+ *  Free space is read in chunks of this size instead of byte by byte.
+ *  Tune: adjust to match the stack available to the frogfs calls. */
+#define FROGFS_SCAN_BUFFER_SIZE        (64U)
+
+/** When defined, a checkpoint of the in-RAM allocation table is kept on the storage
+ *  right after the header, so that frogfs_init can load it instead of scanning the
+ *  whole storage. The full scan is only done when the checkpoint is stale or torn.
+ *  Tune: define it (e.g. in the build flags) to trade (2 * FROGFS_MAX_RECORD_COUNT + 4)
+ *        bytes of storage (3 per record with FROGFS_USE_LARGE_STORAGE, 2 more with FROGFS_USE_EXTENDED_INDEX) for a faster boot. A storage shall always be used with the
+ *        same setting it has been formatted with. */
+/* #define FROGFS_USE_CHECKPOINT */
+
+/** When defined, a write-back block cache (storage/cache) sits between the filesystem
+ *  and the storage backend. Repeated small accesses to the same bytes (e.g. the record
+ *  header updated at every frogfs_write) are served from RAM and written back on
+ *  eviction, frogfs_close and storage_cache_sync.
+ *  Tune: define it (e.g. in the build flags) to trade
+ *        FROGFS_CACHE_BLOCK_COUNT * (FROGFS_CACHE_BLOCK_SIZE + 4) bytes of RAM for
+ *        fewer storage accesses. */
+/* #define FROGFS_USE_CACHE */
+
+/** When defined, frogfs_write only keeps the size of the block being written in RAM.
+ *  The block header on the storage is updated ahead of the data, FROGFS_HEADER_STEP bytes
+ *  at a time, and set to the exact size when the block is full, at frogfs_close and at
+ *  frogfs_flush, instead of at every frogfs_write call.
+ *  Tune: define it (e.g. in the build flags) to reduce the storage accesses (and wear)
+ *        of streaming writes made of many small chunks. On power loss, the record keeps
+ *        the size of the last header update: the bytes that had not been written yet
+ *        read as zeros (up to FROGFS_HEADER_STEP bytes). */
+/* #define FROGFS_USE_DEFERRED_HEADER */
+
+/** Number of bytes the size in the block header goes ahead of the data (FROGFS_USE_DEFERRED_HEADER).
+ *  Tune: larger values update the header less often, but leave more zeroed bytes at the
+ *        end of a record cut by a power loss. */
+#define FROGFS_HEADER_STEP             (32U)
+
+/** When defined, the data blocks (start and length) of every record are kept in RAM
+ *  once the record has been traversed, so that further reads and erases go straight
+ *  to the data without reading the fragment metadata from the storage again.
+ *  Tune: define it (e.g. in the build flags) to trade
+ *        FROGFS_MAX_RECORD_COUNT * (4 * FROGFS_EXTENT_CACHE_SIZE + 3) bytes of RAM for
+ *        faster access to fragmented records. */
+/* #define FROGFS_USE_EXTENT_CACHE */
+
+/** When defined, the free space search resumes after the block allocated last and
+ *  wraps around at the end of the storage (next fit) instead of always taking the
+ *  first hole of the storage (first fit). The holes left by the erased records are
+ *  reused only once the rest of the storage has been written.
+ *  Tune: define it (e.g. in the build flags) to spread the writes, and the wear, over
+ *        the whole EEPROM when records are often erased and written again. The holes
+ *        are filled later, so the free space fragments more than with first fit.
+ *        frogfs_open_sized keeps searching the best fit over the whole storage. */
+/* #define FROGFS_USE_NEXT_FIT */
+
+/** When defined, every volume carries a reader/writer lock and its functions can be
+ *  called from several threads. Read-only operations (frogfs_list, frogfs_stat, reads,
+ *  seeks and read handles) run in parallel as long as they work on different records;
+ *  the operations that allocate or change the storage are serialized.
+ *  Tune: define it (e.g. in the build flags) on hosted builds with POSIX threads and
+ *        link with the pthread library. */
+/* #define FROGFS_USE_LOCKING */
+
+/** When defined, the storage is formatted with the on-disk format version 2: block
+ *  pointers and sizes are stored on 23 bits (4 bytes of metadata per block instead
+ *  of 3) and every offset of the API is 32-bit, so that storages up to 8 MB
+ *  (e.g. serial FRAM and flash parts) can be used.
+ *  Tune: define it (e.g. in the build flags) for storages larger than 32 KB. Every
+ *        block costs one more byte of storage. A storage shall always be used with
+ *        the same setting it has been formatted with. */
+/* #define FROGFS_USE_LARGE_STORAGE */
+
+/** When defined, frogfs_format only writes the header, holding a high-water mark: the
+ *  storage after the mark is free whatever its content and it is neither read by
+ *  frogfs_init nor by the free space search. The mark is raised (and the storage zeroed
+ *  in steps of FROGFS_HIGH_WATER_STEP bytes) ahead of the writes, and moved back when the
+ *  records at the end of the storage are erased: the scans stop after the last allocated byte.
+ *  Tune: define it (e.g. in the build flags) when erasing the whole storage at format
+ *        time is too slow (e.g. large EEPROMs). The header takes 2 more bytes (3 with
+ *        FROGFS_USE_LARGE_STORAGE). A storage shall always be used with the same setting
+ *        it has been formatted with. */
+/* #define FROGFS_USE_QUICK_FORMAT */
+
+/** Number of bytes zeroed at once when the high-water mark is raised (FROGFS_USE_QUICK_FORMAT).
+ *  Tune: a multiple of the page size of the storage; larger values update the header
+ *        less often. */
+#define FROGFS_HIGH_WATER_STEP         (64U)
+
+/** When defined, frogfs_compact moves the records, each one into a single block, to the
+ *  lowest free extents, so that the holes left by the erased records merge at the end of
+ *  the storage. Every move is recorded in a journal after the header (and after the
+ *  checkpoint): a move cut by a power loss is rolled back or completed by frogfs_init.
+ *  Tune: define it (e.g. in the build flags) for storages with long lived records among
+ *        frequently erased ones. The journal takes 18 bytes of storage (24 with
+ *        FROGFS_USE_LARGE_STORAGE). A storage shall always be used with the
+ *        same setting it has been formatted with. */
+/* #define FROGFS_USE_COMPACTION */
+
+/** When defined, the record index takes 14 bits (2 bytes in every block metadata instead of 1),
+ *  so that records can be numbered from 0 to 16382 (see FROGFS_RECORD_ID_LIMIT). The RAM
+ *  allocation table does not grow with the index range: it keeps FROGFS_MAX_RECORD_COUNT
+ *  slots, hashed on the record index, for the records that exist at a given time.
+ *  Tune: define it (e.g. in the build flags) when the record index is derived from sparse
+ *        identifiers (e.g. sensor numbers). Every block costs one more byte of storage and
+ *        every slot 2 more bytes of RAM. A storage shall always be used with the same
+ *        setting it has been formatted with. */
+/* #define FROGFS_USE_EXTENDED_INDEX */
+
+/** Number of data blocks cached per record. The blocks of longer fragment chains
+ *  are located through the metadata on the storage. */
+#define FROGFS_EXTENT_CACHE_SIZE       (4U)
+
+/** Size of a cache block in bytes. */
+#define FROGFS_CACHE_BLOCK_SIZE        (16U)
+
+/** Number of blocks kept in the cache (maximum 255). */
+#define FROGFS_CACHE_BLOCK_COUNT       (4U)
+
+#endif /* FROGFS_CONFIG_H_ */
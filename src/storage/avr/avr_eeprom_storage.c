@@ -23,7 +23,7 @@
  *
  */
 
-#include "../storage_api.h"
+#include "avr_eeprom_storage.h"
 
 #ifdef __AVR__
 
@@ -44,12 +44,12 @@
 
 uint16_t eeprom_pos = 0;
 
-uint16_t storage_size(void)
+t_frogfs_offset storage_size(void)
 {
     return EEPROM_SIZE;
 }
 
-t_e_frogfs_error storage_advance(uint16_t size)
+t_e_frogfs_error storage_advance(t_frogfs_offset size)
 {
     t_e_frogfs_error retval = FROGFS_ERR_IO;
 
@@ -66,7 +66,7 @@ t_e_frogfs_error storage_advance(uint16_t size)
     return retval;
 }
 
-t_e_frogfs_error storage_backtrack(uint16_t size)
+t_e_frogfs_error storage_backtrack(t_frogfs_offset size)
 {
     t_e_frogfs_error retval = FROGFS_ERR_IO;
 
@@ -83,7 +83,7 @@ t_e_frogfs_error storage_backtrack(uint16_t size)
     return retval;
 }
 
-t_e_frogfs_error storage_pos(uint16_t *offset)
+t_e_frogfs_error storage_pos(t_frogfs_offset *offset)
 {
     t_e_frogfs_error retval = FROGFS_ERR_OK;
 
@@ -105,13 +105,13 @@ t_e_frogfs_error storage_end_of_storage(void)
     return retval;
 }
 
-t_e_frogfs_error storage_seek(uint16_t offset)
+t_e_frogfs_error storage_seek(t_frogfs_offset offset)
 {
     t_e_frogfs_error retval = FROGFS_ERR_IO;
 
     if (offset <= E2END)
     {
-        eeprom_pos = offset;
+        eeprom_pos = (uint16_t)offset;
         retval = FROGFS_ERR_OK;
     }
 
@@ -160,6 +160,75 @@ t_e_frogfs_error storage_write(const uint8_t *data, uint16_t size)
     return retval;
 }
 
+t_e_frogfs_error storage_read_at(t_frogfs_offset offset, uint8_t *data, uint16_t size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+
+    NULL_PTR_CHECK_RETURN(data);
+
+    if (((uint32_t)offset + (uint32_t)size) <= (uint32_t)EEPROM_SIZE)
+    {
+        eeprom_read_block(data, (void*)(uint16_t)offset, size);
+        retval = FROGFS_ERR_OK;
+    }
+    else
+    {
+        /* Out of physical storage */
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_write_at(t_frogfs_offset offset, const uint8_t *data, uint16_t size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+
+    NULL_PTR_CHECK_RETURN(data);
+
+    if (((uint32_t)offset + (uint32_t)size) <= (uint32_t)EEPROM_SIZE)
+    {
+        eeprom_write_block(data, (void*)(uint16_t)offset, size);
+        retval = FROGFS_ERR_OK;
+    }
+    else
+    {
+        /* Out of physical storage */
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_fill(t_frogfs_offset offset, uint8_t value, t_frogfs_offset size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    uint8_t buffer[16];
+    uint16_t chunk;
+
+    if (((uint32_t)offset + (uint32_t)size) <= (uint32_t)EEPROM_SIZE)
+    {
+        (void)memset(buffer, value, sizeof(buffer));
+
+        while (size > 0)
+        {
+            chunk = (size < sizeof(buffer)) ? (uint16_t)size : (uint16_t)sizeof(buffer);
+            /* Update: cells already holding the value are not written (no wear, no write time) */
+            eeprom_update_block(buffer, (void*)(uint16_t)offset, chunk);
+            offset += chunk;
+            size -= chunk;
+        }
+        retval = FROGFS_ERR_OK;
+    }
+    else
+    {
+        /* Out of physical storage */
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    return retval;
+}
+
 void storage_sync(void)
 {
     /* Nothing to do */
@@ -171,4 +240,52 @@ t_e_frogfs_error storage_close(void)
     return FROGFS_ERR_OK;
 }
 
+/* The EEPROM is the only instance: the context is not used */
+
+static t_frogfs_offset avr_eeprom_storage_size(void *context)
+{
+    (void)context;
+    return storage_size();
+}
+
+static t_e_frogfs_error avr_eeprom_storage_read_at(void *context, t_frogfs_offset offset, uint8_t *data, uint16_t size)
+{
+    (void)context;
+    return storage_read_at(offset, data, size);
+}
+
+static t_e_frogfs_error avr_eeprom_storage_write_at(void *context, t_frogfs_offset offset, const uint8_t *data, uint16_t size)
+{
+    (void)context;
+    return storage_write_at(offset, data, size);
+}
+
+static t_e_frogfs_error avr_eeprom_storage_fill(void *context, t_frogfs_offset offset, uint8_t value, t_frogfs_offset size)
+{
+    (void)context;
+    return storage_fill(offset, value, size);
+}
+
+static void avr_eeprom_storage_sync(void *context)
+{
+    (void)context;
+    storage_sync();
+}
+
+static t_e_frogfs_error avr_eeprom_storage_close(void *context)
+{
+    (void)context;
+    return storage_close();
+}
+
+const t_s_storage_ops avr_eeprom_storage_ops =
+{
+    avr_eeprom_storage_size,
+    avr_eeprom_storage_read_at,
+    avr_eeprom_storage_write_at,
+    avr_eeprom_storage_fill,
+    avr_eeprom_storage_sync,
+    avr_eeprom_storage_close
+};
+
 #endif
@@ -0,0 +1,451 @@
+/*
+ *  Project     FrogFS
+ *  @author     Lorenzo Miori
+ *  @license    MIT - Copyright (c) 2019 Lorenzo Miori
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the \"Software\"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED \"AS IS\", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* Write-back block cache between the filesystem and the storage backend.
+ * The storage is split in blocks of FROGFS_CACHE_BLOCK_SIZE bytes; up to
+ * FROGFS_CACHE_BLOCK_COUNT of them are kept in RAM and replaced in LRU order.
+ * Whole-block accesses that miss the cache go directly to the storage, so that
+ * large reads and writes do not evict the small, frequently accessed blocks
+ * (record headers, checkpoint). */
+
+#include "storage_cache.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(FROGFS_USE_CACHE) && defined(FROGFS_USE_LOCKING)
+#define STORAGE_CACHE_LOCK(cache)       ((void)pthread_mutex_lock(&(cache)->lock))
+#define STORAGE_CACHE_UNLOCK(cache)     ((void)pthread_mutex_unlock(&(cache)->lock))
+#else
+#define STORAGE_CACHE_LOCK(cache)
+#define STORAGE_CACHE_UNLOCK(cache)
+#endif
+
+void storage_cache_init(t_s_storage_cache *cache, const t_s_storage_ops *ops, void *context)
+{
+    (void)memset(cache, 0, sizeof(*cache));
+    cache->storage.ops = ops;
+    cache->storage.context = context;
+#if defined(FROGFS_USE_CACHE) && defined(FROGFS_USE_LOCKING)
+    (void)pthread_mutex_init(&cache->lock, NULL);
+#endif
+}
+
+void storage_cache_release(t_s_storage_cache *cache)
+{
+#if defined(FROGFS_USE_CACHE) && defined(FROGFS_USE_LOCKING)
+    (void)pthread_mutex_destroy(&cache->lock);
+#else
+    (void)cache;
+#endif
+}
+
+#ifdef FROGFS_USE_CACHE
+
+#define STORAGE_CACHE_VALID     (0x01U)
+#define STORAGE_CACHE_DIRTY     (0x02U)
+
+/**
+ * Size of the given block: the last block is shorter if the storage size
+ * is not a multiple of the block size.
+ */
+static uint16_t storage_cache_block_len(t_s_storage_cache *cache, t_frogfs_offset block)
+{
+    uint32_t start = (uint32_t)block * FROGFS_CACHE_BLOCK_SIZE;
+    uint32_t len = (uint32_t)storage_cache_size(cache) - start;
+
+    if (len > FROGFS_CACHE_BLOCK_SIZE)
+    {
+        len = FROGFS_CACHE_BLOCK_SIZE;
+    }
+
+    return (uint16_t)len;
+}
+
+static void storage_cache_touch(t_s_storage_cache *cache, uint8_t line)
+{
+    uint8_t i;
+
+    for (i = 0; i < FROGFS_CACHE_BLOCK_COUNT; i++)
+    {
+        if (cache->lines[i].age < UINT8_MAX)
+        {
+            cache->lines[i].age++;
+        }
+    }
+    cache->lines[line].age = 0U;
+}
+
+static t_e_frogfs_error storage_cache_writeback(t_s_storage_cache *cache, uint8_t line)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    t_s_storage_cache_line *l = &cache->lines[line];
+
+    if ((l->flags & STORAGE_CACHE_DIRTY) != 0U)
+    {
+        retval = cache->storage.ops->write_at(cache->storage.context, (t_frogfs_offset)(l->block * FROGFS_CACHE_BLOCK_SIZE),
+                                              l->data, storage_cache_block_len(cache, l->block));
+        if (retval == FROGFS_ERR_OK)
+        {
+            l->flags &= (uint8_t)~STORAGE_CACHE_DIRTY;
+            cache->stats.writebacks++;
+        }
+    }
+
+    return retval;
+}
+
+/**
+ * Write back, oldest first, the dirty blocks that became dirty up to the given order.
+ * The writes of a dirty block all come after the ones of the blocks that became dirty
+ * before it (see storage_cache_access): the storage goes through the same states as
+ * without the cache, e.g. a block header reaches it before the data it covers.
+ */
+static t_e_frogfs_error storage_cache_writeback_upto(t_s_storage_cache *cache, uint32_t dirty_seq)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    uint8_t oldest;
+    uint8_t i;
+
+    do
+    {
+        oldest = FROGFS_CACHE_BLOCK_COUNT;
+        for (i = 0; i < FROGFS_CACHE_BLOCK_COUNT; i++)
+        {
+            if (((cache->lines[i].flags & STORAGE_CACHE_DIRTY) != 0U) && (cache->lines[i].dirty_seq <= dirty_seq) &&
+                ((oldest >= FROGFS_CACHE_BLOCK_COUNT) || (cache->lines[i].dirty_seq < cache->lines[oldest].dirty_seq)))
+            {
+                oldest = i;
+            }
+        }
+
+        if (oldest < FROGFS_CACHE_BLOCK_COUNT)
+        {
+            retval = storage_cache_writeback(cache, oldest);
+        }
+    } while ((retval == FROGFS_ERR_OK) && (oldest < FROGFS_CACHE_BLOCK_COUNT));
+
+    return retval;
+}
+
+/**
+ * Look for the given block in the cache.
+ * @return the line index or FROGFS_CACHE_BLOCK_COUNT if not cached
+ */
+static uint8_t storage_cache_find(t_s_storage_cache *cache, t_frogfs_offset block)
+{
+    uint8_t i;
+
+    for (i = 0; i < FROGFS_CACHE_BLOCK_COUNT; i++)
+    {
+        if (((cache->lines[i].flags & STORAGE_CACHE_VALID) != 0U) &&
+            (cache->lines[i].block == block))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/**
+ * Bring the given block in the cache, evicting the least recently used one.
+ */
+static t_e_frogfs_error storage_cache_load(t_s_storage_cache *cache, t_frogfs_offset block, uint8_t *line)
+{
+    t_e_frogfs_error retval;
+    uint8_t victim = 0U;
+    uint8_t i;
+
+    for (i = 0; i < FROGFS_CACHE_BLOCK_COUNT; i++)
+    {
+        if ((cache->lines[i].flags & STORAGE_CACHE_VALID) == 0U)
+        {
+            victim = i;
+            break;
+        }
+        if (cache->lines[i].age > cache->lines[victim].age)
+        {
+            victim = i;
+        }
+    }
+
+    if ((cache->lines[victim].flags & STORAGE_CACHE_DIRTY) != 0U)
+    {
+        retval = storage_cache_writeback_upto(cache, cache->lines[victim].dirty_seq);
+    }
+    else
+    {
+        retval = FROGFS_ERR_OK;
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        cache->lines[victim].flags = 0U;
+        retval = cache->storage.ops->read_at(cache->storage.context, (t_frogfs_offset)(block * FROGFS_CACHE_BLOCK_SIZE),
+                                             cache->lines[victim].data, storage_cache_block_len(cache, block));
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        cache->lines[victim].block = block;
+        cache->lines[victim].flags = STORAGE_CACHE_VALID;
+        *line = victim;
+    }
+
+    return retval;
+}
+
+/**
+ * Common access loop: split the access in blocks and copy from/to the cache.
+ */
+static t_e_frogfs_error storage_cache_access(t_s_storage_cache *cache, t_frogfs_offset offset, uint8_t *rdata,
+                                             const uint8_t *wdata, uint16_t size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_OK;
+    t_frogfs_offset block;
+    uint16_t block_offset;
+    uint16_t chunk;
+    uint8_t line;
+
+    if (((uint32_t)offset + size) > storage_cache_size(cache))
+    {
+        /* Out of space */
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    while ((retval == FROGFS_ERR_OK) && (size > 0U))
+    {
+        block = (t_frogfs_offset)(offset / FROGFS_CACHE_BLOCK_SIZE);
+        block_offset = (uint16_t)(offset % FROGFS_CACHE_BLOCK_SIZE);
+        chunk = (uint16_t)(FROGFS_CACHE_BLOCK_SIZE - block_offset);
+        if (chunk > size)
+        {
+            chunk = size;
+        }
+
+        line = storage_cache_find(cache, block);
+        if (line < FROGFS_CACHE_BLOCK_COUNT)
+        {
+            cache->stats.hits++;
+        }
+        else
+        {
+            cache->stats.misses++;
+
+            if (chunk == FROGFS_CACHE_BLOCK_SIZE)
+            {
+                /* Whole block not cached: bypass the cache */
+                if (rdata != NULL)
+                {
+                    retval = cache->storage.ops->read_at(cache->storage.context, offset, rdata, chunk);
+                }
+                else
+                {
+                    /* After the blocks written before */
+                    retval = storage_cache_writeback_upto(cache, cache->dirty_seq);
+                    if (retval == FROGFS_ERR_OK)
+                    {
+                        retval = cache->storage.ops->write_at(cache->storage.context, offset, wdata, chunk);
+                    }
+                }
+            }
+            else
+            {
+                retval = storage_cache_load(cache, block, &line);
+            }
+        }
+
+        if ((retval == FROGFS_ERR_OK) && (line < FROGFS_CACHE_BLOCK_COUNT))
+        {
+            if (rdata != NULL)
+            {
+                (void)memcpy(rdata, &cache->lines[line].data[block_offset], chunk);
+            }
+            else
+            {
+                if (((cache->lines[line].flags & STORAGE_CACHE_DIRTY) != 0U) && (cache->lines[line].dirty_seq != cache->dirty_seq))
+                {
+                    /* Blocks have become dirty since this one: they go first, so that the
+                     * writes of every dirty block stay after the ones of the older blocks */
+                    retval = storage_cache_writeback_upto(cache, cache->dirty_seq);
+                }
+
+                if (retval == FROGFS_ERR_OK)
+                {
+                    (void)memcpy(&cache->lines[line].data[block_offset], wdata, chunk);
+                    if ((cache->lines[line].flags & STORAGE_CACHE_DIRTY) == 0U)
+                    {
+                        cache->dirty_seq++;
+                        cache->lines[line].dirty_seq = cache->dirty_seq;
+                        cache->lines[line].flags |= STORAGE_CACHE_DIRTY;
+                    }
+                }
+            }
+            storage_cache_touch(cache, line);
+        }
+
+        if (rdata != NULL)
+        {
+            rdata += chunk;
+        }
+        else
+        {
+            wdata += chunk;
+        }
+        offset += chunk;
+        size -= chunk;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_cache_read_at(t_s_storage_cache *cache, t_frogfs_offset offset, uint8_t *data, uint16_t size)
+{
+    t_e_frogfs_error retval;
+
+    if (data == NULL) return FROGFS_ERR_NULL_POINTER;
+
+    STORAGE_CACHE_LOCK(cache);
+    retval = storage_cache_access(cache, offset, data, NULL, size);
+    STORAGE_CACHE_UNLOCK(cache);
+
+    return retval;
+}
+
+t_e_frogfs_error storage_cache_write_at(t_s_storage_cache *cache, t_frogfs_offset offset, const uint8_t *data, uint16_t size)
+{
+    t_e_frogfs_error retval;
+
+    if (data == NULL) return FROGFS_ERR_NULL_POINTER;
+
+    STORAGE_CACHE_LOCK(cache);
+    retval = storage_cache_access(cache, offset, NULL, data, size);
+    STORAGE_CACHE_UNLOCK(cache);
+
+    return retval;
+}
+
+t_e_frogfs_error storage_cache_fill(t_s_storage_cache *cache, t_frogfs_offset offset, uint8_t value, t_frogfs_offset size)
+{
+    t_e_frogfs_error retval;
+    uint32_t start;
+    uint32_t end;
+    uint32_t line_start;
+    uint32_t line_end;
+    uint8_t i;
+
+    STORAGE_CACHE_LOCK(cache);
+
+    /* After the blocks written before */
+    retval = storage_cache_writeback_upto(cache, cache->dirty_seq);
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        retval = cache->storage.ops->fill(cache->storage.context, offset, value, size);
+    }
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        /* Keep the cached copies (all clean now) coherent */
+        start = offset;
+        end = (uint32_t)offset + size;
+
+        for (i = 0; i < FROGFS_CACHE_BLOCK_COUNT; i++)
+        {
+            if ((cache->lines[i].flags & STORAGE_CACHE_VALID) != 0U)
+            {
+                line_start = (uint32_t)cache->lines[i].block * FROGFS_CACHE_BLOCK_SIZE;
+                line_end = line_start + FROGFS_CACHE_BLOCK_SIZE;
+
+                if ((start < line_end) && (end > line_start))
+                {
+                    line_start = (start > line_start) ? start : line_start;
+                    line_end = (end < line_end) ? end : line_end;
+                    (void)memset(&cache->lines[i].data[line_start % FROGFS_CACHE_BLOCK_SIZE], value,
+                                 (size_t)(line_end - line_start));
+                }
+            }
+        }
+    }
+
+    STORAGE_CACHE_UNLOCK(cache);
+
+    return retval;
+}
+
+t_e_frogfs_error storage_cache_flush(t_s_storage_cache *cache)
+{
+    t_e_frogfs_error retval;
+
+    STORAGE_CACHE_LOCK(cache);
+
+    retval = storage_cache_writeback_upto(cache, cache->dirty_seq);
+
+    STORAGE_CACHE_UNLOCK(cache);
+
+    return retval;
+}
+
+void storage_cache_sync(t_s_storage_cache *cache)
+{
+    (void)storage_cache_flush(cache);
+    cache->storage.ops->sync(cache->storage.context);
+}
+
+t_e_frogfs_error storage_cache_close(t_s_storage_cache *cache)
+{
+    t_e_frogfs_error retval;
+
+    retval = storage_cache_flush(cache);
+
+    /* Drop the content anyway: the storage is going away */
+    STORAGE_CACHE_LOCK(cache);
+    (void)memset(cache->lines, 0, sizeof(cache->lines));
+    STORAGE_CACHE_UNLOCK(cache);
+
+    if (retval == FROGFS_ERR_OK)
+    {
+        retval = cache->storage.ops->close(cache->storage.context);
+    }
+
+    return retval;
+}
+
+void storage_cache_get_stats(const t_s_storage_cache *cache, t_s_storage_cache_stats *stats)
+{
+    if (stats != NULL)
+    {
+        *stats = cache->stats;
+    }
+}
+
+void storage_cache_reset_stats(t_s_storage_cache *cache)
+{
+    (void)memset(&cache->stats, 0, sizeof(cache->stats));
+}
+
+#endif /* FROGFS_USE_CACHE */
@@ -0,0 +1,133 @@
+/*
+ *  Project     FrogFS
+ *  @author     Lorenzo Miori
+ *  @license    MIT - Copyright (c) 2019 Lorenzo Miori
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the \"Software\"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED \"AS IS\", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef STORAGE_CACHE_H_
+#define STORAGE_CACHE_H_
+
+#include "storage/storage_api.h"
+#include "frogfs_enums.h"
+#include "frogfs_config.h"
+
+#include <stdint.h>
+
+#if defined(FROGFS_USE_CACHE) && defined(FROGFS_USE_LOCKING)
+#include <pthread.h>
+#endif
+
+#ifdef FROGFS_USE_CACHE
+
+/** Cache usage counters, one lookup per cache block touched by an access */
+typedef struct
+{
+    uint32_t hits;          /**< Block found in the cache */
+    uint32_t misses;        /**< Block not in the cache (loaded, or accessed directly for whole blocks) */
+    uint32_t writebacks;    /**< Dirty blocks written to the storage */
+} t_s_storage_cache_stats;
+
+typedef struct
+{
+    t_frogfs_offset block;                      /**< Block number on the storage */
+    uint8_t flags;                              /**< STORAGE_CACHE_VALID | STORAGE_CACHE_DIRTY */
+    uint8_t age;                                /**< Accesses to other blocks since the last use */
+    uint32_t dirty_seq;                         /**< When the block became dirty (see dirty_seq of the cache) */
+    uint8_t data[FROGFS_CACHE_BLOCK_SIZE];
+} t_s_storage_cache_line;
+
+#endif /* FROGFS_USE_CACHE */
+
+/** A storage accessed through the cache (directly if FROGFS_USE_CACHE is not defined) */
+typedef struct
+{
+    t_s_storage storage;                        /**< The cached storage */
+#ifdef FROGFS_USE_CACHE
+    t_s_storage_cache_line lines[FROGFS_CACHE_BLOCK_COUNT];
+    t_s_storage_cache_stats stats;
+    uint32_t dirty_seq;                         /**< Counter of the blocks made dirty: the dirty blocks are
+                                                     written back in that order */
+#ifdef FROGFS_USE_LOCKING
+    pthread_mutex_t lock;                       /**< Serializes the accesses to the lines */
+#endif
+#endif
+} t_s_storage_cache;
+
+/**
+ * Set up an empty cache on top of the given storage instance.
+ */
+void storage_cache_init(t_s_storage_cache *cache, const t_s_storage_ops *ops, void *context);
+
+/**
+ * Release the resources of the cache. The storage is not closed.
+ */
+void storage_cache_release(t_s_storage_cache *cache);
+
+#ifdef FROGFS_USE_CACHE
+
+/**
+ * Write-back block cache on top of a storage instance. Same semantics as the
+ * storage_*_at functions, but repeated small accesses to the same block only
+ * hit the storage when the block is evicted or flushed.
+ */
+t_e_frogfs_error storage_cache_read_at(t_s_storage_cache *cache, t_frogfs_offset offset, uint8_t *data, uint16_t size);
+t_e_frogfs_error storage_cache_write_at(t_s_storage_cache *cache, t_frogfs_offset offset, const uint8_t *data, uint16_t size);
+
+/**
+ * Fill is written through to the storage; cached copies are updated.
+ */
+t_e_frogfs_error storage_cache_fill(t_s_storage_cache *cache, t_frogfs_offset offset, uint8_t value, t_frogfs_offset size);
+
+/**
+ * Write all the dirty blocks to the storage. The blocks stay cached.
+ */
+t_e_frogfs_error storage_cache_flush(t_s_storage_cache *cache);
+
+/**
+ * Flush the cache, then sync the storage.
+ */
+void storage_cache_sync(t_s_storage_cache *cache);
+
+/**
+ * Flush and drop the cache, then close the storage.
+ */
+t_e_frogfs_error storage_cache_close(t_s_storage_cache *cache);
+
+void storage_cache_get_stats(const t_s_storage_cache *cache, t_s_storage_cache_stats *stats);
+void storage_cache_reset_stats(t_s_storage_cache *cache);
+
+#else
+
+/* No cache: direct storage access */
+#define storage_cache_read_at(cache, offset, data, size)    ((cache)->storage.ops->read_at((cache)->storage.context, (offset), (data), (size)))
+#define storage_cache_write_at(cache, offset, data, size)   ((cache)->storage.ops->write_at((cache)->storage.context, (offset), (data), (size)))
+#define storage_cache_fill(cache, offset, value, size)      ((cache)->storage.ops->fill((cache)->storage.context, (offset), (value), (size)))
+#define storage_cache_flush(cache)                          (FROGFS_ERR_OK)
+#define storage_cache_sync(cache)                           ((cache)->storage.ops->sync((cache)->storage.context))
+#define storage_cache_close(cache)                          ((cache)->storage.ops->close((cache)->storage.context))
+
+#endif /* FROGFS_USE_CACHE */
+
+/** Size of the cached storage */
+#define storage_cache_size(cache)                           ((cache)->storage.ops->size((cache)->storage.context))
+
+#endif /* STORAGE_CACHE_H_ */
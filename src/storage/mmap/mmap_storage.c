@@ -0,0 +1,379 @@
+/*
+ *  Project     FrogFS
+ *  @author     Lorenzo Miori
+ *  @license    MIT - Copyright (c) 2019 Lorenzo Miori
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the \"Software\"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED \"AS IS\", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* Memory mapped storage backend for hosted (POSIX) platforms.
+ * Build with FROGFS_STORAGE_MMAP defined to use it instead of the stdio backend. */
+
+#if defined(FROGFS_STORAGE_MMAP) && !defined(__AVR__)
+
+#include "mmap_storage.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define NULL_PTR_CHECK_RETURN(handle)  do              \
+                                       {               \
+                                           if (handle == NULL) return FROGFS_ERR_NULL_POINTER; \
+                                       } while(0);     \
+
+/** The instance used by the storage_* functions and by the operations given a NULL context */
+static t_s_mmap_storage mmap_storage_default = { NULL, -1, 0, 0 };
+
+static t_s_mmap_storage *mmap_storage_instance(void *context)
+{
+    return (context != NULL) ? (t_s_mmap_storage*)context : &mmap_storage_default;
+}
+
+static void mmap_storage_unmap(t_s_mmap_storage *storage)
+{
+    if (storage->image != NULL)
+    {
+        (void)munmap(storage->image, storage->size);
+        storage->image = NULL;
+    }
+
+    if (storage->fd != -1)
+    {
+        (void)close(storage->fd);
+        storage->fd = -1;
+    }
+
+    storage->size = 0;
+    storage->pos = 0;
+}
+
+void mmap_storage_open(t_s_mmap_storage *storage, const char *storage_filename, t_frogfs_offset storage_size)
+{
+    struct stat st;
+    void *image;
+    bool create = (storage_size > 0) ? true : false;
+
+    storage->image = NULL;
+    storage->size = 0;
+    storage->pos = 0;
+
+    storage->fd = open(storage_filename, create ? (O_RDWR | O_CREAT) : O_RDWR, 0644);
+    if (storage->fd == -1)
+    {
+        printf("Could not open eeprom file: %s\n", storage_filename);
+        return;
+    }
+
+    if (create == true)
+    {
+        /* Grow (zero filled) or shrink the file to the emulated size */
+        if (ftruncate(storage->fd, (off_t)storage_size) != 0)
+        {
+            printf("Could not resize eeprom file: %s\n", storage_filename);
+            mmap_storage_unmap(storage);
+            return;
+        }
+    }
+    else
+    {
+        /* Read the emulated size from the file itself */
+        if ((fstat(storage->fd, &st) != 0) || (st.st_size > FROGFS_OFFSET_MAX))
+        {
+            printf("Invalid eeprom file: %s\n", storage_filename);
+            mmap_storage_unmap(storage);
+            return;
+        }
+        storage_size = (t_frogfs_offset)st.st_size;
+    }
+
+    if (storage_size > 0)
+    {
+        image = mmap(NULL, storage_size, PROT_READ | PROT_WRITE, MAP_SHARED, storage->fd, 0);
+        if (image == MAP_FAILED)
+        {
+            printf("Could not map eeprom file: %s\n", storage_filename);
+            mmap_storage_unmap(storage);
+            return;
+        }
+        storage->image = (uint8_t*)image;
+    }
+
+    storage->size = storage_size;
+}
+
+void mmap_storage_set_file(const char *storage_filename)
+{
+    mmap_storage_unmap(&mmap_storage_default);
+    mmap_storage_open(&mmap_storage_default, storage_filename, 0);
+}
+
+void mmap_storage_set_size(t_frogfs_offset storage_size)
+{
+    mmap_storage_unmap(&mmap_storage_default);
+    mmap_storage_open(&mmap_storage_default, "eeprom.bin", storage_size);
+}
+
+static t_frogfs_offset mmap_storage_size(void *context)
+{
+    return mmap_storage_instance(context)->size;
+}
+
+t_frogfs_offset storage_size(void)
+{
+    return mmap_storage_default.size;
+}
+
+t_e_frogfs_error storage_advance(t_frogfs_offset size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+
+    NULL_PTR_CHECK_RETURN(mmap_storage_default.image);
+
+    if (((uint32_t)mmap_storage_default.pos + size) <= mmap_storage_default.size)
+    {
+        mmap_storage_default.pos += size;
+        retval = FROGFS_ERR_OK;
+    }
+    else
+    {
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_backtrack(t_frogfs_offset size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+
+    NULL_PTR_CHECK_RETURN(mmap_storage_default.image);
+
+    if (mmap_storage_default.pos >= size)
+    {
+        mmap_storage_default.pos -= size;
+        retval = FROGFS_ERR_OK;
+    }
+    else
+    {
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_pos(t_frogfs_offset *offset)
+{
+    NULL_PTR_CHECK_RETURN(offset);
+    NULL_PTR_CHECK_RETURN(mmap_storage_default.image);
+
+    *offset = mmap_storage_default.pos;
+
+    return FROGFS_ERR_OK;
+}
+
+t_e_frogfs_error storage_end_of_storage(void)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+
+    if ((mmap_storage_default.size == 0) || (mmap_storage_default.pos == (mmap_storage_default.size - 1)))
+    {
+        retval = FROGFS_ERR_OK;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_seek(t_frogfs_offset offset)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+
+    NULL_PTR_CHECK_RETURN(mmap_storage_default.image);
+
+    if (offset <= mmap_storage_default.size)
+    {
+        mmap_storage_default.pos = offset;
+        retval = FROGFS_ERR_OK;
+    }
+
+    return retval;
+}
+
+static t_e_frogfs_error mmap_storage_read_at(void *context, t_frogfs_offset offset, uint8_t *data, uint16_t size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    t_s_mmap_storage *storage = mmap_storage_instance(context);
+
+    NULL_PTR_CHECK_RETURN(data);
+    NULL_PTR_CHECK_RETURN(storage->image);
+
+    if (((uint32_t)offset + size) <= storage->size)
+    {
+        (void)memcpy(data, &storage->image[offset], size);
+        retval = FROGFS_ERR_OK;
+    }
+    else
+    {
+        /* Out of space */
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_read_at(t_frogfs_offset offset, uint8_t *data, uint16_t size)
+{
+    return mmap_storage_read_at(NULL, offset, data, size);
+}
+
+static t_e_frogfs_error mmap_storage_write_at(void *context, t_frogfs_offset offset, const uint8_t *data, uint16_t size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    t_s_mmap_storage *storage = mmap_storage_instance(context);
+
+    NULL_PTR_CHECK_RETURN(data);
+    NULL_PTR_CHECK_RETURN(storage->image);
+
+    if (((uint32_t)offset + size) <= storage->size)
+    {
+        (void)memcpy(&storage->image[offset], data, size);
+        retval = FROGFS_ERR_OK;
+    }
+    else
+    {
+        /* Out of space */
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_write_at(t_frogfs_offset offset, const uint8_t *data, uint16_t size)
+{
+    return mmap_storage_write_at(NULL, offset, data, size);
+}
+
+static t_e_frogfs_error mmap_storage_fill(void *context, t_frogfs_offset offset, uint8_t value, t_frogfs_offset size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    t_s_mmap_storage *storage = mmap_storage_instance(context);
+
+    NULL_PTR_CHECK_RETURN(storage->image);
+
+    if (((uint32_t)offset + size) <= storage->size)
+    {
+        (void)memset(&storage->image[offset], value, size);
+        retval = FROGFS_ERR_OK;
+    }
+    else
+    {
+        /* Out of space */
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_fill(t_frogfs_offset offset, uint8_t value, t_frogfs_offset size)
+{
+    return mmap_storage_fill(NULL, offset, value, size);
+}
+
+t_e_frogfs_error storage_read(uint8_t *data, uint16_t size)
+{
+    t_e_frogfs_error retval;
+
+    retval = storage_read_at(mmap_storage_default.pos, data, size);
+    if (retval == FROGFS_ERR_OK)
+    {
+        mmap_storage_default.pos += size;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_write(const uint8_t *data, uint16_t size)
+{
+    t_e_frogfs_error retval;
+
+    retval = storage_write_at(mmap_storage_default.pos, data, size);
+    if (retval == FROGFS_ERR_OK)
+    {
+        mmap_storage_default.pos += size;
+    }
+
+    return retval;
+}
+
+static void mmap_storage_sync(void *context)
+{
+    t_s_mmap_storage *storage = mmap_storage_instance(context);
+
+    if (storage->image != NULL)
+    {
+        (void)msync(storage->image, storage->size, MS_SYNC);
+    }
+}
+
+void storage_sync(void)
+{
+    mmap_storage_sync(NULL);
+}
+
+static t_e_frogfs_error mmap_storage_close(void *context)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    t_s_mmap_storage *storage = mmap_storage_instance(context);
+
+    if (storage->fd != -1)
+    {
+        if ((storage->image == NULL) || (msync(storage->image, storage->size, MS_SYNC) == 0))
+        {
+            retval = FROGFS_ERR_OK;
+        }
+        mmap_storage_unmap(storage);
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_close(void)
+{
+    return mmap_storage_close(NULL);
+}
+
+const t_s_storage_ops mmap_storage_ops =
+{
+    mmap_storage_size,
+    mmap_storage_read_at,
+    mmap_storage_write_at,
+    mmap_storage_fill,
+    mmap_storage_sync,
+    mmap_storage_close
+};
+
+#endif
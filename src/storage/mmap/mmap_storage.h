@@ -0,0 +1,69 @@
+/*
+ *  Project     FrogFS
+ *  @author     Lorenzo Miori
+ *  @license    MIT - Copyright (c) 2019 Lorenzo Miori
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the \"Software\"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED \"AS IS\", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef STORAGE_MMAP_H_
+#define STORAGE_MMAP_H_
+
+#include "storage/storage_api.h"
+#include "frogfs_enums.h"
+
+#include <stdint.h>
+
+/** A memory mapped file emulating a storage */
+typedef struct
+{
+    uint8_t *image;         /**< The mapped file, NULL if not mapped */
+    int fd;                 /**< The open file, -1 if not open */
+    t_frogfs_offset size;   /**< The emulated size */
+    t_frogfs_offset pos;    /**< Position of the storage_* cursor functions */
+} t_s_mmap_storage;
+
+/** Storage operations on a t_s_mmap_storage (NULL context: the default instance) */
+extern const t_s_storage_ops mmap_storage_ops;
+
+/**
+ * Open and map the given file as storage emulation.
+ * @param storage           the instance to open
+ * @param storage_filename
+ * @param storage_size      the size of the emulated storage (the file is created or resized),
+ *                          0 to use the size of the file
+ */
+void mmap_storage_open(t_s_mmap_storage *storage, const char *storage_filename, t_frogfs_offset storage_size);
+
+/**
+ * Set and use the given file as storage emulation (default instance).
+ * The file is mapped in memory: reads and writes are plain copies from/to the image.
+ * @param storage_filename
+ */
+void mmap_storage_set_file(const char *storage_filename);
+
+/**
+ * Initialize the storage by giving a file size (default instance).
+ * The file "eeprom.bin" is generated (or resized) and mapped in memory.
+ * @param storage_size  the size of the emulated storage
+ */
+void mmap_storage_set_size(t_frogfs_offset storage_size);
+
+#endif /* STORAGE_MMAP_H_ */
@@ -22,6 +22,8 @@
  * THE SOFTWARE.
  *
  */
+/* The stdio backend is replaced by the memory mapped one when FROGFS_STORAGE_MMAP is defined */
+#ifndef FROGFS_STORAGE_MMAP
 
 #include "file_storage.h"
 
@@ -31,92 +33,117 @@
 #include <stdbool.h>
 #include <string.h>
 
-uint8_t *eeprom_image = NULL;
-FILE *eeprom_handle = NULL;
-
 #define NULL_PTR_CHECK_RETURN(handle)  do              \
                                                 {               \
                                                     if (handle == NULL) return FROGFS_ERR_NULL_POINTER; \
                                                 } while(0);     \
 
-static uint16_t file_storage_size = 0;
+#ifdef FROGFS_USE_LOCKING
+#define FILE_STORAGE_LOCK(storage)      flockfile((storage)->handle)
+#define FILE_STORAGE_UNLOCK(storage)    funlockfile((storage)->handle)
+#else
+#define FILE_STORAGE_LOCK(storage)
+#define FILE_STORAGE_UNLOCK(storage)
+#endif
+
+/** The instance used by the storage_* functions and by the operations given a NULL context */
+static t_s_file_storage file_storage_default = { NULL, 0 };
 
-static void file_storage_create(void)
+static t_s_file_storage *file_storage_instance(void *context)
 {
-    eeprom_handle = fopen("eeprom.bin", "r+");
-    if (eeprom_handle == NULL)
+    return (context != NULL) ? (t_s_file_storage*)context : &file_storage_default;
+}
+
+static void file_storage_create(const char *storage_filename, t_frogfs_offset storage_size)
+{
+    FILE *handle;
+    uint8_t buffer[64];
+    uint16_t chunk;
+
+    printf("EEPROM file not found. Creating %u bytes EEPROM\r\n", (unsigned int)storage_size);
+    handle = fopen(storage_filename, "w");
+    if (handle == NULL)
     {
-        printf("EEPROM file not found. Creating 4KB EEPROM\r\n");
-        eeprom_handle = fopen("eeprom.bin", "w");
-        if (eeprom_handle == NULL)
-        {
-            printf("Could not create EEPROM file\r\n");
-            exit(1);
-        }
-        else
+        printf("Could not create EEPROM file\r\n");
+        exit(1);
+    }
+    else
+    {
+        (void)memset(buffer, 0, sizeof(buffer));
+        while (storage_size > 0)
         {
-            (void)memset(eeprom_image, 0, file_storage_size);
-            (void)fwrite(eeprom_image, 1, file_storage_size, eeprom_handle);
-            (void)fclose(eeprom_handle);
+            chunk = (storage_size < sizeof(buffer)) ? (uint16_t)storage_size : (uint16_t)sizeof(buffer);
+            (void)fwrite(buffer, 1, chunk, handle);
+            storage_size -= chunk;
         }
-        eeprom_handle = fopen("eeprom.bin", "r+");
+        (void)fclose(handle);
     }
 }
 
-void file_storage_set_file(char *storage_filename)
+void file_storage_open(t_s_file_storage *storage, const char *storage_filename, t_frogfs_offset storage_size)
 {
     int fretval = -1;
 
-    file_storage_size = 0;
+    storage->size = 0;
+
+    storage->handle = fopen(storage_filename, "r+");
+    if ((storage->handle == NULL) && (storage_size > 0))
+    {
+        file_storage_create(storage_filename, storage_size);
+        storage->handle = fopen(storage_filename, "r+");
+    }
 
-    eeprom_handle = fopen(storage_filename, "r+");
-    if (eeprom_handle == NULL)
+    if (storage->handle == NULL)
     {
         printf("Could not open eeprom file: %s\n", storage_filename);
     }
+    else if (storage_size > 0)
+    {
+        /* Set the new internal storage size */
+        storage->size = storage_size;
+    }
     else
     {
         /* Read the emulated size from the file itself */
-        (void)fseek(eeprom_handle, 0, SEEK_END);
-        fretval = ftell(eeprom_handle);
+        (void)fseek(storage->handle, 0, SEEK_END);
+        fretval = ftell(storage->handle);
 
         if (fretval != -1)
         {
-            file_storage_size = (uint16_t)fretval;
+            storage->size = (t_frogfs_offset)fretval;
         }
     }
 }
 
-void file_storage_set_size(uint16_t storage_size)
+void file_storage_set_file(char *storage_filename)
 {
-    /* Set the new internal storage size */
-    file_storage_size = storage_size;
+    file_storage_open(&file_storage_default, storage_filename, 0);
+}
 
-    /* Check if a buffer had been previously allocated */
-    if (eeprom_image != NULL)
-    {
-        /* deallocate previous buffer */
-        free(eeprom_image);
-    }
-    /* create a new buffer */
-    eeprom_image = malloc(file_storage_size);
+void file_storage_set_size(t_frogfs_offset storage_size)
+{
     /* allocate the physical storage */
-    file_storage_create();
+    file_storage_open(&file_storage_default, "eeprom.bin", storage_size);
+}
+
+static t_frogfs_offset file_storage_size(void *context)
+{
+    return file_storage_instance(context)->size;
 }
 
-uint16_t storage_size(void)
+t_frogfs_offset storage_size(void)
 {
-    return file_storage_size;
+    return file_storage_default.size;
 }
 
-t_e_frogfs_error storage_advance(uint16_t size)
+t_e_frogfs_error storage_advance(t_frogfs_offset size)
 {
     t_e_frogfs_error retval = FROGFS_ERR_IO;
     int fretval;
 
-    NULL_PTR_CHECK_RETURN(eeprom_handle);
+    NULL_PTR_CHECK_RETURN(file_storage_default.handle);
 
-    fretval = fseek(eeprom_handle, size, SEEK_CUR);
+    fretval = fseek(file_storage_default.handle, size, SEEK_CUR);
 
     if (fretval == 0)
     {
@@ -126,14 +153,14 @@ t_e_frogfs_error storage_advance(uint16_t size)
     return retval;
 }
 
-t_e_frogfs_error storage_backtrack(uint16_t size)
+t_e_frogfs_error storage_backtrack(t_frogfs_offset size)
 {
     t_e_frogfs_error retval = FROGFS_ERR_IO;
     int fretval;
 
-    NULL_PTR_CHECK_RETURN(eeprom_handle);
+    NULL_PTR_CHECK_RETURN(file_storage_default.handle);
 
-    fretval = fseek(eeprom_handle, -1L * (long int)size, SEEK_CUR);
+    fretval = fseek(file_storage_default.handle, -1L * (long int)size, SEEK_CUR);
 
     if (fretval == 0)
     {
@@ -143,20 +170,20 @@ t_e_frogfs_error storage_backtrack(uint16_t size)
     return retval;
 }
 
-t_e_frogfs_error storage_pos(uint16_t *offset)
+t_e_frogfs_error storage_pos(t_frogfs_offset *offset)
 {
     t_e_frogfs_error retval = FROGFS_ERR_IO;
     int fretval;
 
     NULL_PTR_CHECK_RETURN(offset);
-    NULL_PTR_CHECK_RETURN(eeprom_handle);
+    NULL_PTR_CHECK_RETURN(file_storage_default.handle);
 
-    fretval = ftell(eeprom_handle);
+    fretval = ftell(file_storage_default.handle);
 
     if (fretval != -1)
     {
         retval = FROGFS_ERR_OK;
-        *offset = (uint16_t)fretval;
+        *offset = (t_frogfs_offset)fretval;
     }
 
     return retval;
@@ -167,11 +194,11 @@ t_e_frogfs_error storage_end_of_storage(void)
     t_e_frogfs_error retval = FROGFS_ERR_IO;
     int fretval;
 
-    NULL_PTR_CHECK_RETURN(eeprom_handle);
+    NULL_PTR_CHECK_RETURN(file_storage_default.handle);
 
-    fretval = ftell(eeprom_handle);
+    fretval = ftell(file_storage_default.handle);
 
-    if ((file_storage_size == 0) || (fretval == (file_storage_size - 1)))
+    if ((file_storage_default.size == 0) || (fretval == ((int)file_storage_default.size - 1)))
     {
         retval = FROGFS_ERR_OK;
     }
@@ -179,14 +206,14 @@ t_e_frogfs_error storage_end_of_storage(void)
     return retval;
 }
 
-t_e_frogfs_error storage_seek(uint16_t offset)
+t_e_frogfs_error storage_seek(t_frogfs_offset offset)
 {
     t_e_frogfs_error retval = FROGFS_ERR_IO;
     int fretval;
 
-    NULL_PTR_CHECK_RETURN(eeprom_handle);
+    NULL_PTR_CHECK_RETURN(file_storage_default.handle);
 
-    fretval = fseek(eeprom_handle, offset, SEEK_SET);
+    fretval = fseek(file_storage_default.handle, offset, SEEK_SET);
 
     if (fretval == 0)
     {
@@ -202,14 +229,14 @@ t_e_frogfs_error storage_read(uint8_t *data, uint16_t size)
     int fretval;
 
     NULL_PTR_CHECK_RETURN(data);
-    NULL_PTR_CHECK_RETURN(eeprom_handle);
+    NULL_PTR_CHECK_RETURN(file_storage_default.handle);
 
     /* Verify if we are reading out of space */
-    fretval = ftell(eeprom_handle);
+    fretval = ftell(file_storage_default.handle);
 
-    if (((fretval + (int)size) <= (int)(file_storage_size)))
+    if (((fretval + (int)size) <= (int)(file_storage_default.size)))
     {
-        fretval = fread(data, 1, size, eeprom_handle);
+        fretval = fread(data, 1, size, file_storage_default.handle);
 
         if (fretval == (int)size)
         {
@@ -231,14 +258,14 @@ t_e_frogfs_error storage_write(const uint8_t *data, uint16_t size)
     int fretval;
 
     NULL_PTR_CHECK_RETURN(data);
-    NULL_PTR_CHECK_RETURN(eeprom_handle);
+    NULL_PTR_CHECK_RETURN(file_storage_default.handle);
 
     /* Verify if we are reading out of space */
-    fretval = ftell(eeprom_handle);
+    fretval = ftell(file_storage_default.handle);
 
-    if (((fretval + (int)size) <= (int)(file_storage_size)))
+    if (((fretval + (int)size) <= (int)(file_storage_default.size)))
     {
-        fretval = fwrite(data, 1, size, eeprom_handle);
+        fretval = fwrite(data, 1, size, file_storage_default.handle);
 
         if (fretval == (int)size)
         {
@@ -254,16 +281,145 @@ t_e_frogfs_error storage_write(const uint8_t *data, uint16_t size)
     return retval;
 }
 
+static t_e_frogfs_error file_storage_read_at(void *context, t_frogfs_offset offset, uint8_t *data, uint16_t size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    t_s_file_storage *storage = file_storage_instance(context);
+    size_t fretval;
+
+    NULL_PTR_CHECK_RETURN(data);
+    NULL_PTR_CHECK_RETURN(storage->handle);
+
+    if (((uint32_t)offset + (uint32_t)size) <= (uint32_t)storage->size)
+    {
+        /* The seek and the access are not interleaved with the ones of other threads */
+        FILE_STORAGE_LOCK(storage);
+        if (fseek(storage->handle, offset, SEEK_SET) == 0)
+        {
+            fretval = fread(data, 1, size, storage->handle);
+
+            if (fretval == (size_t)size)
+            {
+                retval = FROGFS_ERR_OK;
+            }
+        }
+        FILE_STORAGE_UNLOCK(storage);
+    }
+    else
+    {
+        /* Out of space */
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_read_at(t_frogfs_offset offset, uint8_t *data, uint16_t size)
+{
+    return file_storage_read_at(NULL, offset, data, size);
+}
+
+static t_e_frogfs_error file_storage_write_at(void *context, t_frogfs_offset offset, const uint8_t *data, uint16_t size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    t_s_file_storage *storage = file_storage_instance(context);
+    size_t fretval;
+
+    NULL_PTR_CHECK_RETURN(data);
+    NULL_PTR_CHECK_RETURN(storage->handle);
+
+    if (((uint32_t)offset + (uint32_t)size) <= (uint32_t)storage->size)
+    {
+        /* The seek and the access are not interleaved with the ones of other threads */
+        FILE_STORAGE_LOCK(storage);
+        if (fseek(storage->handle, offset, SEEK_SET) == 0)
+        {
+            fretval = fwrite(data, 1, size, storage->handle);
+
+            if (fretval == (size_t)size)
+            {
+                retval = FROGFS_ERR_OK;
+            }
+        }
+        FILE_STORAGE_UNLOCK(storage);
+    }
+    else
+    {
+        /* Out of space */
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_write_at(t_frogfs_offset offset, const uint8_t *data, uint16_t size)
+{
+    return file_storage_write_at(NULL, offset, data, size);
+}
+
+static t_e_frogfs_error file_storage_fill(void *context, t_frogfs_offset offset, uint8_t value, t_frogfs_offset size)
+{
+    t_e_frogfs_error retval = FROGFS_ERR_IO;
+    t_s_file_storage *storage = file_storage_instance(context);
+    uint8_t buffer[64];
+    uint16_t chunk;
+
+    NULL_PTR_CHECK_RETURN(storage->handle);
+
+    if (((uint32_t)offset + (uint32_t)size) <= (uint32_t)storage->size)
+    {
+        FILE_STORAGE_LOCK(storage);
+        if (fseek(storage->handle, offset, SEEK_SET) == 0)
+        {
+            (void)memset(buffer, value, sizeof(buffer));
+            retval = FROGFS_ERR_OK;
+
+            while ((retval == FROGFS_ERR_OK) && (size > 0))
+            {
+                chunk = (size < sizeof(buffer)) ? (uint16_t)size : (uint16_t)sizeof(buffer);
+
+                if (fwrite(buffer, 1, chunk, storage->handle) != (size_t)chunk)
+                {
+                    retval = FROGFS_ERR_IO;
+                }
+                size -= chunk;
+            }
+        }
+        FILE_STORAGE_UNLOCK(storage);
+    }
+    else
+    {
+        /* Out of space */
+        retval = FROGFS_ERR_NOSPACE;
+    }
+
+    return retval;
+}
+
+t_e_frogfs_error storage_fill(t_frogfs_offset offset, uint8_t value, t_frogfs_offset size)
+{
+    return file_storage_fill(NULL, offset, value, size);
+}
+
+static void file_storage_sync(void *context)
+{
+    (void)fflush(file_storage_instance(context)->handle);
+}
+
 void storage_sync(void)
 {
-    (void)fflush(eeprom_handle);
+    file_storage_sync(NULL);
 }
 
-t_e_frogfs_error storage_close(void)
+static t_e_frogfs_error file_storage_close(void *context)
 {
+    t_s_file_storage *storage = file_storage_instance(context);
     int ret = -1;
 
-    ret = fclose(eeprom_handle);
+    NULL_PTR_CHECK_RETURN(storage->handle);
+
+    ret = fclose(storage->handle);
+    storage->handle = NULL;
 
     if (ret == 0)
     {
@@ -274,3 +430,20 @@ t_e_frogfs_error storage_close(void)
         return FROGFS_ERR_IO;
     }
 }
+
+t_e_frogfs_error storage_close(void)
+{
+    return file_storage_close(NULL);
+}
+
+const t_s_storage_ops file_storage_ops =
+{
+    file_storage_size,
+    file_storage_read_at,
+    file_storage_write_at,
+    file_storage_fill,
+    file_storage_sync,
+    file_storage_close
+};
+
+#endif
@@ -30,18 +30,38 @@
 #include "frogfs_enums.h"
 
 #include <stdint.h>
+#include <stdio.h>
+
+/** A file emulating a storage */
+typedef struct
+{
+    FILE *handle;           /**< The open file, NULL if not open */
+    t_frogfs_offset size;   /**< The emulated size */
+} t_s_file_storage;
+
+/** Storage operations on a t_s_file_storage (NULL context: the default instance) */
+extern const t_s_storage_ops file_storage_ops;
+
+/**
+ * Open the given file as storage emulation. The file is created (zero filled) if it
+ * does not exist yet.
+ * @param storage           the instance to open
+ * @param storage_filename
+ * @param storage_size      the size of the emulated storage, 0 to use the size of the file
+ */
+void file_storage_open(t_s_file_storage *storage, const char *storage_filename, t_frogfs_offset storage_size);
 
 /**
- * Set and use the given file as storage emulation.
+ * Set and use the given file as storage emulation (default instance).
  * @param storage_filename
  */
 void file_storage_set_file(char *storage_filename);
 
 /**
- * Initialize the storage by giving a file size.
+ * Initialize the storage by giving a file size (default instance).
  * The file "eeprom.bin" is generated.
  * @param storage_size  the size of the emulated storage
  */
-void file_storage_set_size(uint16_t storage_size);
+void file_storage_set_size(t_frogfs_offset storage_size);
 
 #endif /* STORAGE_FILE_H_ */
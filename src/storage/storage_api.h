@@ -28,18 +28,66 @@
 #define STORAGE_STORAGE_API_H_
 
 #include "frogfs_enums.h"
+#include "frogfs_config.h"
 
 #include <stdint.h>
 
+/** Offset (and size) on the storage: 32-bit when large storages are supported */
+#ifdef FROGFS_USE_LARGE_STORAGE
+typedef uint32_t t_frogfs_offset;
+#define FROGFS_OFFSET_MAX   (UINT32_MAX)
+#else
+typedef uint16_t t_frogfs_offset;
+#define FROGFS_OFFSET_MAX   (UINT16_MAX)
+#endif
+
 t_e_frogfs_error storage_close(void);
 void             storage_sync(void);
-uint16_t         storage_size(void);
-t_e_frogfs_error storage_advance(uint16_t size);
-t_e_frogfs_error storage_backtrack(uint16_t size);
-t_e_frogfs_error storage_pos(uint16_t *offset);
+t_frogfs_offset  storage_size(void);
+t_e_frogfs_error storage_advance(t_frogfs_offset size);
+t_e_frogfs_error storage_backtrack(t_frogfs_offset size);
+t_e_frogfs_error storage_pos(t_frogfs_offset *offset);
 t_e_frogfs_error storage_end_of_storage(void);
-t_e_frogfs_error storage_seek(uint16_t offset);
+t_e_frogfs_error storage_seek(t_frogfs_offset offset);
 t_e_frogfs_error storage_read(uint8_t *data, uint16_t size);
 t_e_frogfs_error storage_write(const uint8_t *data, uint16_t size);
 
+/**
+ * Positional access: read/write size bytes at the given offset with a single call.
+ * The current position of the storage (storage_seek / storage_pos) is undefined afterwards.
+ * FROGFS_ERR_NOSPACE is returned if the access goes beyond the end of the storage.
+ */
+t_e_frogfs_error storage_read_at(t_frogfs_offset offset, uint8_t *data, uint16_t size);
+t_e_frogfs_error storage_write_at(t_frogfs_offset offset, const uint8_t *data, uint16_t size);
+
+/**
+ * Bulk fill: set size bytes at the given offset to value with a single call.
+ * The current position of the storage (storage_seek / storage_pos) is undefined afterwards.
+ * FROGFS_ERR_NOSPACE is returned if the access goes beyond the end of the storage.
+ */
+t_e_frogfs_error storage_fill(t_frogfs_offset offset, uint8_t value, t_frogfs_offset size);
+
+/**
+ * Operations of a storage instance, with the same semantics as the functions above.
+ * Every operation gets the context of the instance (see t_s_storage): this allows
+ * several storages (e.g. several volumes, see t_s_frogfs_volume) in the same program.
+ * The functions above operate on the default instance of the backend.
+ */
+typedef struct
+{
+    t_frogfs_offset  (*size)(void *context);
+    t_e_frogfs_error (*read_at)(void *context, t_frogfs_offset offset, uint8_t *data, uint16_t size);
+    t_e_frogfs_error (*write_at)(void *context, t_frogfs_offset offset, const uint8_t *data, uint16_t size);
+    t_e_frogfs_error (*fill)(void *context, t_frogfs_offset offset, uint8_t value, t_frogfs_offset size);
+    void             (*sync)(void *context);
+    t_e_frogfs_error (*close)(void *context);
+} t_s_storage_ops;
+
+/** A storage instance: the operations of its backend and the data they work on */
+typedef struct
+{
+    const t_s_storage_ops *ops;
+    void *context;          /**< Backend instance, NULL for the default instance of the backend */
+} t_s_storage;
+
 #endif /* STORAGE_STORAGE_API_H_ */
@@ -33,6 +33,14 @@
 
 /* Storage includes */
 #include "storage/storage_api.h"
+#include "storage/cache/storage_cache.h"
+#ifdef __linux__
+#ifdef FROGFS_STORAGE_MMAP
+#include "storage/mmap/mmap_storage.h"
+#else
+#include "storage/stdio/file_storage.h"
+#endif
+#endif
 
 /* Filesystem includes */
 #include "frogfs.h"
@@ -40,14 +48,37 @@
 
 const char* TEST_CONTENT = "Hello! This is FrogFS.";
 
+/* Storage layout details checked by the grey-box tests: size of the header (the
+ * checkpoint follows it), of a block metadata and of the room kept for appending
+ * after the last block of a record */
+#ifdef FROGFS_USE_LARGE_STORAGE
+#define TEST_POINTER_SIZE       (3U)
+#else
+#define TEST_POINTER_SIZE       (2U)
+#endif
+#ifdef FROGFS_USE_QUICK_FORMAT
+#define TEST_HEADER_SIZE        (5U + TEST_POINTER_SIZE)
+#else
+#define TEST_HEADER_SIZE        (5U)
+#endif
+#ifdef FROGFS_USE_EXTENDED_INDEX
+#define TEST_METADATA_SIZE      (TEST_POINTER_SIZE + 2U)
+#else
+#define TEST_METADATA_SIZE      (TEST_POINTER_SIZE + 1U)
+#endif
+#if (TEST_METADATA_SIZE > 3U)
+#define TEST_STORAGE_SIZE       (2U * 1024U)
+#else
+#define TEST_STORAGE_SIZE       (1U * 1024U)
+#endif
+#define TEST_RESERVED_SIZE      (TEST_METADATA_SIZE + 1U)
+
 uint8_t read_buffer[128U];
 
-/* Some internal variables are exported here to perform some grey-box testing
- * and analyze internal structure state occasionally as a test expectation. */
-extern t_s_frogfsram_record frogfs_RAM[FROGFS_MAX_RECORD_COUNT];
+/* The volume under test. Its RAM state is also analyzed occasionally to perform
+ * some grey-box testing as a test expectation. */
+t_s_frogfs_volume volume;
 
-#warning "As debugging required some time, also prepare a test to check if zero-bytes chuncks can be flawlessly written"
-#warning "...and not regarded as free storage"
 /**
  * This test is used to verify that allocation of the maximum number of records
  * is successfully performed in a contiguous space (without fragmentation).
@@ -62,51 +93,51 @@ int test_contiguous(void)
     t_e_frogfs_error fserr;
     uint16_t i = 0;
     uint16_t effective_read = 0;
-    uint8_t next_record = 0;
+    t_frogfs_record next_record = 0;
 
     printf("Formatting media\r\n");
-    fserr = frogfs_format();
+    fserr = frogfs_format(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_init();
+    fserr = frogfs_init(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
     {
         /* Verify the behavior of frogfs_get_available */
-        fserr = frogfs_get_available(&next_record);
+        fserr = frogfs_get_available(&volume, &next_record);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
         FROGFS_ASSERT(next_record, i);
 
         /* Filesystem is ready: open record */
-        fserr = frogfs_open(i);
+        fserr = frogfs_open(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Write to record */
-        fserr = frogfs_write(i, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+        fserr = frogfs_write(&volume, i, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Close the record */
-        fserr = frogfs_close(i);
+        fserr = frogfs_close(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Open the written record */
-        fserr = frogfs_open(i);
+        fserr = frogfs_open(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Read the record */
         (void)memset(read_buffer, 0, sizeof(read_buffer));
-        fserr = frogfs_read(i, read_buffer, sizeof(read_buffer), &effective_read);
+        fserr = frogfs_read(&volume, i, read_buffer, sizeof(read_buffer), &effective_read);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Close the record */
-        fserr = frogfs_close(i);
+        fserr = frogfs_close(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
@@ -118,9 +149,9 @@ int test_contiguous(void)
     }
 
     /* Check that listing the created records works as expected */
-    uint8_t file_listing[FROGFS_MAX_RECORD_COUNT];
-    uint8_t file_count = 0xFFU;  /* test that the variable is internally reset */
-    fserr = frogfs_list(file_listing, sizeof(file_listing), &file_count);
+    t_frogfs_record file_listing[FROGFS_MAX_RECORD_COUNT];
+    t_frogfs_record file_count = 0xFFU;  /* test that the variable is internally reset */
+    fserr = frogfs_list(&volume, file_listing, FROGFS_MAX_RECORD_COUNT, &file_count);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     FROGFS_ASSERT(file_count, FROGFS_MAX_RECORD_COUNT);
     for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
@@ -129,9 +160,9 @@ int test_contiguous(void)
     }
 
     /* Verify the behavior of frogfs_get_available: no more records are available here */
-    fserr = frogfs_get_available(&next_record);
+    fserr = frogfs_get_available(&volume, &next_record);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OUT_OF_RANGE);
-    FROGFS_ASSERT(next_record, UINT8_MAX);
+    FROGFS_ASSERT(next_record, FROGFS_RECORD_NONE);
 
     return 0;
 }
@@ -148,46 +179,46 @@ int test_contiguous_and_remove(void)
     uint16_t effective_read = 0;
 
     printf("Formatting media\r\n");
-    fserr = frogfs_format();
+    fserr = frogfs_format(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_init();
+    fserr = frogfs_init(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
     {
         /* Flush the file handle to disk at every step to enhance debugging */
-        storage_sync();
+        storage_cache_sync(&volume.storage);
 
         /* Filesystem is ready: open record */
-        fserr = frogfs_open(i);
+        fserr = frogfs_open(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Write to record */
-        fserr = frogfs_write(i, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+        fserr = frogfs_write(&volume, i, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Close the record */
-        fserr = frogfs_close(i);
+        fserr = frogfs_close(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Open the written record */
-        fserr = frogfs_open(i);
+        fserr = frogfs_open(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Read the record */
         (void)memset(read_buffer, 0, sizeof(read_buffer));
-        fserr = frogfs_read(i, read_buffer, sizeof(read_buffer), &effective_read);
+        fserr = frogfs_read(&volume, i, read_buffer, sizeof(read_buffer), &effective_read);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Close the record */
-        fserr = frogfs_close(i);
+        fserr = frogfs_close(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
@@ -197,11 +228,11 @@ int test_contiguous_and_remove(void)
         FROGFS_ASSERT_VERBOSE(effective_read, strlen(TEST_CONTENT), "length does not match.");
 
         /* Remove the record */
-        fserr = frogfs_erase(i);
+        fserr = frogfs_erase(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
         /* Check that the allocation table has been erased */
-        FROGFS_ASSERT(frogfs_RAM[i].offset, 0U);
+        FROGFS_ASSERT(volume.records[i].offset, 0U);
     }
 
     return 0;
@@ -214,46 +245,46 @@ int test_contiguous_and_remove_at_end(void)
     uint16_t effective_read = 0;
 
     printf("Formatting media\r\n");
-    fserr = frogfs_format();
+    fserr = frogfs_format(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_init();
+    fserr = frogfs_init(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
     {
         /* Flush the file handle to disk at every step to enhance debugging */
-        storage_sync();
+        storage_cache_sync(&volume.storage);
 
         /* Filesystem is ready: open record */
-        fserr = frogfs_open(i);
+        fserr = frogfs_open(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Write to record */
-        fserr = frogfs_write(i, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+        fserr = frogfs_write(&volume, i, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Close the record */
-        fserr = frogfs_close(i);
+        fserr = frogfs_close(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Open the written record */
-        fserr = frogfs_open(i);
+        fserr = frogfs_open(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Read the record */
         (void)memset(read_buffer, 0, sizeof(read_buffer));
-        fserr = frogfs_read(i, read_buffer, sizeof(read_buffer), &effective_read);
+        fserr = frogfs_read(&volume, i, read_buffer, sizeof(read_buffer), &effective_read);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Close the record */
-        fserr = frogfs_close(i);
+        fserr = frogfs_close(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
@@ -266,15 +297,15 @@ int test_contiguous_and_remove_at_end(void)
     for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
     {
         /* Flush the file handle to disk at every step to enhance debugging */
-        storage_sync();
+        storage_cache_sync(&volume.storage);
 
         /* Remove the record */
-        fserr = frogfs_erase(i);
+        fserr = frogfs_erase(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Check that the allocation table has been erased */
-        FROGFS_ASSERT(frogfs_RAM[i].offset, 0U);
+        FROGFS_ASSERT(volume.records[i].offset, 0U);
     }
 
     return 0;
@@ -287,25 +318,25 @@ void test_reopen(void)
     uint8_t i = 0;
     uint16_t effective_read = 0;
 
-    fserr = frogfs_init();
+    fserr = frogfs_init(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
     {
         /* Filesystem is ready: open record */
-        fserr = frogfs_open(i);
+        fserr = frogfs_open(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Read the record */
         (void)memset(read_buffer, 0, sizeof(read_buffer));
-        fserr = frogfs_read(i, read_buffer, sizeof(read_buffer), &effective_read);
+        fserr = frogfs_read(&volume, i, read_buffer, sizeof(read_buffer), &effective_read);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
         /* Close the record */
-        fserr = frogfs_close(i);
+        fserr = frogfs_close(&volume, i);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
@@ -321,19 +352,19 @@ void test_record_limit(void)
     t_e_frogfs_error fserr;
     uint16_t effective_read = 0;
 
-    fserr = frogfs_open(FROGFS_MAX_RECORD_COUNT);
+    fserr = frogfs_open(&volume, FROGFS_RECORD_ID_LIMIT);
     FROGFS_ASSERT(FROGFS_ERR_INVALID_RECORD, fserr);
 
-    fserr = frogfs_write(FROGFS_MAX_RECORD_COUNT, NULL, 0);
+    fserr = frogfs_write(&volume, FROGFS_RECORD_ID_LIMIT, NULL, 0);
     FROGFS_ASSERT(FROGFS_ERR_INVALID_RECORD, fserr);
 
-    fserr = frogfs_traverse(FROGFS_MAX_RECORD_COUNT, NULL, 0, &effective_read, false);
+    fserr = frogfs_traverse(&volume, FROGFS_RECORD_ID_LIMIT, NULL, 0, &effective_read, false);
     FROGFS_ASSERT(FROGFS_ERR_INVALID_RECORD, fserr);
 
-    fserr = frogfs_read(FROGFS_MAX_RECORD_COUNT, NULL, 0, &effective_read);
+    fserr = frogfs_read(&volume, FROGFS_RECORD_ID_LIMIT, NULL, 0, &effective_read);
     FROGFS_ASSERT(FROGFS_ERR_INVALID_RECORD, fserr);
 
-    fserr = frogfs_close(FROGFS_MAX_RECORD_COUNT);
+    fserr = frogfs_close(&volume, FROGFS_RECORD_ID_LIMIT);
     FROGFS_ASSERT(FROGFS_ERR_INVALID_RECORD, fserr);
 }
 
@@ -345,14 +376,14 @@ void test_reopen_files(uint8_t index_record_start, uint8_t index_record_end)
     for (;index_record_start <= index_record_end; index_record_start++)
     {
         /* Filesystem is ready: open record */
-        fserr = frogfs_open(index_record_start);
+        fserr = frogfs_open(&volume, index_record_start);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-        storage_sync();
+        storage_cache_sync(&volume.storage);
 
         /* Read the record */
         (void)memset(read_buffer, 0, sizeof(read_buffer));
-        fserr = frogfs_read(index_record_start, read_buffer, sizeof(read_buffer), &effective_read);
+        fserr = frogfs_read(&volume, index_record_start, read_buffer, sizeof(read_buffer), &effective_read);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
@@ -362,11 +393,11 @@ void test_reopen_files(uint8_t index_record_start, uint8_t index_record_end)
         FROGFS_ASSERT_VERBOSE(effective_read, strlen(TEST_CONTENT), "length does not match.");
 
         /* Close the record */
-        fserr = frogfs_close(index_record_start);
+        fserr = frogfs_close(&volume, index_record_start);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
         /* Flush the file handle to disk at every step to enhance debugging */
-        storage_sync();
+        storage_cache_sync(&volume.storage);
     }
 }
 
@@ -378,81 +409,81 @@ void test_fragmentation()
     t_e_frogfs_error fserr;
 
     printf("Formatting media\r\n");
-    fserr = frogfs_format();
+    fserr = frogfs_format(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_init();
+    fserr = frogfs_init(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    storage_sync();
+    storage_cache_sync(&volume.storage);
 
     /* Filesystem is ready: open record 0 */
-    fserr = frogfs_open(0);
+    fserr = frogfs_open(&volume, 0);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    storage_sync();
+    storage_cache_sync(&volume.storage);
 
     /* Write to record 0 */
-    fserr = frogfs_write(0, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+    fserr = frogfs_write(&volume, 0, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     /* Flush the file handle to disk at every step to enhance debugging */
-    storage_sync();
+    storage_cache_sync(&volume.storage);
 
     /* Close the record 0 */
-    fserr = frogfs_close(0);
+    fserr = frogfs_close(&volume, 0);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     /* Flush the file handle to disk at every step to enhance debugging */
-    storage_sync();
+    storage_cache_sync(&volume.storage);
 
     /* Filesystem is ready: open record 1 */
-    fserr = frogfs_open(1);
+    fserr = frogfs_open(&volume, 1);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    storage_sync();
+    storage_cache_sync(&volume.storage);
 
     /* Write to record 1 */
-    fserr = frogfs_write(1, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+    fserr = frogfs_write(&volume, 1, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     /* Flush the file handle to disk at every step to enhance debugging */
-    storage_sync();
+    storage_cache_sync(&volume.storage);
 
     /* Close the record 1 */
-    fserr = frogfs_close(1);
+    fserr = frogfs_close(&volume, 1);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     /* Flush the file handle to disk at every step to enhance debugging */
-    storage_sync();
+    storage_cache_sync(&volume.storage);
 
     /* Remove record 0 */
-    fserr = frogfs_erase(0);
+    fserr = frogfs_erase(&volume, 0);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     /* Flush the file handle to disk at every step to enhance debugging */
-    storage_sync();
+    storage_cache_sync(&volume.storage);
 
     /* Filesystem is ready: open record 2 */
-    fserr = frogfs_open(2);
+    fserr = frogfs_open(&volume, 2);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     /* Flush the file handle to disk at every step to enhance debugging */
-    storage_sync();
+    storage_cache_sync(&volume.storage);
 
     /* Write to record 2 */
-    fserr = frogfs_write(2, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+    fserr = frogfs_write(&volume, 2, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     /* Flush the file handle to disk at every step to enhance debugging */
-    storage_sync();
+    storage_cache_sync(&volume.storage);
 
     /* Close the record 2 */
-    fserr = frogfs_close(2);
+    fserr = frogfs_close(&volume, 2);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     /* Flush the file handle to disk at every step to enhance debugging */
-    storage_sync();
+    storage_cache_sync(&volume.storage);
 
     /* Re-read record 1 and 2 and verify their integrity */
     test_reopen_files(1, 2);
@@ -465,41 +496,41 @@ int test_0_byte_record(void)
     uint16_t effective_read = UINT16_MAX;
 
     printf("Formatting media\r\n");
-    fserr = frogfs_format();
+    fserr = frogfs_format(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_init();
+    fserr = frogfs_init(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     /* Filesystem is ready: open record */
-    fserr = frogfs_open(0);
+    fserr = frogfs_open(&volume, 0);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     /* Write to record, 0 bytes */
-    fserr = frogfs_write(0, (const uint8_t*)TEST_CONTENT, 0);
+    fserr = frogfs_write(&volume, 0, (const uint8_t*)TEST_CONTENT, 0);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     /* Close the record */
-    fserr = frogfs_close(0);
+    fserr = frogfs_close(&volume, 0);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     /* Filesystem is ready: open record */
-    fserr = frogfs_open(0);
+    fserr = frogfs_open(&volume, 0);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     /* Read: expect 0 bytes */
     (void)memset(read_buffer, 0, sizeof(read_buffer));
-    fserr = frogfs_read(0, read_buffer, sizeof(read_buffer), &effective_read);
+    fserr = frogfs_read(&volume, 0, read_buffer, sizeof(read_buffer), &effective_read);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     /* Close the record */
-    fserr = frogfs_close(0);
+    fserr = frogfs_close(&volume, 0);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
@@ -526,20 +557,20 @@ int test_unclosed_file(void)
     t_e_frogfs_error fserr;
 
     printf("Formatting media\r\n");
-    fserr = frogfs_format();
+    fserr = frogfs_format(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_init();
+    fserr = frogfs_init(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     /* Filesystem is ready: open record */
-    fserr = frogfs_open(FILE_SETTINGS);
+    fserr = frogfs_open(&volume, FILE_SETTINGS);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     /* Simulate power-cycle by re-init of frogfs */
-    fserr = frogfs_init();
+    fserr = frogfs_init(&volume);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     return 0;
@@ -567,70 +598,70 @@ int test_use_case_settings(bool perform_format_and_init, bool check_first_open_z
     if (perform_format_and_init == true)
     {
         printf("Formatting media\r\n");
-        fserr = frogfs_format();
+        fserr = frogfs_format(&volume);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-        fserr = frogfs_init();
+        fserr = frogfs_init(&volume);
         printf_frogfserror(fserr);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     }
 
     /* Filesystem is ready: open record */
-    fserr = frogfs_open(FILE_SETTINGS);
+    fserr = frogfs_open(&volume, FILE_SETTINGS);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_close(FILE_SETTINGS);
+    fserr = frogfs_close(&volume, FILE_SETTINGS);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     if (perform_format_and_init == true)
     {
         /* Simulate power-cycle by re-init of frogfs */
-        fserr = frogfs_init();
+        fserr = frogfs_init(&volume);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     }
 
     if (check_first_open_zero_data == true)
     {
         /* Try to reload settings */
-        fserr =  frogfs_read(FILE_SETTINGS, demo_struct_read, sizeof(demo_struct_read), &effective_read);
+        fserr =  frogfs_read(&volume, FILE_SETTINGS, demo_struct_read, sizeof(demo_struct_read), &effective_read);
         for (i = 0; i < sizeof(demo_struct_read); i++)
         {
             FROGFS_ASSERT(demo_struct_read[i], 0x00U);
         }
         FROGFS_ASSERT(effective_read, 0);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-        fserr = frogfs_close(FILE_SETTINGS);
+        fserr = frogfs_close(&volume, FILE_SETTINGS);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     }
 
     /* Save new settings */
-    fserr = frogfs_erase(FILE_SETTINGS);
+    fserr = frogfs_erase(&volume, FILE_SETTINGS);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_open(FILE_SETTINGS);
+    fserr = frogfs_open(&volume, FILE_SETTINGS);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_write(FILE_SETTINGS, demo_struct_write, sizeof(demo_struct_write));
+    fserr = frogfs_write(&volume, FILE_SETTINGS, demo_struct_write, sizeof(demo_struct_write));
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_close(FILE_SETTINGS);
+    fserr = frogfs_close(&volume, FILE_SETTINGS);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     if (perform_format_and_init == true)
     {
         /* Simulate power-cycle by re-init of frogfs */
-        fserr = frogfs_init();
+        fserr = frogfs_init(&volume);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     }
 
     /* Try to reload settings */
-    fserr = frogfs_open(FILE_SETTINGS);
+    fserr = frogfs_open(&volume, FILE_SETTINGS);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr =  frogfs_read(FILE_SETTINGS, demo_struct_read, sizeof(demo_struct_read), &effective_read);
+    fserr =  frogfs_read(&volume, FILE_SETTINGS, demo_struct_read, sizeof(demo_struct_read), &effective_read);
     for (i = 0; i < sizeof(demo_struct_read); i++)
     {
         FROGFS_ASSERT(demo_struct_read[i], demo_struct_write[i]);
     }
     FROGFS_ASSERT(effective_read, sizeof(demo_struct_write));
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_close(FILE_SETTINGS);
+    fserr = frogfs_close(&volume, FILE_SETTINGS);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     return 0;
@@ -647,10 +678,10 @@ int test_file0_and_file1(void)
     t_e_frogfs_error fserr;
 
     printf("Formatting media\r\n");
-    fserr = frogfs_format();
+    fserr = frogfs_format(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_init();
+    fserr = frogfs_init(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
@@ -661,22 +692,22 @@ int test_file0_and_file1(void)
     /* Simulate logging record: subsequent writes */
 
     /* Test and get the record name that is first available */
-    uint8_t new_record;
-    fserr = frogfs_get_available(&new_record);
+    t_frogfs_record new_record;
+    fserr = frogfs_get_available(&volume, &new_record);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_open(new_record);
+    fserr = frogfs_open(&volume, new_record);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     /* Write 128 bytes - byte by byte */
     for (i = 0; i < 128; i++)
     {
-        fserr = frogfs_write(new_record, &i, 1U);
+        fserr = frogfs_write(&volume, new_record, &i, 1U);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     }
-    fserr = frogfs_close(new_record);
+    fserr = frogfs_close(&volume, new_record);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     /* Simulate a power cycle */
-    fserr = frogfs_init();
+    fserr = frogfs_init(&volume);
     printf_frogfserror(fserr);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
@@ -684,29 +715,29 @@ int test_file0_and_file1(void)
     uint16_t effective_read;
 
     /* Read back the data: in one go */
-    fserr = frogfs_open(new_record);
+    fserr = frogfs_open(&volume, new_record);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
-    fserr = frogfs_read(new_record, read_buffer, sizeof(read_buffer), &effective_read);
+    fserr = frogfs_read(&volume, new_record, read_buffer, sizeof(read_buffer), &effective_read);
     FROGFS_ASSERT(effective_read, 128);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     for (i = 0; i < 128; i++)
     {
         FROGFS_ASSERT(read_buffer[i], i);
     }
-    fserr = frogfs_close(new_record);
+    fserr = frogfs_close(&volume, new_record);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     /* Read back the data: byte by byte */
-    fserr = frogfs_open(new_record);
+    fserr = frogfs_open(&volume, new_record);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
     for (i = 0; i < 128; i++)
     {
-        fserr = frogfs_read(new_record, read_buffer, 1, &effective_read);
+        fserr = frogfs_read(&volume, new_record, read_buffer, 1, &effective_read);
         FROGFS_ASSERT(effective_read, 1);
         FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
         FROGFS_ASSERT(read_buffer[i], i);
     }
-    fserr = frogfs_close(new_record);
+    fserr = frogfs_close(&volume, new_record);
     FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
     /* Perform power cycle and repeat data read */
@@ -714,54 +745,2609 @@ int test_file0_and_file1(void)
     return 0;
 }
 
-/* TODO tests to be implemented:
- * - write non-opened file
- * - read non-opened file
- * - write maximum storage record, read and finally try to add new record
- * - fragmentation test: worst case 1-byte data fragments (with initial EEPROM image)
- * - test frogfs_find_contiguous_space in A) filesystem empty B) filesystem full C) other mixed cases...
+/**
+ * This test is used to verify that the free space scanners do not mistake
+ * zeroed record data or metadata having a zero size byte (e.g. 256 bytes)
+ * for free storage.
+ *
+ * @return  0 (or asserts)
  */
+int test_zero_data_record(void)
+{
+    t_e_frogfs_error fserr;
+    uint16_t i = 0;
+    uint16_t total_read = 0;
+    uint16_t effective_read = 0;
 
-int frogfs_execute_test(void)
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Record 0: 256 zero bytes */
+    (void)memset(read_buffer, 0, sizeof(read_buffer));
+    fserr = frogfs_open(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_write(&volume, 0, read_buffer, sizeof(read_buffer));
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_write(&volume, 0, read_buffer, sizeof(read_buffer));
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Record 1 shall be allocated after record 0 */
+    fserr = frogfs_open(&volume, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT((volume.records[1].offset >= (volume.records[0].offset + TEST_METADATA_SIZE + 256U)), true);
+    fserr = frogfs_write(&volume, 1, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&volume, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Record 0 is intact */
+    fserr = frogfs_open(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    do
+    {
+        (void)memset(read_buffer, 0xFF, sizeof(read_buffer));
+        fserr = frogfs_read(&volume, 0, read_buffer, sizeof(read_buffer), &effective_read);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        for (i = 0; i < effective_read; i++)
+        {
+            FROGFS_ASSERT(read_buffer[i], 0x00U);
+        }
+        total_read += effective_read;
+    } while (effective_read > 0);
+    FROGFS_ASSERT(total_read, 256U);
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    test_reopen_files(1, 1);
+
+    return 0;
+}
+
+/**
+ * Check that the free space found through the maintained free-extent map
+ * matches the one found after rebuilding the map from the storage.
+ */
+void check_free_space(t_frogfs_offset expected_space_start)
 {
     t_e_frogfs_error fserr;
+    t_frogfs_offset space_start[2];
+    t_frogfs_offset data_start[2];
+    t_frogfs_offset data_size[2];
 
-    FROGFS_DEBUG_VERBOSE("START: test_contiguous");
-    test_contiguous();
-    FROGFS_DEBUG_VERBOSE("START: test_reopen");
-    test_reopen();
-    FROGFS_DEBUG_VERBOSE("START: test_contiguous_and_remove");
-    test_contiguous_and_remove();
-    FROGFS_DEBUG_VERBOSE("START: test_contiguous_and_remove_at_end");
-    test_contiguous_and_remove_at_end();
-    FROGFS_DEBUG_VERBOSE("START: test_record_limit");
-    test_record_limit();
-    FROGFS_DEBUG_VERBOSE("START: test_fragmentation");
-    test_fragmentation();
-    FROGFS_DEBUG_VERBOSE("START: test_0_byte_record");
-    test_0_byte_record();
-    FROGFS_DEBUG_VERBOSE("START: test_use_case_settings");
-    test_use_case_settings(true, true);
-    FROGFS_DEBUG_VERBOSE("START: test_unclosed_file");
-    test_unclosed_file();
-    FROGFS_DEBUG_VERBOSE("START: test_file0_and_file1");
-    test_file0_and_file1();
+    fserr = frogfs_find_contiguous_space(&volume, &space_start[0], &data_start[0], &data_size[0]);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(space_start[0], expected_space_start);
 
-    fserr = storage_close();
-    FROGFS_ASSERT_VERBOSE(fserr, FROGFS_ERR_OK, "assertion failed at closing the storage layer.");
+    /* Simulate power-cycle: the map is rebuilt */
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_find_contiguous_space(&volume, &space_start[1], &data_start[1], &data_size[1]);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
 
-    FROGFS_DEBUG_VERBOSE("test passed");
+    FROGFS_ASSERT(space_start[0], space_start[1]);
+    FROGFS_ASSERT(data_start[0], data_start[1]);
+    FROGFS_ASSERT(data_size[0], data_size[1]);
+}
+
+/**
+ * This test is used to verify that the in-RAM free-extent map is maintained
+ * across write, close and erase operations.
+ *
+ * @return  0 (or asserts)
+ */
+int test_free_map(void)
+{
+    t_e_frogfs_error fserr;
+    uint8_t i = 0;
+    t_frogfs_offset record_size = (t_frogfs_offset)(TEST_METADATA_SIZE + strlen(TEST_CONTENT));
+    t_frogfs_offset offset0;
+    t_frogfs_offset offset1;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Record 0 is shorter: with the room kept for appending it takes record_size bytes */
+    for (i = 0; i < 2U; i++)
+    {
+        fserr = frogfs_open(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_write(&volume, i, (const uint8_t*)TEST_CONTENT, (uint16_t)(strlen(TEST_CONTENT) - ((i == 0U) ? TEST_RESERVED_SIZE : 0U)));
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_close(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+    offset0 = volume.records[0].offset;
+    offset1 = volume.records[1].offset;
+    FROGFS_ASSERT(offset1, offset0 + record_size);
+
+    /* The free space is after the last record and its room for appending */
+    check_free_space(offset1 + record_size + TEST_RESERVED_SIZE);
+
+    /* Erasing the first record leaves a hole that is reused */
+    fserr = frogfs_erase(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+#ifdef FROGFS_USE_NEXT_FIT
+    /* First fit layout: search from the beginning */
+    volume.alloc_cursor = 0U;
+#endif
+    check_free_space(offset0);
+
+    /* Record 2 does not fit the hole: it is fragmented after record 1 */
+    fserr = frogfs_open(&volume, 2);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.records[2].offset, offset0);
+    fserr = frogfs_write(&volume, 2, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&volume, 2);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* 18 bytes in the hole (17 with the large storage format), the rest in a fragment after record 1 */
+    check_free_space(offset1 + record_size + TEST_RESERVED_SIZE + TEST_METADATA_SIZE + (TEST_METADATA_SIZE + 1U) + TEST_RESERVED_SIZE);
+
+    test_reopen_files(1, 2);
 
     return 0;
 }
 
-#ifdef __linux__
-#include "storage/stdio/file_storage.h"
-/* Execute tests on a hosted linux platform */
-int main(void)
+/**
+ * This test is used to verify that the allocation table checkpoint is loaded at
+ * init time, that it is invalidated when the allocation table changes and that
+ * a torn checkpoint falls back to the full storage scan.
+ *
+ * @return  0 (or asserts)
+ */
+int test_checkpoint(void)
 {
-    /* Initialize the stdio-file storage backend for FrogFS */
-    file_storage_set_size(1U * 1024U);      /* 1KB */
+#ifdef FROGFS_USE_CHECKPOINT
+    t_e_frogfs_error fserr;
+    t_frogfs_offset offsets[FROGFS_MAX_RECORD_COUNT];
+    uint8_t marker = 0U;
+    uint8_t i = 0;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    for (i = 0; i < 4U; i++)
+    {
+        fserr = frogfs_open(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_write(&volume, i, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_close(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+
+    /* A record has been erased: the checkpoint marker shall be cleared */
+    fserr = frogfs_erase(&volume, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = storage_cache_read_at(&volume.storage, TEST_HEADER_SIZE, &marker, 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(marker, 0x00U);
+
+    /* Store the checkpoint and remember the allocation table */
+    fserr = frogfs_checkpoint(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
+    {
+        offsets[i] = volume.records[i].offset;
+    }
+
+    /* Simulate power-cycle: the table is loaded from the checkpoint */
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
+    {
+        FROGFS_ASSERT(volume.records[i].offset, offsets[i]);
+    }
+    FROGFS_ASSERT(volume.records[1].offset, 0U);
+
+    /* Corrupt the checkpoint content: init shall fall back to the full scan */
+    marker = 0xFFU;
+    fserr = storage_cache_write_at(&volume.storage, TEST_HEADER_SIZE + 3U, &marker, 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    for (i = 0; i < FROGFS_MAX_RECORD_COUNT; i++)
+    {
+        FROGFS_ASSERT(volume.records[i].offset, offsets[i]);
+    }
+
+    /* The records are still readable */
+    test_reopen_files(2, 3);
+#endif
+
+    return 0;
+}
+
+/**
+ * This test is used to verify that the quick format (FROGFS_USE_QUICK_FORMAT) leaves the
+ * storage after the high-water mark untouched, and that neither the scan nor the
+ * allocator take its content for records.
+ *
+ * @return  0 (or asserts)
+ */
+int test_quick_format(void)
+{
+#ifdef FROGFS_USE_QUICK_FORMAT
+    t_e_frogfs_error fserr;
+    uint8_t tmp[TEST_POINTER_SIZE];
+    t_frogfs_record list[FROGFS_MAX_RECORD_COUNT];
+    t_frogfs_record file_num = 0U;
+    t_frogfs_offset mark = 0U;
+    uint8_t garbage = 0U;
+    uint8_t i = 0;
+#ifdef FROGFS_USE_CHECKPOINT
+    uint8_t zero = 0U;
+#endif
+
+    /* Leftovers of a previous use of the storage */
+    fserr = storage_cache_fill(&volume.storage, 0U, 0xA5U, TEST_STORAGE_SIZE);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_list(&volume, list, FROGFS_MAX_RECORD_COUNT, &file_num);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(file_num, 0U);
+
+    for (i = 0; i < 3U; i++)
+    {
+        fserr = frogfs_open(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_write(&volume, i, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_close(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+
+    /* The mark follows the written data, the storage after it has not been erased */
+    fserr = storage_cache_read_at(&volume.storage, 5U, tmp, TEST_POINTER_SIZE);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    for (i = 0; i < TEST_POINTER_SIZE; i++)
+    {
+        mark |= (t_frogfs_offset)((t_frogfs_offset)tmp[i] << (8U * i));
+    }
+    FROGFS_ASSERT((mark > (volume.records[2].offset + TEST_METADATA_SIZE + strlen(TEST_CONTENT))), true);
+    FROGFS_ASSERT((mark < TEST_STORAGE_SIZE), true);
+    fserr = storage_cache_read_at(&volume.storage, mark, &garbage, 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(garbage, 0xA5U);
+
+    /* Simulate power-cycle: the storage is scanned up to the mark only */
+#ifdef FROGFS_USE_CHECKPOINT
+    fserr = storage_cache_write_at(&volume.storage, TEST_HEADER_SIZE, &zero, 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+#endif
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_list(&volume, list, FROGFS_MAX_RECORD_COUNT, &file_num);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(file_num, 3U);
+    test_reopen_files(0, 2);
+
+    /* Fill the storage: the space after the mark is formatted on the way */
+    fserr = frogfs_open(&volume, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    do
+    {
+        fserr = frogfs_write(&volume, 3, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+    } while (fserr == FROGFS_ERR_OK);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_NOSPACE);
+    fserr = frogfs_close(&volume, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.high_water, TEST_STORAGE_SIZE);
+
+    fserr = frogfs_erase(&volume, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    test_reopen_files(0, 2);
+#endif
+
+    return 0;
+}
+
+/**
+ * This test is used to verify that the high-water mark (FROGFS_USE_QUICK_FORMAT) follows
+ * the last allocated byte: it moves back when the records at the end of the storage are
+ * erased, also when it has been left high by a power cut.
+ *
+ * @return  0 (or asserts)
+ */
+int test_high_water(void)
+{
+#ifdef FROGFS_USE_QUICK_FORMAT
+    t_e_frogfs_error fserr;
+    uint8_t tmp[TEST_POINTER_SIZE];
+    t_frogfs_offset empty;
+    t_frogfs_offset mark;
+    uint8_t i = 0;
+#ifdef FROGFS_USE_CHECKPOINT
+    uint8_t zero = 0U;
+#endif
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    empty = volume.high_water;
+
+    for (i = 0; i < 3U; i++)
+    {
+        fserr = frogfs_open(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_write(&volume, i, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_close(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+    mark = volume.high_water;
+    FROGFS_ASSERT((mark > empty), true);
+
+    /* Record 3 takes the rest of the storage, then it is erased: the mark goes back */
+    fserr = frogfs_open(&volume, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    do
+    {
+        fserr = frogfs_write(&volume, 3, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+    } while (fserr == FROGFS_ERR_OK);
+    fserr = frogfs_close(&volume, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.high_water, TEST_STORAGE_SIZE);
+    fserr = frogfs_erase(&volume, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    /* Down to the records left, the block headers going ahead of their data (FROGFS_HEADER_STEP) may have raised it further */
+    FROGFS_ASSERT((volume.high_water <= mark), true);
+    FROGFS_ASSERT((volume.high_water >= (t_frogfs_offset)(volume.records[2].offset + TEST_METADATA_SIZE + strlen(TEST_CONTENT) + TEST_RESERVED_SIZE)), true);
+    mark = volume.high_water;
+
+    /* Simulate a power cut before the mark went back: the scan moves it back */
+    for (i = 0; i < TEST_POINTER_SIZE; i++)
+    {
+        tmp[i] = (uint8_t)((t_frogfs_offset)TEST_STORAGE_SIZE >> (8U * i));
+    }
+    fserr = storage_cache_write_at(&volume.storage, 5U, tmp, TEST_POINTER_SIZE);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+#ifdef FROGFS_USE_CHECKPOINT
+    fserr = storage_cache_write_at(&volume.storage, TEST_HEADER_SIZE, &zero, 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+#endif
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.high_water, mark);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.high_water, mark);
+    test_reopen_files(0, 2);
+
+    /* Erasing a record in the middle keeps the mark, erasing the last ones moves it */
+    fserr = frogfs_erase(&volume, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.high_water, mark);
+    fserr = frogfs_erase(&volume, 2);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_erase(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT((volume.high_water < mark), true);
+    FROGFS_ASSERT(((t_frogfs_offset)(volume.high_water - empty) < FROGFS_HIGH_WATER_STEP), true);
+    empty = volume.high_water;
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.high_water, empty);
+#endif
+
+    return 0;
+}
+
+/**
+ * This test is used to verify that frogfs_maintenance_step builds the free-extent map
+ * a few bytes at a time, that it starts over when the storage changes in the meantime
+ * and that it ends up with the map of the full storage scan.
+ *
+ * @return  0 (or asserts)
+ */
+int test_maintenance(void)
+{
+    t_e_frogfs_error fserr;
+    t_s_frogfs_extent map[FROGFS_MAX_FREE_EXTENTS];
+    uint8_t count;
+    t_frogfs_offset space_start;
+    t_frogfs_offset data_start;
+    t_frogfs_offset data_size;
+    uint16_t steps = 0U;
+    bool more = false;
+    uint8_t i;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    for (i = 0; i < 4U; i++)
+    {
+        fserr = frogfs_open(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_write(&volume, i, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_close(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+    fserr = frogfs_erase(&volume, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_erase(&volume, 2);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Nothing to do once the map is built */
+    fserr = frogfs_maintenance_step(&volume, 16U, &more);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+#ifndef FROGFS_USE_COMPACTION
+    FROGFS_ASSERT(more, false);
+#endif
+
+    /* As after a checkpoint load: the map has not been built */
+    volume.free_map_valid = false;
+    fserr = frogfs_maintenance_step(&volume, 16U, &more);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(more, true);
+    FROGFS_ASSERT(volume.free_map_valid, false);
+    FROGFS_ASSERT((volume.scan_pos > 0U), true);
+
+    /* The storage changes under the scan: it starts over */
+    fserr = frogfs_erase_range(&volume, (t_frogfs_offset)(TEST_STORAGE_SIZE - 16U), 16U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.scan_pos, 0U);
+
+    do
+    {
+        fserr = frogfs_maintenance_step(&volume, 16U, &more);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        steps++;
+        FROGFS_ASSERT((steps < 1000U), true);
+    } while (more == true);
+    FROGFS_ASSERT((steps > 1U), true);
+    FROGFS_ASSERT(volume.free_map_valid, true);
+    test_reopen_files(0, 0);
+    test_reopen_files(3, 3);
+
+    /* Same map as the full scan */
+    count = volume.free_map_count;
+    (void)memcpy(map, volume.free_map, sizeof(map));
+    volume.free_map_valid = false;
+    fserr = frogfs_find_contiguous_space(&volume, &space_start, &data_start, &data_size);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.free_map_count, count);
+    for (i = 0; i < count; i++)
+    {
+        FROGFS_ASSERT(volume.free_map[i].start, map[i].start);
+        FROGFS_ASSERT(volume.free_map[i].size, map[i].size);
+    }
+
+    return 0;
+}
+
+/**
+ * This test is used to verify that frogfs_maintenance_step compacts a storage with more
+ * holes than the free-extent map holds, with a budget smaller than the storage.
+ *
+ * @return  0 (or asserts)
+ */
+int test_maintenance_holes(void)
+{
+#ifdef FROGFS_USE_COMPACTION
+    t_e_frogfs_error fserr;
+    t_frogfs_offset offsets[2U * FROGFS_MAX_FREE_EXTENTS];
+    uint8_t data[16];
+    uint16_t effective_read;
+    uint16_t steps = 0U;
+    bool more = false;
+    uint8_t i;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Every other record erased: more holes than the map entries */
+    for (i = 0; i < (2U * FROGFS_MAX_FREE_EXTENTS); i++)
+    {
+        (void)memset(data, (int)(i + 1U), sizeof(data));
+        fserr = frogfs_open(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_write(&volume, i, data, sizeof(data));
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_close(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        offsets[i] = volume.records[i].offset;
+    }
+    for (i = 0; i < (2U * FROGFS_MAX_FREE_EXTENTS); i += 2U)
+    {
+        fserr = frogfs_erase(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+
+    do
+    {
+        fserr = frogfs_maintenance_step(&volume, 64U, &more);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        steps++;
+        FROGFS_ASSERT((steps < 2000U), true);
+    } while (more == true);
+    FROGFS_ASSERT(volume.free_map_valid, true);
+
+    /* The records have been moved towards the beginning, one after the other */
+    FROGFS_ASSERT(volume.records[1].offset, offsets[0]);
+    for (i = 3U; i < (2U * FROGFS_MAX_FREE_EXTENTS); i += 2U)
+    {
+        FROGFS_ASSERT((volume.records[i].offset < offsets[i - 1U]), true);
+        fserr = frogfs_pread(&volume, i, 0U, data, sizeof(data), &effective_read);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        FROGFS_ASSERT(effective_read, sizeof(data));
+        FROGFS_ASSERT(data[15], i + 1U);
+    }
+#endif
+
+    return 0;
+}
+
+/**
+ * This test is used to verify that the block cache absorbs repeated small writes
+ * and that the data reaches the storage when the record is closed.
+ *
+ * @return  0 (or asserts)
+ */
+int test_cache(void)
+{
+#ifdef FROGFS_USE_CACHE
+    t_e_frogfs_error fserr;
+    t_s_storage_cache_stats stats;
+    uint8_t tmp[TEST_METADATA_SIZE];
+    uint8_t i;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    fserr = frogfs_open(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    storage_cache_reset_stats(&volume.storage);
+    for (i = 0; i < 20U; i++)
+    {
+        fserr = frogfs_write(&volume, 0, &i, 1U);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+
+    /* The record header is updated at every write: most accesses hit the cache */
+    storage_cache_get_stats(&volume.storage, &stats);
+    FROGFS_ASSERT(stats.hits > stats.misses, true);
+
+    /* The final size is not on the storage yet */
+    fserr = storage_read_at(volume.records[0].offset, tmp, TEST_METADATA_SIZE);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(tmp[TEST_METADATA_SIZE - 1U] != 20U, true);
+
+    /* Closing the record flushes the cache */
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = storage_read_at(volume.records[0].offset, tmp, TEST_METADATA_SIZE);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(tmp[TEST_METADATA_SIZE - 1U], 20U);
+#endif
+
+    return 0;
+}
+
+/**
+ * This test is used to verify that the block header is only updated when the block
+ * is full, at frogfs_flush and at frogfs_close when the header update is deferred.
+ *
+ * @return  0 (or asserts)
+ */
+int test_deferred_header(void)
+{
+    t_e_frogfs_error fserr;
+    uint8_t tmp[TEST_METADATA_SIZE];
+    uint8_t read_buffer[40];
+    uint16_t effective_read;
+    uint8_t i;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    fserr = frogfs_open(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    for (i = 0; i < 10U; i++)
+    {
+        fserr = frogfs_write(&volume, 0, &i, 1U);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+
+    fserr = storage_cache_read_at(&volume.storage, volume.records[0].offset, tmp, TEST_METADATA_SIZE);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+#ifdef FROGFS_USE_DEFERRED_HEADER
+    /* Stored once, ahead of the first byte */
+    FROGFS_ASSERT(tmp[TEST_METADATA_SIZE - 1U], 1U + FROGFS_HEADER_STEP);
+#else
+    FROGFS_ASSERT(tmp[TEST_METADATA_SIZE - 1U], 10U);
+#endif
+
+    /* Explicit commit: the record stays open for writing */
+    fserr = frogfs_flush(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = storage_cache_read_at(&volume.storage, volume.records[0].offset, tmp, TEST_METADATA_SIZE);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(tmp[TEST_METADATA_SIZE - 1U], 10U);
+
+    for (i = 10U; i < 40U; i++)
+    {
+        fserr = frogfs_write(&volume, 0, &i, 1U);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Nothing to flush on a closed record */
+    fserr = frogfs_flush(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_NOT_WRITABLE);
+
+    /* Simulate a power cycle and read back */
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_open(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_read(&volume, 0, read_buffer, sizeof(read_buffer), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, 40U);
+    for (i = 0; i < 40U; i++)
+    {
+        FROGFS_ASSERT(read_buffer[i], i);
+    }
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    return 0;
+}
+
+/**
+ * This test is used to verify that records can be appended to after being closed
+ * and after a power cycle, both in place and through a new fragment.
+ *
+ * @return  0 (or asserts)
+ */
+int test_append(void)
+{
+    t_e_frogfs_error fserr;
+    uint8_t data[20];
+    uint8_t read_buffer[sizeof(data)];
+    uint16_t effective_read;
+    t_frogfs_offset space_start[2];
+    t_frogfs_offset data_start[2];
+    t_frogfs_offset data_size[2];
+    uint8_t i;
+
+    for (i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(0xA0U + i);
+    }
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Appending to a record that does not exist creates it */
+    fserr = frogfs_open_append(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_write(&volume, 0, data, 10U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Record 1 is right after record 0 and its room for appending */
+    fserr = frogfs_open(&volume, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.records[1].offset, volume.records[0].offset + TEST_METADATA_SIZE + 10U + TEST_RESERVED_SIZE);
+    fserr = frogfs_write(&volume, 1, (const uint8_t*)TEST_CONTENT, strlen(TEST_CONTENT));
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&volume, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Simulate power-cycle, then append to record 0: it continues in a new fragment */
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_open_append(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_write(&volume, 0, &data[10], 6U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Append again: it continues in place, in the fragment */
+    fserr = frogfs_open_append(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_write(&volume, 0, &data[16], 4U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* The free space tracked in RAM matches the storage */
+    fserr = frogfs_find_contiguous_space(&volume, &space_start[0], &data_start[0], &data_size[0]);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_find_contiguous_space(&volume, &space_start[1], &data_start[1], &data_size[1]);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(space_start[0], space_start[1]);
+    FROGFS_ASSERT(data_size[0], data_size[1]);
+
+    /* Read back */
+    fserr = frogfs_open(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_read(&volume, 0, read_buffer, sizeof(read_buffer), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, sizeof(data));
+    FROGFS_ASSERT(memcmp(read_buffer, data, sizeof(data)), 0);
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    test_reopen_files(1, 1);
+
+    /* Erasing the appended record gives all of its space back */
+    fserr = frogfs_erase(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_find_contiguous_space(&volume, &space_start[0], &data_start[0], &data_size[0]);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_find_contiguous_space(&volume, &space_start[1], &data_start[1], &data_size[1]);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(space_start[0], space_start[1]);
+    FROGFS_ASSERT(data_size[0], data_size[1]);
+
+    return 0;
+}
+
+/**
+ * This test is used to verify that fragmented records are traversed through the
+ * extent cache, also when their chain is longer than the cache.
+ *
+ * @return  0 (or asserts)
+ */
+int test_extent_cache(void)
+{
+    t_e_frogfs_error fserr;
+    uint16_t len = (uint16_t)strlen(TEST_CONTENT);
+    t_frogfs_offset pointer_pos;
+    uint16_t effective_read;
+    t_frogfs_offset space_start[2];
+    t_frogfs_offset data_start[2];
+    t_frogfs_offset data_size[2];
+    uint8_t pointer[TEST_METADATA_SIZE];
+    uint8_t zeros[TEST_METADATA_SIZE] = {0U};
+    uint8_t data[30];
+    uint8_t i;
+    uint8_t j;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Same layout as test_free_map: record 2 starts in a hole and ends in a fragment */
+    for (i = 0; i < 2U; i++)
+    {
+        fserr = frogfs_open(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_write(&volume, i, (const uint8_t*)TEST_CONTENT, (uint16_t)(len - ((i == 0U) ? TEST_RESERVED_SIZE : 0U)));
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_close(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+    fserr = frogfs_erase(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+#ifdef FROGFS_USE_NEXT_FIT
+    /* First fit layout: search from the beginning */
+    volume.alloc_cursor = 0U;
+#endif
+    fserr = frogfs_open(&volume, 2);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_write(&volume, 2, (const uint8_t*)TEST_CONTENT, len);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&volume, 2);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    pointer_pos = (t_frogfs_offset)(volume.records[2].offset + TEST_METADATA_SIZE + len - TEST_RESERVED_SIZE);
+
+    /* The first read locates all the blocks */
+    fserr = frogfs_open(&volume, 2);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_read(&volume, 2, read_buffer, 1U, &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, 1U);
+
+    /* Hide the fragment pointer: the rest of the record is still found */
+    fserr = storage_cache_read_at(&volume.storage, pointer_pos, pointer, sizeof(pointer));
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+#ifdef FROGFS_USE_EXTENDED_INDEX
+    FROGFS_ASSERT(pointer[0], 0x80U | 0x40U);
+    FROGFS_ASSERT(pointer[1], 3U);
+#else
+    FROGFS_ASSERT(pointer[0], 0x80U | 3U);
+#endif
+    fserr = storage_cache_write_at(&volume.storage, pointer_pos, zeros, sizeof(zeros));
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+#if defined(FROGFS_USE_EXTENT_CACHE) && (FROGFS_EXTENT_CACHE_SIZE >= 2U)
+    fserr = frogfs_read(&volume, 2, &read_buffer[1], (uint16_t)(len - 1U), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, len - 1U);
+    FROGFS_ASSERT(memcmp(read_buffer, TEST_CONTENT, len), 0);
+#endif
+    fserr = storage_cache_write_at(&volume.storage, pointer_pos, pointer, sizeof(pointer));
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&volume, 2);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    test_reopen_files(1, 2);
+
+    /* Interleaved appends: records 3 and 4 get 6 blocks each, more than the cache holds */
+    for (i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(0x30U + i);
+    }
+    for (j = 0; j < 6U; j++)
+    {
+        for (i = 3U; i <= 4U; i++)
+        {
+            fserr = frogfs_open_append(&volume, i);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            fserr = frogfs_write(&volume, i, &data[j * 5U], 5U);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            fserr = frogfs_close(&volume, i);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        }
+    }
+
+    for (i = 3U; i <= 4U; i++)
+    {
+        fserr = frogfs_open(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_read(&volume, i, read_buffer, sizeof(data), &effective_read);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        FROGFS_ASSERT(effective_read, sizeof(data));
+        FROGFS_ASSERT(memcmp(read_buffer, data, sizeof(data)), 0);
+        fserr = frogfs_close(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+
+    /* Erasing through the cache gives all the space back */
+    for (i = 2U; i <= 4U; i++)
+    {
+        fserr = frogfs_erase(&volume, i);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+    fserr = frogfs_find_contiguous_space(&volume, &space_start[0], &data_start[0], &data_size[0]);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_find_contiguous_space(&volume, &space_start[1], &data_start[1], &data_size[1]);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(space_start[0], space_start[1]);
+    FROGFS_ASSERT(data_size[0], data_size[1]);
+    test_reopen_files(1, 1);
+
+    return 0;
+}
+
+/**
+ * This test is used to verify random access reads in a fragmented record,
+ * including offsets at block boundaries and at the end of the record.
+ *
+ * @return  0 (or asserts)
+ */
+int test_seek(void)
+{
+    t_e_frogfs_error fserr;
+    uint8_t data[30];
+    uint16_t effective_read;
+    uint16_t offsets[] = {0U, 4U, 5U, 14U, 17U, 25U, 29U};
+    uint8_t i;
+    uint8_t j;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Records 0 and 1 get 6 blocks of 5 bytes each */
+    for (i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(0x30U + i);
+    }
+    for (j = 0; j < 6U; j++)
+    {
+        for (i = 0U; i <= 1U; i++)
+        {
+            fserr = frogfs_open_append(&volume, i);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            fserr = frogfs_write(&volume, i, &data[j * 5U], 5U);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+            /* No random access while writing */
+            fserr = frogfs_seek(&volume, i, 0U);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_NOT_READABLE);
+
+            fserr = frogfs_close(&volume, i);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        }
+    }
+
+    fserr = frogfs_open(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    for (i = 0; i < (sizeof(offsets) / sizeof(offsets[0])); i++)
+    {
+        /* Read up to 8 bytes at the offset */
+        (void)memset(read_buffer, 0, sizeof(read_buffer));
+        fserr = frogfs_pread(&volume, 0, offsets[i], read_buffer, 8U, &effective_read);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        FROGFS_ASSERT(effective_read, (offsets[i] + 8U <= sizeof(data)) ? 8U : sizeof(data) - offsets[i]);
+        FROGFS_ASSERT(memcmp(read_buffer, &data[offsets[i]], effective_read), 0);
+    }
+
+    /* Seek, then continue reading sequentially up to the end */
+    fserr = frogfs_seek(&volume, 0, 12U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_read(&volume, 0, read_buffer, 3U, &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, 3U);
+    fserr = frogfs_read(&volume, 0, &read_buffer[3], sizeof(read_buffer) - 3U, &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, sizeof(data) - 15U);
+    FROGFS_ASSERT(memcmp(read_buffer, &data[12], sizeof(data) - 12U), 0);
+
+    /* The end of the record is a valid position, beyond is not */
+    fserr = frogfs_pread(&volume, 0, sizeof(data), read_buffer, 8U, &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, 0U);
+    fserr = frogfs_seek(&volume, 0, sizeof(data) + 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OUT_OF_RANGE);
+
+    /* Back to the start */
+    fserr = frogfs_pread(&volume, 0, 0U, read_buffer, sizeof(read_buffer), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, sizeof(data));
+    FROGFS_ASSERT(memcmp(read_buffer, data, sizeof(data)), 0);
+
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Not existing record */
+    fserr = frogfs_seek(&volume, 2, 0U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_INVALID_OPERATION);
+
+    return 0;
+}
+
+/**
+ * Check the size and the number of blocks of a record as given by frogfs_stat.
+ */
+void check_stat(uint8_t record, t_frogfs_offset expected_size, uint16_t expected_fragments)
+{
+    t_e_frogfs_error fserr;
+    t_s_frogfs_record_info info;
+
+    fserr = frogfs_stat(&volume, record, &info);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(info.size, expected_size);
+    FROGFS_ASSERT(info.fragments, expected_fragments);
+}
+
+/**
+ * This test is used to verify that the record size and fragment count are known
+ * after the storage scan, after loading the checkpoint and while writing.
+ *
+ * @return  0 (or asserts)
+ */
+int test_stat(void)
+{
+    t_e_frogfs_error fserr;
+    t_s_frogfs_record_info info;
+    uint16_t len = (uint16_t)strlen(TEST_CONTENT);
+    uint8_t i;
+    uint8_t j;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    fserr = frogfs_open(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    check_stat(0, 0U, 1U);
+    fserr = frogfs_write(&volume, 0, (const uint8_t*)TEST_CONTENT, len);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    check_stat(0, len, 1U);
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Records 1 and 2 get 6 blocks of 5 bytes each */
+    for (j = 0; j < 6U; j++)
+    {
+        for (i = 1U; i <= 2U; i++)
+        {
+            fserr = frogfs_open_append(&volume, i);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            fserr = frogfs_write(&volume, i, (const uint8_t*)TEST_CONTENT, 5U);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            fserr = frogfs_close(&volume, i);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        }
+    }
+    check_stat(1, 30U, 6U);
+
+    /* Simulate power-cycles: from the storage scan, then (if enabled) from the checkpoint */
+    for (j = 0; j < 2U; j++)
+    {
+        fserr = frogfs_init(&volume);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        check_stat(0, len, 1U);
+        check_stat(1, 30U, 6U);
+        check_stat(2, 30U, 6U);
+    }
+
+    /* Erased and not existing records */
+    fserr = frogfs_erase(&volume, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_stat(&volume, 1, &info);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_INVALID_OPERATION);
+    fserr = frogfs_stat(&volume, 3, &info);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_INVALID_OPERATION);
+    fserr = frogfs_stat(&volume, 0, NULL);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_NULL_POINTER);
+    check_stat(2, 30U, 6U);
+
+    return 0;
+}
+
+/**
+ * Create a record of the given size, filled with a constant.
+ */
+static void test_open_sized_write(t_frogfs_record record, t_frogfs_offset expected_size, uint16_t size)
+{
+    t_e_frogfs_error fserr;
+    uint8_t data[100];
+
+    (void)memset(data, (int)(record + 1U), sizeof(data));
+    fserr = frogfs_open_sized(&volume, record, expected_size);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_write(&volume, record, data, size);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&volume, record);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+}
+
+/**
+ * This test is used to verify that a record opened with its expected size is created
+ * in the smallest hole that takes it whole (or in the largest hole) instead of the first one.
+ *
+ * @return  0 (or asserts)
+ */
+int test_open_sized(void)
+{
+    t_e_frogfs_error fserr;
+    t_frogfs_offset hole1;
+    t_frogfs_offset hole3;
+    t_frogfs_offset tail;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Holes of 40 and 100 bytes of data, then the free space at the end */
+    test_open_sized_write(0, 0U, 10U);
+    test_open_sized_write(1, 0U, 40U);
+    test_open_sized_write(2, 0U, 10U);
+    test_open_sized_write(3, 0U, 100U);
+    test_open_sized_write(4, 0U, 10U);
+    hole1 = volume.records[1].offset;
+    hole3 = volume.records[3].offset;
+    fserr = frogfs_erase(&volume, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_erase(&volume, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* 60 bytes do not fit the first hole: the second one is the best fit */
+    test_open_sized_write(5, 60U, 60U);
+    FROGFS_ASSERT(volume.records[5].offset, hole3);
+    check_stat(5, 60U, 1U);
+
+    /* The smallest hole that fits: not the 40 bytes left after record 5 */
+    test_open_sized_write(6, 35U, 35U);
+    FROGFS_ASSERT(volume.records[6].offset, hole1);
+    check_stat(6, 35U, 1U);
+
+    /* Larger than any hole: the largest one, at the end */
+    tail = volume.free_map[volume.free_map_count - 1U].start;
+    fserr = frogfs_open_sized(&volume, 7, (t_frogfs_offset)(TEST_STORAGE_SIZE * 2U));
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.records[7].offset, tail);
+    fserr = frogfs_close(&volume, 7);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* An existing record is opened as it is */
+    fserr = frogfs_open_sized(&volume, 5, 10U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.records[5].offset, hole3);
+    fserr = frogfs_close(&volume, 5);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    check_stat(5, 60U, 1U);
+
+    return 0;
+}
+
+/**
+ * This test is used to verify that a reserved record is written in a single block,
+ * without any allocation (the free-extent map does not change) up to the reserved size.
+ *
+ * @return  0 (or asserts)
+ */
+int test_reserve(void)
+{
+    t_e_frogfs_error fserr;
+    t_s_frogfs_extent map[FROGFS_MAX_FREE_EXTENTS];
+    uint8_t count;
+    uint8_t data[10];
+    t_frogfs_offset hole1;
+    uint16_t effective_read;
+    uint8_t i;
+    uint8_t j;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* A hole of 40 bytes of data before the free space at the end */
+    test_open_sized_write(0, 0U, 10U);
+    test_open_sized_write(1, 0U, 40U);
+    test_open_sized_write(2, 0U, 10U);
+    hole1 = volume.records[1].offset;
+    fserr = frogfs_erase(&volume, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Invalid requests */
+    fserr = frogfs_reserve(&volume, 0, 10U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_INVALID_OPERATION);
+    fserr = frogfs_reserve(&volume, 3, (t_frogfs_offset)(FROGFS_MAX_BLOCK_SIZE + 1UL));
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OUT_OF_RANGE);
+    fserr = frogfs_reserve(&volume, 3, TEST_STORAGE_SIZE);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_NOSPACE);
+    FROGFS_ASSERT(volume.records[3].offset, 0U);
+
+    /* 30 bytes: the hole is the best fit */
+    fserr = frogfs_reserve(&volume, 3, 30U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.records[3].offset, hole1);
+    count = volume.free_map_count;
+    (void)memcpy(map, volume.free_map, sizeof(map));
+
+    for (i = 0; i < 3U; i++)
+    {
+        (void)memset(data, (int)(i + 1U), sizeof(data));
+        fserr = frogfs_write(&volume, 3, data, sizeof(data));
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+        /* No allocation */
+        FROGFS_ASSERT(volume.free_map_count, count);
+        for (j = 0; j < count; j++)
+        {
+            FROGFS_ASSERT(volume.free_map[j].start, map[j].start);
+            FROGFS_ASSERT(volume.free_map[j].size, map[j].size);
+        }
+    }
+    fserr = frogfs_close(&volume, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    check_stat(3, 30U, 1U);
+
+    /* Simulate power-cycle */
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    check_stat(3, 30U, 1U);
+    fserr = frogfs_pread(&volume, 3, 20U, data, sizeof(data), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, sizeof(data));
+    FROGFS_ASSERT(data[9], 3U);
+
+    return 0;
+}
+
+/**
+ * This test is used to verify that the next fit search resumes after the block
+ * allocated last and only reuses the holes at the beginning once the end of the
+ * storage is full.
+ *
+ * @return  0 (or asserts)
+ */
+int test_next_fit(void)
+{
+#ifdef FROGFS_USE_NEXT_FIT
+    t_e_frogfs_error fserr;
+    t_frogfs_offset space_start;
+    t_frogfs_offset data_start;
+    t_frogfs_offset data_size;
+    t_frogfs_offset hole0;
+    uint8_t data[64];
+    uint16_t chunk;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* A hole at the beginning of the storage */
+    test_open_sized_write(0, 0U, 10U);
+    test_open_sized_write(1, 0U, 10U);
+    hole0 = volume.records[0].offset;
+    fserr = frogfs_erase(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* The hole is skipped: record 2 follows record 1 */
+    test_open_sized_write(2, 0U, 10U);
+    FROGFS_ASSERT((volume.records[2].offset > volume.records[1].offset), true);
+
+    /* Record 3 fills the rest of the storage */
+    fserr = frogfs_find_contiguous_space(&volume, &space_start, &data_start, &data_size);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT((space_start > volume.records[2].offset), true);
+    fserr = frogfs_open(&volume, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(volume.records[3].offset, space_start);
+    (void)memset(data, 0x33, sizeof(data));
+    while (data_size > 0U)
+    {
+        chunk = (data_size > sizeof(data)) ? (uint16_t)sizeof(data) : (uint16_t)data_size;
+        fserr = frogfs_write(&volume, 3, data, chunk);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        data_size -= chunk;
+    }
+    fserr = frogfs_close(&volume, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    check_stat(3, (t_frogfs_offset)(storage_cache_size(&volume.storage) - space_start - (2U * TEST_METADATA_SIZE + 1U)), 1U);
+
+    /* The search wraps around to the hole */
+    test_open_sized_write(4, 0U, 10U);
+    FROGFS_ASSERT(volume.records[4].offset, hole0);
+
+    /* Simulate power-cycle */
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    check_stat(4, 10U, 1U);
+#endif
+
+    return 0;
+}
+
+/**
+ * This test is used to verify that read handles keep independent positions in the
+ * same record, also interleaved with frogfs_read.
+ *
+ * @return  0 (or asserts)
+ */
+int test_handles(void)
+{
+    t_e_frogfs_error fserr;
+    t_s_frogfs_handle handle[2];
+    uint8_t data[30];
+    uint8_t buffer[2][sizeof(data)];
+    uint16_t effective_read;
+    uint8_t i;
+    uint8_t j;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    printf_frogfserror(fserr);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Records 0 and 1 get 6 blocks of 5 bytes each */
+    for (i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(0x40U + i);
+    }
+    for (j = 0; j < 6U; j++)
+    {
+        for (i = 0U; i <= 1U; i++)
+        {
+            fserr = frogfs_open_append(&volume, i);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            fserr = frogfs_write(&volume, i, &data[j * 5U], 5U);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            fserr = frogfs_close(&volume, i);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        }
+    }
+
+    fserr = frogfs_handle_open(&volume, &handle[0], 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_handle_open(&volume, &handle[1], 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_handle_seek(&handle[1], 13U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* The record is also read on its own */
+    fserr = frogfs_open(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Interleaved reads of 3 bytes */
+    for (j = 0; j < 6U; j++)
+    {
+        fserr = frogfs_handle_read(&handle[0], &buffer[0][j * 3U], 3U, &effective_read);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        FROGFS_ASSERT(effective_read, 3U);
+        fserr = frogfs_read(&volume, 0, &read_buffer[j * 3U], 3U, &effective_read);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        FROGFS_ASSERT(effective_read, 3U);
+        fserr = frogfs_handle_read(&handle[1], &buffer[1][j * 3U], 3U, &effective_read);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        FROGFS_ASSERT(effective_read, (j < 5U) ? 3U : 2U);
+    }
+    FROGFS_ASSERT(memcmp(buffer[0], data, 18U), 0);
+    FROGFS_ASSERT(memcmp(read_buffer, data, 18U), 0);
+    FROGFS_ASSERT(memcmp(buffer[1], &data[13], 17U), 0);
+
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    for (i = 0; i < 2U; i++)
+    {
+        fserr = frogfs_handle_close(&handle[i]);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+
+    /* Closed handle and not existing record */
+    fserr = frogfs_handle_read(&handle[0], buffer[0], 1U, &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_INVALID_OPERATION);
+    fserr = frogfs_handle_close(&handle[0]);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_INVALID_OPERATION);
+    fserr = frogfs_handle_open(&volume, &handle[0], 2);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_INVALID_OPERATION);
+
+    /* No reading while writing */
+    fserr = frogfs_handle_open(&volume, &handle[0], 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_open_append(&volume, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_handle_read(&handle[0], buffer[0], 1U, &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_NOT_READABLE);
+    fserr = frogfs_close(&volume, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_handle_read(&handle[0], buffer[0], sizeof(data), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, sizeof(data));
+    FROGFS_ASSERT(memcmp(buffer[0], data, sizeof(data)), 0);
+    fserr = frogfs_handle_close(&handle[0]);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    return 0;
+}
+
+#ifdef __linux__
+/**
+ * This test is used to verify that two volumes on two storage instances can be
+ * used side by side without affecting each other.
+ *
+ * @return  0 (or asserts)
+ */
+int test_volumes(void)
+{
+    t_e_frogfs_error fserr;
+    t_s_frogfs_volume other;
+#ifdef FROGFS_STORAGE_MMAP
+    t_s_mmap_storage storage;
+#else
+    t_s_file_storage storage;
+#endif
+    t_s_frogfs_record_info info;
+    t_frogfs_record list[FROGFS_MAX_RECORD_COUNT];
+    t_frogfs_record file_num;
+    uint16_t effective_read;
+
+#ifdef FROGFS_STORAGE_MMAP
+    mmap_storage_open(&storage, "eeprom1.bin", 512U);
+    frogfs_volume_setup(&other, &mmap_storage_ops, &storage);
+#else
+    file_storage_open(&storage, "eeprom1.bin", 512U);
+    frogfs_volume_setup(&other, &file_storage_ops, &storage);
+#endif
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_format(&other);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&other);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Record 0 on both volumes, with different content, record 3 on the other one only */
+    fserr = frogfs_open(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_open(&other, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_write(&volume, 0, (const uint8_t*)TEST_CONTENT, 10U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_write(&other, 0, (const uint8_t*)&TEST_CONTENT[10], 12U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&other, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    fserr = frogfs_open(&other, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_write(&other, 3, (const uint8_t*)TEST_CONTENT, 5U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_close(&other, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    fserr = frogfs_list(&volume, list, FROGFS_MAX_RECORD_COUNT, &file_num);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(file_num, 1U);
+    fserr = frogfs_list(&other, list, FROGFS_MAX_RECORD_COUNT, &file_num);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(file_num, 2U);
+
+    /* Mount the other volume again: the first one is not affected */
+    fserr = frogfs_init(&other);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    fserr = frogfs_stat(&volume, 0, &info);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(info.size, 10U);
+    fserr = frogfs_stat(&other, 0, &info);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(info.size, 12U);
+
+    fserr = frogfs_open(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_read(&volume, 0, read_buffer, sizeof(read_buffer), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, 10U);
+    FROGFS_ASSERT(memcmp(read_buffer, TEST_CONTENT, 10U), 0);
+    fserr = frogfs_close(&volume, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    fserr = frogfs_open(&other, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_read(&other, 0, read_buffer, sizeof(read_buffer), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, 12U);
+    FROGFS_ASSERT(memcmp(read_buffer, &TEST_CONTENT[10], 12U), 0);
+    fserr = frogfs_close(&other, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    fserr = storage_cache_close(&other.storage);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    frogfs_volume_release(&other);
+
+    return 0;
+}
+#endif
+
+#ifdef __linux__
+#ifdef FROGFS_USE_LARGE_STORAGE
+#define TEST_LARGE_CHUNK            (1000U)
+/* Number of blocks of a record written at once in a single hole */
+#define TEST_LARGE_BLOCKS(length)   (((length) + FROGFS_MAX_BLOCK_SIZE - 1UL) / FROGFS_MAX_BLOCK_SIZE)
+
+static uint8_t test_large_pattern(uint8_t record, uint32_t pos)
+{
+    return (uint8_t)((pos * 7U) + (pos >> 8U) + record);
+}
+
+/**
+ * Write length bytes of the test pattern to a record, in chunks.
+ */
+static void test_large_write(t_s_frogfs_volume *large, uint8_t record, uint32_t length)
+{
+    t_e_frogfs_error fserr;
+    uint8_t chunk[TEST_LARGE_CHUNK];
+    uint32_t pos;
+    uint16_t i;
+
+    fserr = frogfs_open(large, record);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    for (pos = 0; pos < length; pos += TEST_LARGE_CHUNK)
+    {
+        for (i = 0; i < TEST_LARGE_CHUNK; i++)
+        {
+            chunk[i] = test_large_pattern(record, pos + i);
+        }
+        fserr = frogfs_write(large, record, chunk, TEST_LARGE_CHUNK);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+    fserr = frogfs_close(large, record);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+}
+
+/**
+ * Read a record back and compare it with the test pattern.
+ */
+static void test_large_check(t_s_frogfs_volume *large, uint8_t record, uint32_t length)
+{
+    t_e_frogfs_error fserr;
+    uint8_t chunk[TEST_LARGE_CHUNK];
+    uint16_t effective_read;
+    uint32_t pos = 0U;
+    uint16_t i;
+
+    fserr = frogfs_open(large, record);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    do
+    {
+        fserr = frogfs_read(large, record, chunk, sizeof(chunk), &effective_read);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        for (i = 0; i < effective_read; i++)
+        {
+            FROGFS_ASSERT(chunk[i], test_large_pattern(record, pos + i));
+        }
+        pos += effective_read;
+    } while (effective_read > 0U);
+    FROGFS_ASSERT(pos, length);
+    fserr = frogfs_close(large, record);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+}
+#endif
+
+/**
+ * This test is used to verify that a storage larger than the metadata can address
+ * is rejected by the format version 1, and that the format version 2
+ * (FROGFS_USE_LARGE_STORAGE) holds records and fragments beyond the first 64KB,
+ * records larger than a block being chained transparently. The last record ends beyond
+ * 1MB, where the cache block numbers no longer fit 16 bits.
+ *
+ * @return  0 (or asserts)
+ */
+int test_large_storage(void)
+{
+    t_e_frogfs_error fserr;
+    t_s_frogfs_volume large;
+#ifdef FROGFS_STORAGE_MMAP
+    t_s_mmap_storage storage;
+#else
+    t_s_file_storage storage;
+#endif
+#ifdef FROGFS_USE_LARGE_STORAGE
+    t_s_frogfs_record_info info;
+    uint8_t data[10];
+    uint16_t effective_read;
+    t_frogfs_offset size = 2048UL * 1024UL;
+#else
+    t_frogfs_offset size = 40U * 1024U;
+#endif
+
+#ifdef FROGFS_STORAGE_MMAP
+    mmap_storage_open(&storage, "eeprom2.bin", size);
+    frogfs_volume_setup(&large, &mmap_storage_ops, &storage);
+#else
+    file_storage_open(&storage, "eeprom2.bin", size);
+    frogfs_volume_setup(&large, &file_storage_ops, &storage);
+#endif
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&large);
+#ifdef FROGFS_USE_LARGE_STORAGE
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&large);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Record 0 is larger than 64KB, record 1 starts after it */
+    test_large_write(&large, 0, 100U * TEST_LARGE_CHUNK);
+    test_large_write(&large, 1, 20U * TEST_LARGE_CHUNK);
+    FROGFS_ASSERT(large.records[1].offset > 0x10000UL, true);
+
+    /* Record 0 is written in one go but chained in blocks of FROGFS_MAX_BLOCK_SIZE */
+    fserr = frogfs_stat(&large, 0, &info);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(info.size, 100UL * TEST_LARGE_CHUNK);
+    FROGFS_ASSERT(info.fragments, TEST_LARGE_BLOCKS(100UL * TEST_LARGE_CHUNK));
+
+    /* Random access beyond 64KB */
+    fserr = frogfs_pread(&large, 0, 70000UL, data, sizeof(data), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, sizeof(data));
+    FROGFS_ASSERT(data[0], test_large_pattern(0, 70000UL));
+    FROGFS_ASSERT(data[9], test_large_pattern(0, 70009UL));
+
+    /* Random access across the end of the first block */
+    fserr = frogfs_pread(&large, 0, FROGFS_MAX_BLOCK_SIZE - 5UL, data, sizeof(data), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, sizeof(data));
+    FROGFS_ASSERT(data[0], test_large_pattern(0, FROGFS_MAX_BLOCK_SIZE - 5UL));
+    FROGFS_ASSERT(data[9], test_large_pattern(0, FROGFS_MAX_BLOCK_SIZE + 4UL));
+
+    /* Record 2 fills the hole of record 0 and continues in a fragment after record 1 */
+    fserr = frogfs_erase(&large, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+#ifdef FROGFS_USE_NEXT_FIT
+    /* First fit layout: search from the beginning */
+    large.alloc_cursor = 0U;
+#endif
+    test_large_write(&large, 2, 110U * TEST_LARGE_CHUNK);
+    fserr = frogfs_stat(&large, 2, &info);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(info.size, 110UL * TEST_LARGE_CHUNK);
+    FROGFS_ASSERT(info.fragments > TEST_LARGE_BLOCKS(100UL * TEST_LARGE_CHUNK), true);
+
+    /* Record 3 goes past 1MB */
+    test_large_write(&large, 3, 1200U * TEST_LARGE_CHUNK);
+    fserr = frogfs_pread(&large, 3, 1100000UL, data, sizeof(data), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, sizeof(data));
+    FROGFS_ASSERT(data[0], test_large_pattern(3, 1100000UL));
+
+    /* Simulate power-cycle: the metadata is scanned (or loaded) again */
+    fserr = frogfs_init(&large);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    test_large_check(&large, 1, 20U * TEST_LARGE_CHUNK);
+    test_large_check(&large, 2, 110U * TEST_LARGE_CHUNK);
+    test_large_check(&large, 3, 1200U * TEST_LARGE_CHUNK);
+#else
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OUT_OF_RANGE);
+#endif
+
+    fserr = storage_cache_close(&large.storage);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    frogfs_volume_release(&large);
+
+    return 0;
+}
+#endif
+
+#ifdef __linux__
+/* Power cut simulation: the storage operations of the test volume, failing once the
+ * budget of writes is spent */
+static const t_s_storage_ops *test_cut_ops;
+static void *test_cut_context;
+static uint16_t test_cut_budget;
+
+static t_frogfs_offset test_cut_size(void *context)
+{
+    (void)context;
+    return test_cut_ops->size(test_cut_context);
+}
+
+static t_e_frogfs_error test_cut_read_at(void *context, t_frogfs_offset offset, uint8_t *data, uint16_t size)
+{
+    (void)context;
+    return test_cut_ops->read_at(test_cut_context, offset, data, size);
+}
+
+static t_e_frogfs_error test_cut_write_at(void *context, t_frogfs_offset offset, const uint8_t *data, uint16_t size)
+{
+    (void)context;
+    if (test_cut_budget == 0U)
+    {
+        return FROGFS_ERR_IO;
+    }
+    test_cut_budget--;
+    return test_cut_ops->write_at(test_cut_context, offset, data, size);
+}
+
+static t_e_frogfs_error test_cut_fill(void *context, t_frogfs_offset offset, uint8_t value, t_frogfs_offset size)
+{
+    (void)context;
+    if (test_cut_budget == 0U)
+    {
+        return FROGFS_ERR_IO;
+    }
+    test_cut_budget--;
+    return test_cut_ops->fill(test_cut_context, offset, value, size);
+}
+
+static void test_cut_sync(void *context)
+{
+    (void)context;
+    test_cut_ops->sync(test_cut_context);
+}
+
+static t_e_frogfs_error test_cut_close(void *context)
+{
+    (void)context;
+    return test_cut_ops->close(test_cut_context);
+}
+
+static const t_s_storage_ops test_cut_storage_ops =
+{
+    test_cut_size,
+    test_cut_read_at,
+    test_cut_write_at,
+    test_cut_fill,
+    test_cut_sync,
+    test_cut_close
+};
+
+#ifdef FROGFS_USE_COMPACTION
+#define TEST_COMPACTION_RECORDS     (5U)
+
+static uint8_t test_compaction_pattern(uint8_t record, uint16_t pos)
+{
+    return (uint8_t)((record * 31U) + (pos * 7U) + 1U);
+}
+
+/**
+ * Write the bytes [from, from + length) of the test pattern to a record, appending to it.
+ */
+static void test_compaction_write(t_s_frogfs_volume *compacted, uint8_t record, uint16_t from, uint16_t length)
+{
+    t_e_frogfs_error fserr;
+    uint8_t data;
+    uint16_t i;
+
+    fserr = (from == 0U) ? frogfs_open(compacted, record) : frogfs_open_append(compacted, record);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    for (i = from; i < (from + length); i++)
+    {
+        data = test_compaction_pattern(record, i);
+        fserr = frogfs_write(compacted, record, &data, 1U);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+    fserr = frogfs_close(compacted, record);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+}
+
+/**
+ * Compare the records with the test pattern (0 length: the record does not exist).
+ */
+static void test_compaction_check(t_s_frogfs_volume *compacted, const uint16_t *lengths)
+{
+    t_e_frogfs_error fserr;
+    t_s_frogfs_record_info info;
+    uint8_t data[32];
+    uint16_t effective_read;
+    uint16_t pos;
+    uint16_t i;
+    uint8_t record;
+
+    for (record = 0; record < TEST_COMPACTION_RECORDS; record++)
+    {
+        fserr = frogfs_stat(compacted, record, &info);
+        if (lengths[record] == 0U)
+        {
+            FROGFS_ASSERT(fserr, FROGFS_ERR_INVALID_OPERATION);
+            continue;
+        }
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        FROGFS_ASSERT(info.size, lengths[record]);
+
+        for (pos = 0; pos < lengths[record]; pos += effective_read)
+        {
+            fserr = frogfs_pread(compacted, record, pos, data, sizeof(data), &effective_read);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            FROGFS_ASSERT((effective_read > 0U), true);
+            for (i = 0; i < effective_read; i++)
+            {
+                FROGFS_ASSERT(data[i], test_compaction_pattern(record, (uint16_t)(pos + i)));
+            }
+        }
+    }
+}
+#endif
+
+/**
+ * This test is used to verify that the compaction moves every record into a single
+ * block at the beginning of the storage, and that a compaction cut by a power loss
+ * after any write leaves the records intact once the volume is mounted again.
+ *
+ * @return  0 (or asserts)
+ */
+int test_compaction(void)
+{
+#ifdef FROGFS_USE_COMPACTION
+    t_e_frogfs_error fserr;
+    t_s_frogfs_volume compacted;
+#ifdef FROGFS_STORAGE_MMAP
+    t_s_mmap_storage storage;
+#else
+    t_s_file_storage storage;
+#endif
+    t_s_frogfs_record_info info;
+    static uint8_t image[TEST_STORAGE_SIZE];
+    const uint16_t lengths[TEST_COMPACTION_RECORDS] = { 40U, 0U, 110U, 0U, 60U };
+    uint16_t budget;
+    uint16_t fragmented = 0U;
+    uint8_t record;
+
+#ifdef FROGFS_STORAGE_MMAP
+    mmap_storage_open(&storage, "eeprom3.bin", TEST_STORAGE_SIZE);
+    test_cut_ops = &mmap_storage_ops;
+#else
+    /* The image is read back whole: start from a file of the right size */
+    (void)remove("eeprom3.bin");
+    file_storage_open(&storage, "eeprom3.bin", TEST_STORAGE_SIZE);
+    test_cut_ops = &file_storage_ops;
+#endif
+    test_cut_context = &storage;
+    frogfs_volume_setup(&compacted, test_cut_ops, test_cut_context);
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&compacted);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&compacted);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* Holes between the records, then appends that end up in fragments */
+    test_compaction_write(&compacted, 0, 0U, 40U);
+    test_compaction_write(&compacted, 1, 0U, 120U);
+    test_compaction_write(&compacted, 2, 0U, 30U);
+    test_compaction_write(&compacted, 3, 0U, 100U);
+    test_compaction_write(&compacted, 4, 0U, 20U);
+    test_compaction_write(&compacted, 2, 30U, 80U);
+    test_compaction_write(&compacted, 4, 20U, 40U);
+    fserr = frogfs_erase(&compacted, 1);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_erase(&compacted, 3);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    test_compaction_check(&compacted, lengths);
+    for (record = 0; record < TEST_COMPACTION_RECORDS; record++)
+    {
+        if ((frogfs_stat(&compacted, record, &info) == FROGFS_ERR_OK) && (info.fragments > 1U))
+        {
+            fragmented++;
+        }
+    }
+    FROGFS_ASSERT(fragmented, 2U);
+
+    /* Keep the fragmented storage for the power cut simulation */
+    storage_cache_sync(&compacted.storage);
+    fserr = test_cut_ops->read_at(test_cut_context, 0U, image, sizeof(image));
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    fserr = frogfs_compact(&compacted);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    test_compaction_check(&compacted, lengths);
+    for (record = 0; record < TEST_COMPACTION_RECORDS; record++)
+    {
+        if (lengths[record] > 0U)
+        {
+            fserr = frogfs_stat(&compacted, record, &info);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            FROGFS_ASSERT(info.fragments, 1U);
+        }
+    }
+
+    /* The free space is a single extent, at the end of the storage */
+    FROGFS_ASSERT(compacted.free_map_count, 1U);
+    FROGFS_ASSERT(((uint32_t)compacted.free_map[0].start + compacted.free_map[0].size), TEST_STORAGE_SIZE);
+
+    /* Nothing more to move */
+    fserr = frogfs_compact(&compacted);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&compacted);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    test_compaction_check(&compacted, lengths);
+    frogfs_volume_release(&compacted);
+
+    /* Cut the power after each write of the compaction in turn */
+    for (budget = 0U; ; budget++)
+    {
+        fserr = test_cut_ops->write_at(test_cut_context, 0U, image, sizeof(image));
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+        frogfs_volume_setup(&compacted, &test_cut_storage_ops, NULL);
+        test_cut_budget = UINT16_MAX;
+        fserr = frogfs_init(&compacted);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        test_cut_budget = budget;
+        fserr = frogfs_compact(&compacted);
+        if (fserr == FROGFS_ERR_OK)
+        {
+            /* The writes to the cache can still be pending */
+            fserr = storage_cache_flush(&compacted.storage);
+        }
+        frogfs_volume_release(&compacted);
+
+        /* Power back on: the move in progress is rolled back or completed */
+        frogfs_volume_setup(&compacted, test_cut_ops, test_cut_context);
+        fserr = frogfs_init(&compacted);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        test_compaction_check(&compacted, lengths);
+
+        if (test_cut_budget > 0U)
+        {
+            /* The compaction completed */
+            FROGFS_ASSERT(compacted.free_map_count, 1U);
+            frogfs_volume_release(&compacted);
+            break;
+        }
+
+        /* Compacting again after the recovery completes the job */
+        fserr = frogfs_compact(&compacted);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        test_compaction_check(&compacted, lengths);
+        frogfs_volume_release(&compacted);
+        FROGFS_ASSERT((budget < 1000U), true);
+    }
+    printf("compaction cut at %u points\r\n", budget);
+
+    fserr = test_cut_ops->close(test_cut_context);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+#endif
+
+    return 0;
+}
+
+/**
+ * This test is used to verify that the cache writes the dirty blocks back in the order
+ * they have been written: when a block is evicted, the blocks made dirty before it reach
+ * the storage first, e.g. a block header before the data written after it.
+ *
+ * @return  0 (or asserts)
+ */
+int test_cache_order(void)
+{
+#ifdef FROGFS_USE_CACHE
+    t_e_frogfs_error fserr;
+    t_s_storage_cache cache;
+#ifdef FROGFS_STORAGE_MMAP
+    t_s_mmap_storage storage;
+#else
+    t_s_file_storage storage;
+#endif
+    const uint8_t header = 0x5AU;
+    const uint8_t data = 0xA5U;
+    uint8_t tmp;
+    t_frogfs_offset block;
+
+    /* Start from an erased storage */
+    (void)remove("eeprom4.bin");
+#ifdef FROGFS_STORAGE_MMAP
+    mmap_storage_open(&storage, "eeprom4.bin", TEST_STORAGE_SIZE);
+    test_cut_ops = &mmap_storage_ops;
+#else
+    file_storage_open(&storage, "eeprom4.bin", TEST_STORAGE_SIZE);
+    test_cut_ops = &file_storage_ops;
+#endif
+    test_cut_context = &storage;
+    storage_cache_init(&cache, &test_cut_storage_ops, NULL);
+    test_cut_budget = UINT16_MAX;
+
+    /* The header block becomes dirty first, then two data blocks */
+    fserr = storage_cache_write_at(&cache, 0U, &header, 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = storage_cache_write_at(&cache, FROGFS_CACHE_BLOCK_SIZE, &data, 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = storage_cache_write_at(&cache, 2U * FROGFS_CACHE_BLOCK_SIZE, &data, 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* The first data block is now the least recently used one: evict it, the power
+     * being cut after a single write */
+    fserr = storage_cache_read_at(&cache, 0U, &tmp, 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    test_cut_budget = 1U;
+    for (block = 3U; (block <= FROGFS_CACHE_BLOCK_COUNT) && (fserr == FROGFS_ERR_OK); block++)
+    {
+        fserr = storage_cache_read_at(&cache, (t_frogfs_offset)(block * FROGFS_CACHE_BLOCK_SIZE), &tmp, 1U);
+    }
+    FROGFS_ASSERT(fserr, FROGFS_ERR_IO);
+
+    /* The header block went first, the data blocks did not make it */
+    fserr = test_cut_ops->read_at(test_cut_context, 0U, &tmp, 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(tmp, header);
+    fserr = test_cut_ops->read_at(test_cut_context, FROGFS_CACHE_BLOCK_SIZE, &tmp, 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(tmp, 0U);
+
+    /* Power back on: the rest is written back, in order */
+    test_cut_budget = UINT16_MAX;
+    fserr = storage_cache_close(&cache);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    storage_cache_release(&cache);
+#endif
+
+    return 0;
+}
+
+/**
+ * Compare a record with the given byte, followed by zeros: the bytes not written when
+ * the power was cut (0 length: the record may not exist).
+ */
+static void test_power_cut_check(t_s_frogfs_volume *cut, t_frogfs_record record, uint8_t value, uint16_t length)
+{
+    t_e_frogfs_error fserr;
+    t_s_frogfs_record_info info;
+    uint8_t data[16];
+    uint16_t effective_read;
+    uint16_t pos;
+    uint16_t i;
+    bool written = true;
+
+    fserr = frogfs_stat(cut, record, &info);
+    if ((length > 0U) || (fserr != FROGFS_ERR_INVALID_OPERATION))
+    {
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        FROGFS_ASSERT((info.size >= length), true);
+
+        for (pos = 0; pos < info.size; pos += effective_read)
+        {
+            fserr = frogfs_pread(cut, record, pos, data, sizeof(data), &effective_read);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            FROGFS_ASSERT((effective_read > 0U), true);
+            for (i = 0; i < effective_read; i++)
+            {
+                if ((pos + i) < length)
+                {
+                    FROGFS_ASSERT(data[i], value);
+                }
+                else if (written && (data[i] == value))
+                {
+                    /* Still the written bytes */
+                }
+                else
+                {
+                    written = false;
+                    FROGFS_ASSERT(data[i], 0U);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * This test is used to verify that a record being written when the power is cut, with
+ * neither frogfs_flush nor frogfs_close, leaves a volume that mounts again: the record
+ * keeps the bytes written, possibly followed by zeros, and the other records are intact.
+ *
+ * @return  0 (or asserts)
+ */
+int test_power_cut_write(void)
+{
+    t_e_frogfs_error fserr;
+    t_s_frogfs_volume cut;
+#ifdef FROGFS_STORAGE_MMAP
+    t_s_mmap_storage storage;
+#else
+    t_s_file_storage storage;
+#endif
+    uint8_t data[10];
+    uint16_t budget;
+    uint8_t i;
+
+    (void)remove("eeprom4.bin");
+#ifdef FROGFS_STORAGE_MMAP
+    mmap_storage_open(&storage, "eeprom4.bin", TEST_STORAGE_SIZE);
+    test_cut_ops = &mmap_storage_ops;
+#else
+    file_storage_open(&storage, "eeprom4.bin", TEST_STORAGE_SIZE);
+    test_cut_ops = &file_storage_ops;
+#endif
+    test_cut_context = &storage;
+
+    /* Cut the power after each write in turn */
+    for (budget = 0U; ; budget++)
+    {
+        frogfs_volume_setup(&cut, &test_cut_storage_ops, NULL);
+        test_cut_budget = UINT16_MAX;
+        fserr = frogfs_format(&cut);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_init(&cut);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        (void)memset(data, 0x3C, sizeof(data));
+        fserr = frogfs_open(&cut, 1);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_write(&cut, 1, data, sizeof(data));
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_close(&cut, 1);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+        /* Neither flushed nor closed */
+        (void)memset(data, 0xA5, sizeof(data));
+        fserr = frogfs_open(&cut, 2);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        test_cut_budget = budget;
+        for (i = 0; (i < 10U) && (fserr == FROGFS_ERR_OK); i++)
+        {
+            fserr = frogfs_write(&cut, 2, data, sizeof(data));
+        }
+        frogfs_volume_release(&cut);
+
+        /* Power back on, the pending writes of the cache being lost */
+        frogfs_volume_setup(&cut, test_cut_ops, test_cut_context);
+        fserr = frogfs_init(&cut);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        (void)memset(data, 0x3C, sizeof(data));
+        test_power_cut_check(&cut, 1, 0x3CU, sizeof(data));
+        test_power_cut_check(&cut, 2, 0xA5U, 0U);
+
+        /* The volume is usable */
+        fserr = frogfs_open(&cut, 3);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_write(&cut, 3, data, sizeof(data));
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_close(&cut, 3);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_init(&cut);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        test_power_cut_check(&cut, 1, 0x3CU, sizeof(data));
+        test_power_cut_check(&cut, 3, 0x3CU, sizeof(data));
+        frogfs_volume_release(&cut);
+
+        if (test_cut_budget > 0U)
+        {
+            /* The writes completed */
+            break;
+        }
+        FROGFS_ASSERT((budget < 1000U), true);
+    }
+    printf("write cut at %u points\r\n", budget);
+
+    fserr = test_cut_ops->close(test_cut_context);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    return 0;
+}
+#endif
+
+#ifdef FROGFS_USE_EXTENDED_INDEX
+#define TEST_EXTENDED_COUNT         (5U)
+
+/**
+ * Read a record back and compare it with the first length bytes of the test content.
+ */
+static void test_extended_check(t_frogfs_record record, uint16_t length)
+{
+    t_e_frogfs_error fserr;
+    uint16_t effective_read;
+
+    fserr = frogfs_open(&volume, record);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    (void)memset(read_buffer, 0, sizeof(read_buffer));
+    fserr = frogfs_read(&volume, record, read_buffer, sizeof(read_buffer), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, length);
+    FROGFS_ASSERT(memcmp(read_buffer, TEST_CONTENT, length), 0);
+    fserr = frogfs_close(&volume, record);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+}
+
+/**
+ * This test is used to verify the extended record index: sparse indexes, also colliding
+ * in the hashed allocation table, are written, listed, erased and found again after
+ * the allocation table has been loaded from the checkpoint and scanned from the storage.
+ * The table holds FROGFS_MAX_RECORD_COUNT records at most.
+ *
+ * @return  0 (or asserts)
+ */
+int test_extended_index(void)
+{
+    t_e_frogfs_error fserr;
+    const t_frogfs_record records[TEST_EXTENDED_COUNT] =
+    {
+        7U, 7U + FROGFS_MAX_RECORD_COUNT, 7U + (2U * FROGFS_MAX_RECORD_COUNT), 1000U, FROGFS_RECORD_ID_LIMIT - 1U
+    };
+    t_frogfs_record list[FROGFS_MAX_RECORD_COUNT];
+    t_frogfs_record file_num;
+    t_frogfs_record next_record;
+    t_frogfs_record created = 0U;
+    t_s_frogfs_record_info info;
+#ifdef FROGFS_USE_CHECKPOINT
+    uint8_t zero = 0U;
+#endif
+    uint8_t i;
+    uint8_t j;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    for (i = 0; i < TEST_EXTENDED_COUNT; i++)
+    {
+        fserr = frogfs_open(&volume, records[i]);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_write(&volume, records[i], (const uint8_t*)TEST_CONTENT, (uint16_t)(10U + i));
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_close(&volume, records[i]);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+
+    /* The first three records share the same hash: they take consecutive slots */
+    FROGFS_ASSERT(volume.records[7].offset != 0U, true);
+    FROGFS_ASSERT(volume.records[8].offset != 0U, true);
+    FROGFS_ASSERT(volume.records[9].offset != 0U, true);
+
+    fserr = frogfs_list(&volume, list, FROGFS_MAX_RECORD_COUNT, &file_num);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(file_num, TEST_EXTENDED_COUNT);
+    for (i = 0; i < TEST_EXTENDED_COUNT; i++)
+    {
+        for (j = 0; (j < file_num) && (list[j] != records[i]); j++)
+        {
+            /* Look for the record in the list */
+        }
+        FROGFS_ASSERT(j < file_num, true);
+    }
+
+    /* Erase the record in the middle of the probe sequence: the last one is still found */
+    fserr = frogfs_erase(&volume, records[1]);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    test_extended_check(records[2], 12U);
+    fserr = frogfs_get_available(&volume, &next_record);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(next_record, 0U);
+
+    /* Simulate power-cycle: load the allocation table from the checkpoint (if used), then scan it */
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    test_extended_check(records[0], 10U);
+    test_extended_check(records[2], 12U);
+#ifdef FROGFS_USE_CHECKPOINT
+    fserr = storage_cache_write_at(&volume.storage, TEST_HEADER_SIZE, &zero, 1U);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+#endif
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    for (i = 0; i < TEST_EXTENDED_COUNT; i++)
+    {
+        if (i != 1U)
+        {
+            test_extended_check(records[i], (uint16_t)(10U + i));
+        }
+    }
+    fserr = frogfs_stat(&volume, records[1], &info);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_INVALID_OPERATION);
+    fserr = frogfs_open(&volume, FROGFS_RECORD_ID_LIMIT);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_INVALID_RECORD);
+
+    /* Fill the allocation table: no further record can be created */
+    do
+    {
+        fserr = frogfs_open(&volume, (t_frogfs_record)(2000U + created));
+        if (fserr == FROGFS_ERR_OK)
+        {
+            fserr = frogfs_close(&volume, (t_frogfs_record)(2000U + created));
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            created++;
+        }
+    } while (fserr == FROGFS_ERR_OK);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_INVALID_RECORD);
+    FROGFS_ASSERT(created, FROGFS_MAX_RECORD_COUNT - (TEST_EXTENDED_COUNT - 1U));
+    fserr = frogfs_get_available(&volume, &next_record);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OUT_OF_RANGE);
+    FROGFS_ASSERT(next_record, FROGFS_RECORD_NONE);
+    test_extended_check(records[4], 14U);
+
+    return 0;
+}
+#endif
+
+#ifdef FROGFS_USE_LOCKING
+#include <pthread.h>
+
+#define TEST_THREADS_RECORD_SIZE    (40U)
+#define TEST_THREADS_READERS        (4U)
+#define TEST_THREADS_LOOPS          (100U)
+#define TEST_THREADS_WRITER_RECORD  (5U)
+
+static uint8_t test_threads_pattern(uint8_t record, uint16_t pos)
+{
+    return (uint8_t)((record << 6U) + pos + 1U);
+}
+
+/**
+ * Reader thread: random access reads of its own record, sequential reads of record 0
+ * through a handle, list and stat.
+ */
+static void *test_threads_reader(void *arg)
+{
+    t_e_frogfs_error fserr;
+    t_s_frogfs_handle handle;
+    t_s_frogfs_record_info info;
+    uint8_t record = (uint8_t)(uintptr_t)arg;
+    t_frogfs_record list[FROGFS_MAX_RECORD_COUNT];
+    uint8_t buffer[8];
+    t_frogfs_record file_num;
+    uint16_t effective_read;
+    uint16_t offset;
+    uint16_t pos = 0U;
+    uint16_t i;
+    uint16_t j;
+
+    fserr = frogfs_handle_open(&volume, &handle, 0);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    for (i = 0; i < TEST_THREADS_LOOPS; i++)
+    {
+        offset = (uint16_t)((i * 7U) % (TEST_THREADS_RECORD_SIZE - sizeof(buffer)));
+        fserr = frogfs_pread(&volume, record, offset, buffer, sizeof(buffer), &effective_read);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        FROGFS_ASSERT(effective_read, sizeof(buffer));
+        for (j = 0; j < sizeof(buffer); j++)
+        {
+            FROGFS_ASSERT(buffer[j], test_threads_pattern(record, (uint16_t)(offset + j)));
+        }
+
+        fserr = frogfs_handle_read(&handle, buffer, 1U, &effective_read);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        if (effective_read == 0U)
+        {
+            fserr = frogfs_handle_seek(&handle, 0U);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            pos = 0U;
+        }
+        else
+        {
+            FROGFS_ASSERT(buffer[0], test_threads_pattern(0, pos));
+            pos++;
+        }
+
+        fserr = frogfs_stat(&volume, record, &info);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        FROGFS_ASSERT(info.size, TEST_THREADS_RECORD_SIZE);
+
+        fserr = frogfs_list(&volume, list, FROGFS_MAX_RECORD_COUNT, &file_num);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        FROGFS_ASSERT((file_num >= TEST_THREADS_READERS), true);
+    }
+
+    fserr = frogfs_handle_close(&handle);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    return NULL;
+}
+
+/**
+ * Writer thread: appends to its record while the readers are running.
+ */
+static void *test_threads_writer(void *arg)
+{
+    t_e_frogfs_error fserr;
+    uint8_t data;
+    uint16_t i;
+
+    (void)arg;
+
+    for (i = 0; i < TEST_THREADS_RECORD_SIZE; i++)
+    {
+        data = test_threads_pattern(TEST_THREADS_WRITER_RECORD, i);
+        fserr = frogfs_open_append(&volume, TEST_THREADS_WRITER_RECORD);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_write(&volume, TEST_THREADS_WRITER_RECORD, &data, 1U);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        fserr = frogfs_close(&volume, TEST_THREADS_WRITER_RECORD);
+        FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    }
+
+    return NULL;
+}
+
+/**
+ * This test is used to verify that several threads can use the same volume:
+ * readers of different records and of the same record run alongside a writer.
+ *
+ * @return  0 (or asserts)
+ */
+int test_threads(void)
+{
+    t_e_frogfs_error fserr;
+    pthread_t readers[TEST_THREADS_READERS];
+    pthread_t writer;
+    uint8_t data[TEST_THREADS_RECORD_SIZE];
+    uint16_t effective_read;
+    uint8_t i;
+    uint16_t j;
+
+    printf("Formatting media\r\n");
+    fserr = frogfs_format(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    fserr = frogfs_init(&volume);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+
+    /* One record per reader, written in two interleaved halves (two blocks each) */
+    for (j = 0; j < 2U; j++)
+    {
+        for (i = 0; i < TEST_THREADS_READERS; i++)
+        {
+            for (effective_read = 0; effective_read < sizeof(data); effective_read++)
+            {
+                data[effective_read] = test_threads_pattern(i, effective_read);
+            }
+            fserr = frogfs_open_append(&volume, i);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            fserr = frogfs_write(&volume, i, &data[j * (sizeof(data) / 2U)], sizeof(data) / 2U);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+            fserr = frogfs_close(&volume, i);
+            FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+        }
+    }
+
+    FROGFS_ASSERT(pthread_create(&writer, NULL, test_threads_writer, NULL), 0);
+    for (i = 0; i < TEST_THREADS_READERS; i++)
+    {
+        FROGFS_ASSERT(pthread_create(&readers[i], NULL, test_threads_reader, (void*)(uintptr_t)i), 0);
+    }
+    for (i = 0; i < TEST_THREADS_READERS; i++)
+    {
+        FROGFS_ASSERT(pthread_join(readers[i], NULL), 0);
+    }
+    FROGFS_ASSERT(pthread_join(writer, NULL), 0);
+
+    /* The record of the writer is complete */
+    fserr = frogfs_pread(&volume, TEST_THREADS_WRITER_RECORD, 0U, data, sizeof(data), &effective_read);
+    FROGFS_ASSERT(fserr, FROGFS_ERR_OK);
+    FROGFS_ASSERT(effective_read, sizeof(data));
+    for (j = 0; j < sizeof(data); j++)
+    {
+        FROGFS_ASSERT(data[j], test_threads_pattern(TEST_THREADS_WRITER_RECORD, j));
+    }
+
+    return 0;
+}
+#endif
+
+/* TODO tests to be implemented:
+ * - write non-opened file
+ * - read non-opened file
+ * - write maximum storage record, read and finally try to add new record
+ * - fragmentation test: worst case 1-byte data fragments (with initial EEPROM image)
+ * - test frogfs_find_contiguous_space in A) filesystem empty B) filesystem full C) other mixed cases...
+ */
+
+int frogfs_execute_test(void)
+{
+    t_e_frogfs_error fserr;
+
+    FROGFS_DEBUG_VERBOSE("START: test_contiguous");
+    test_contiguous();
+    FROGFS_DEBUG_VERBOSE("START: test_reopen");
+    test_reopen();
+    FROGFS_DEBUG_VERBOSE("START: test_contiguous_and_remove");
+    test_contiguous_and_remove();
+    FROGFS_DEBUG_VERBOSE("START: test_contiguous_and_remove_at_end");
+    test_contiguous_and_remove_at_end();
+    FROGFS_DEBUG_VERBOSE("START: test_record_limit");
+    test_record_limit();
+    FROGFS_DEBUG_VERBOSE("START: test_fragmentation");
+    test_fragmentation();
+    FROGFS_DEBUG_VERBOSE("START: test_0_byte_record");
+    test_0_byte_record();
+    FROGFS_DEBUG_VERBOSE("START: test_use_case_settings");
+    test_use_case_settings(true, true);
+    FROGFS_DEBUG_VERBOSE("START: test_unclosed_file");
+    test_unclosed_file();
+    FROGFS_DEBUG_VERBOSE("START: test_file0_and_file1");
+    test_file0_and_file1();
+    FROGFS_DEBUG_VERBOSE("START: test_zero_data_record");
+    test_zero_data_record();
+    FROGFS_DEBUG_VERBOSE("START: test_free_map");
+    test_free_map();
+    FROGFS_DEBUG_VERBOSE("START: test_checkpoint");
+    test_checkpoint();
+    FROGFS_DEBUG_VERBOSE("START: test_quick_format");
+    test_quick_format();
+    FROGFS_DEBUG_VERBOSE("START: test_high_water");
+    test_high_water();
+    FROGFS_DEBUG_VERBOSE("START: test_maintenance");
+    test_maintenance();
+    FROGFS_DEBUG_VERBOSE("START: test_maintenance_holes");
+    test_maintenance_holes();
+    FROGFS_DEBUG_VERBOSE("START: test_cache");
+    test_cache();
+    FROGFS_DEBUG_VERBOSE("START: test_deferred_header");
+    test_deferred_header();
+    FROGFS_DEBUG_VERBOSE("START: test_append");
+    test_append();
+    FROGFS_DEBUG_VERBOSE("START: test_extent_cache");
+    test_extent_cache();
+    FROGFS_DEBUG_VERBOSE("START: test_seek");
+    test_seek();
+    FROGFS_DEBUG_VERBOSE("START: test_stat");
+    test_stat();
+    FROGFS_DEBUG_VERBOSE("START: test_open_sized");
+    test_open_sized();
+    FROGFS_DEBUG_VERBOSE("START: test_reserve");
+    test_reserve();
+    FROGFS_DEBUG_VERBOSE("START: test_next_fit");
+    test_next_fit();
+    FROGFS_DEBUG_VERBOSE("START: test_handles");
+    test_handles();
+#ifdef __linux__
+    FROGFS_DEBUG_VERBOSE("START: test_volumes");
+    test_volumes();
+    FROGFS_DEBUG_VERBOSE("START: test_large_storage");
+    test_large_storage();
+    FROGFS_DEBUG_VERBOSE("START: test_compaction");
+    test_compaction();
+    FROGFS_DEBUG_VERBOSE("START: test_cache_order");
+    test_cache_order();
+    FROGFS_DEBUG_VERBOSE("START: test_power_cut_write");
+    test_power_cut_write();
+#endif
+#ifdef FROGFS_USE_EXTENDED_INDEX
+    FROGFS_DEBUG_VERBOSE("START: test_extended_index");
+    test_extended_index();
+#endif
+#ifdef FROGFS_USE_LOCKING
+    FROGFS_DEBUG_VERBOSE("START: test_threads");
+    test_threads();
+#endif
+
+    fserr = storage_cache_close(&volume.storage);
+    FROGFS_ASSERT_VERBOSE(fserr, FROGFS_ERR_OK, "assertion failed at closing the storage layer.");
+    frogfs_volume_release(&volume);
+
+    FROGFS_DEBUG_VERBOSE("test passed");
+
+    return 0;
+}
+
+#ifdef __linux__
+/* Execute tests on a hosted linux platform */
+int main(void)
+{
+#ifdef FROGFS_STORAGE_MMAP
+    /* Initialize the memory mapped storage backend for FrogFS */
+    mmap_storage_set_size(TEST_STORAGE_SIZE);
+    frogfs_volume_setup(&volume, &mmap_storage_ops, NULL);
+#else
+    /* Initialize the stdio-file storage backend for FrogFS */
+    file_storage_set_size(TEST_STORAGE_SIZE);
+    frogfs_volume_setup(&volume, &file_storage_ops, NULL);
+#endif
 
     return frogfs_execute_test();
 }